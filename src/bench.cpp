@@ -0,0 +1,510 @@
+// Copyright 2019 by Jon Dart. All Rights Reserved.
+//
+#include "bench.h"
+#include "boardio.h"
+#include "bookread.h"
+#include "globals.h"
+#include "notation.h"
+#include "movegen.h"
+#include "see.h"
+
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <thread>
+#include <vector>
+
+static const char *benchPositions[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq -",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -",
+    "r1bq1rk1/pp2bppp/2n1pn2/3p4/2PP4/2N1PN2/PP1B1PPP/R2QKB1R w KQ -",
+    "r1bqk2r/pp2bppp/2p5/3pP3/P2Q1P2/2N1B3/1PP3PP/R4RK1 b kq -",
+    "r2q1rk1/pb1nbppp/1p2pn2/2pp4/3P4/1P1BPN2/PBPN1PPP/R2Q1RK1 w - -",
+    "2rq1rk1/pp1bppbp/2np1np1/8/3NP3/1BN1BP2/PPPQ2PP/2KR3R b - -",
+    "r1bbk1nr/pp3p1p/2n5/1N4p1/2Np1B2/8/PPP2PPP/2KR1B1R w kq -",
+    "4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - -",
+    "r3r1k1/2p2ppp/p1p1bn2/8/1q2P3/2NPQN2/PPP3PP/R4RK1 b - -",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - -",
+    "3r1rk1/p5pp/bpp1pp2/8/q1PP1P2/b3P3/P2NQRPP/1R2B1K1 b - -",
+    "6k1/6p1/6Pp/ppp5/3pn2P/1P3K2/1PP2P2/3N4 b - -",
+    "8/8/8/8/5kp1/P7/8/1K1N4 w - -",
+    "8/3k4/8/8/8/4B3/4KB2/2B5 w - -",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - -",
+    "2K5/p7/7P/5pR1/8/5k2/r7/8 w - -"
+};
+
+static volatile score_t evalSink;
+
+static volatile int bookSink;
+
+static volatile score_t seeSink;
+
+// Number of book positions used by bookSpeed.
+static const size_t BOOK_BENCH_POSITIONS = 2000;
+
+// Book lookup as done before the book was memory-mapped: read the
+// index page and data page from the file on each call (version 15
+// books only).
+static int streamLookup(ifstream &book_file, unsigned num_index_pages,
+                        const Board &board, vector<book::DataEntry> &results) {
+   results.clear();
+   int probe = (int)(board.hashCode() % num_index_pages);
+   book_file.seekg((std::ios::off_type)(sizeof(book::BookHeader)+probe*sizeof(book::IndexPage)), std::ios_base::beg);
+   if (book_file.fail()) return -1;
+   book::IndexPage index;
+   book_file.read((char*)&index,sizeof(book::IndexPage));
+   if (book_file.fail()) return -1;
+   index.next_free = swapEndian32((byte*)&index.next_free);
+   book::BookLocation loc(0,book::INVALID_INDEX);
+   for (unsigned i = 0; i < index.next_free; i++) {
+      uint64_t indexHashCode = (uint64_t)(swapEndian64((byte*)&index.index[i].hashCode));
+      if (indexHashCode == board.hashCode()) {
+         index.index[i].page = (uint16_t)(swapEndian16((byte*)&index.index[i].page));
+         index.index[i].index = (uint16_t)(swapEndian16((byte*)&index.index[i].index));
+         loc = index.index[i];
+         break;
+      }
+   }
+   if (!loc.isValid()) {
+       return 0;
+   }
+   book_file.seekg(sizeof(book::BookHeader)+
+                   num_index_pages*sizeof(book::IndexPage)+
+                   loc.page*sizeof(book::DataPage));
+   if (book_file.fail()) return -1;
+   book::DataPage data;
+   book_file.read((char*)&data,sizeof(book::DataPage));
+   if (book_file.fail()) return -1;
+   while(loc.index != book::NO_NEXT) {
+       book::DataEntry &bookEntry = data.data[loc.index];
+       bookEntry.next = swapEndian16((byte*)&bookEntry.next);
+       bookEntry.win = swapEndian32((byte*)&bookEntry.win);
+       bookEntry.loss = swapEndian32((byte*)&bookEntry.loss);
+       bookEntry.draw = swapEndian32((byte*)&bookEntry.draw);
+       results.push_back(bookEntry);
+       loc.index = bookEntry.next;
+   }
+   return (int)results.size();
+}
+
+ostream & operator << (ostream &o, const Bench::Results &r) {
+    o << "positions: " << r.positions << endl;
+    o << "nodes    : " << r.nodes << endl;
+    o << "time     : " << r.time << " ms" << endl;
+    o << "nps      : ";
+    if (r.time) {
+        Statistics::printNPS(o,r.nodes,r.time);
+    } else {
+        o << "n/a";
+    }
+    o << endl;
+    std::ios_base::fmtflags original_flags = o.flags();
+    o << "hash full: " << setprecision(3) << r.hashFull/10.0 << '%' << endl;
+    o.flags(original_flags);
+    return o;
+}
+
+void Bench::start(SearchController *searcher)
+{
+    savedOptions = options;
+    options.book.book_enabled = 0;
+    options.learning.position_learning = 0;
+
+    delayedInit();
+
+    // Do not terminate the searches early due to pending input
+    savedMonitor = searcher->registerMonitorFunction(nullptr);
+    savedPost = searcher->registerPostFunction(nullptr);
+}
+
+void Bench::finish(SearchController *searcher)
+{
+    searcher->registerMonitorFunction(savedMonitor);
+    searcher->registerPostFunction(savedPost);
+    options = savedOptions;
+}
+
+Bench::Results Bench::bench(SearchController *searcher, int depth, bool verbose)
+{
+    start(searcher);
+    Results results;
+    uint64_t hashFullTotal = 0ULL;
+    for (const char *fen : benchPositions) {
+        Board board;
+        if (!BoardIO::readFEN(board, fen)) {
+            cerr << "bench: error in FEN: " << fen << endl;
+            continue;
+        }
+        searcher->clearHashTables();
+        Statistics stats;
+        MoveSet excludes, includes;
+        Move result = searcher->findBestMove(board,
+                                             FixedDepth,
+                                             INFINITE_TIME, 0, depth,
+                                             0, 0, stats,
+                                             Silent,
+                                             excludes, includes);
+        gameMoves->removeAll();
+        results.nodes += stats.num_nodes;
+        results.time += searcher->getElapsedTime();
+        hashFullTotal += searcher->hashTable.pctFull();
+        ++results.positions;
+        if (verbose) {
+            cout << fen << '\t';
+            Notation::image(board,result,Notation::OutputFormat::SAN,cout);
+            cout << '\t' << stats.num_nodes << " nodes\t" <<
+                searcher->getElapsedTime() << " ms" << endl;
+        }
+    }
+    if (results.positions) {
+        results.hashFull = int(hashFullTotal/results.positions);
+    }
+    finish(searcher);
+    return results;
+}
+
+void Bench::scaling(SearchController *searcher, int depth, unsigned maxThreads,
+                    ostream &out)
+{
+    const int ncpus = options.search.ncpus;
+    maxThreads = std::min<unsigned>(maxThreads,Constants::MaxCPUs);
+    std::ios_base::fmtflags original_flags = out.flags();
+    out << "threads     time(ms)        nodes          nps  ttd speedup  nps speedup" << endl;
+    Results base;
+    for (unsigned threads = 1; threads <= maxThreads; ) {
+        options.search.ncpus = threads;
+        searcher->updateSearchOptions();
+        Results r = bench(searcher, depth, false);
+        if (threads == 1) base = r;
+        const double nps = r.time ? 1000.0*r.nodes/r.time : 0.0;
+        const double baseNps = base.time ? 1000.0*base.nodes/base.time : 0.0;
+        out << setw(7) << threads << setw(13) << r.time << setw(13) << r.nodes <<
+            setw(13) << std::fixed << setprecision(0) << nps <<
+            setw(13) << setprecision(2) << (r.time ? double(base.time)/r.time : 0.0) <<
+            setw(13) << (baseNps > 0.0 ? nps/baseNps : 0.0) << endl;
+        if (threads == maxThreads) break;
+        threads = std::min(2*threads,maxThreads);
+    }
+    out.flags(original_flags);
+    options.search.ncpus = ncpus;
+    searcher->updateSearchOptions();
+}
+
+void Bench::latency(SearchController *searcher, int iterations, ostream &out)
+{
+    start(searcher);
+    Board board;
+    uint64_t startTotal = 0ULL, startMax = 0ULL, searchTotal = 0ULL;
+    for (int i = 0; i < iterations; i++) {
+        Statistics stats;
+        MoveSet excludes, includes;
+        const CLOCK_TYPE startTime = getCurrentTime();
+        searcher->findBestMove(board,
+                               FixedDepth,
+                               INFINITE_TIME, 0, 1,
+                               0, 0, stats,
+                               Silent,
+                               excludes, includes);
+        searchTotal += std::chrono::duration_cast<std::chrono::microseconds>(
+            getCurrentTime() - startTime).count();
+        gameMoves->removeAll();
+        const uint64_t latency = searcher->startLatency();
+        startTotal += latency;
+        startMax = std::max<uint64_t>(startMax,latency);
+    }
+    finish(searcher);
+    if (iterations <= 0) return;
+    out << "threads          : " << options.search.ncpus << endl;
+    out << "searches         : " << iterations << endl;
+    if (options.search.ncpus > 1) {
+        out << "start latency avg: " << startTotal/iterations << " us" << endl;
+        out << "start latency max: " << startMax << " us" << endl;
+    }
+    out << "search time avg  : " << searchTotal/iterations << " us" << endl;
+}
+
+void Bench::polling(SearchController *searcher, int depth, ostream &out)
+{
+    const Results quiet = bench(searcher, depth, false);
+    std::atomic<bool> done(false);
+    uint64_t polls = 0ULL, sum = 0ULL;
+    std::thread poller([&]() {
+        while (!done.load(std::memory_order_relaxed)) {
+            sum += searcher->totalNodes();
+            ++polls;
+        }
+    });
+    const Results polled = bench(searcher, depth, false);
+    done = true;
+    poller.join();
+    const double quietNps = quiet.time ? 1000.0*quiet.nodes/quiet.time : 0.0;
+    const double polledNps = polled.time ? 1000.0*polled.nodes/polled.time : 0.0;
+    std::ios_base::fmtflags original_flags = out.flags();
+    out << std::fixed << setprecision(0);
+    out << "threads          : " << options.search.ncpus << endl;
+    out << "nps, no polling  : " << quietNps << endl;
+    out << "nps, polling     : " << polledNps << " (" << polls << " polls)" << endl;
+    out << setprecision(3);
+    out << "ratio            : " << (quietNps > 0.0 ? polledNps/quietNps : 0.0) << endl;
+    out.flags(original_flags);
+}
+
+void Bench::evalSpeed(ostream &out)
+{
+    std::unique_ptr<nnue::Network> net(new nnue::Network());
+    const bool randomWeights = !net->load(options.search.nn_file);
+    if (randomWeights) {
+        // weights do not affect the speed
+        net->randomize(0ULL);
+    }
+    std::unique_ptr<nnue::AccumulatorStack> stack(new nnue::AccumulatorStack());
+    std::unique_ptr<Scoring> scoring(new Scoring());
+    vector<Board> boards;
+    vector< vector<Move> > moves;
+    for (const char *fen : benchPositions) {
+        Board board;
+        if (!BoardIO::readFEN(board, fen)) {
+            cerr << "bench: error in FEN: " << fen << endl;
+            continue;
+        }
+        RootMoveGenerator mg(board);
+        vector<Move> list;
+        Move m;
+        int order;
+        while ((m = mg.nextMove(order)) != NullMove) {
+            list.push_back(m);
+        }
+        boards.push_back(board);
+        moves.push_back(list);
+    }
+    enum Kernel {Standard, NNScalar, NNSimd};
+    const int kernels = nnue::Network::simdKernel() ? 3 : 2;
+    const int nnEval = options.search.nn_eval;
+    // make sure evalu8 uses the standard evaluation
+    options.search.nn_eval = 0;
+    std::ios_base::fmtflags original_flags = out.flags();
+    out << "evaluator             evals/sec" << endl;
+    for (int k = Standard; k < kernels; k++) {
+        uint64_t evals = 0ULL, elapsed = 0ULL;
+        const CLOCK_TYPE startTime = getCurrentTime();
+        score_t total = 0;
+        // evaluate the positions after each move (so the network
+        // accumulators are updated incrementally), for at least
+        // one second
+        while (elapsed < 1000) {
+            for (size_t i = 0; i < boards.size(); i++) {
+                Board &board = boards[i];
+                board.setAccumulatorStack(k == Standard ? nullptr : stack.get());
+                const BoardState state(board.state);
+                for (Move m : moves[i]) {
+                    board.doMove(m);
+                    if (k == Standard) {
+                        total += scoring->evalu8(board);
+                    }
+                    else {
+                        total += net->evaluate(board, k == NNScalar);
+                    }
+                    board.undoMove(m,state);
+                    ++evals;
+                }
+                board.setAccumulatorStack(nullptr);
+            }
+            elapsed = getElapsedTime(startTime,getCurrentTime());
+        }
+        string name;
+        if (k == Standard) {
+            name = "standard";
+        }
+        else {
+            name = string("network (") +
+                (k == NNScalar ? "scalar" : nnue::Network::simdKernel()) + ")";
+        }
+        // keep the evaluations from being optimized away
+        evalSink = total;
+        out << std::left << setw(18) << name << std::right << setw(14) <<
+            std::fixed << setprecision(0) << 1000.0*evals/elapsed << endl;
+    }
+    out.flags(original_flags);
+    options.search.nn_eval = nnEval;
+    if (randomWeights) {
+        out << "(network file " << options.search.nn_file <<
+            " not loaded, used random weights)" << endl;
+    }
+}
+
+void Bench::seeSpeed(ostream &out)
+{
+    // capture lists for the positions after each move from the
+    // benchmark positions
+    vector<Board> boards;
+    vector< vector<Move> > captures;
+    for (const char *fen : benchPositions) {
+        Board board;
+        if (!BoardIO::readFEN(board, fen)) {
+            cerr << "bench: error in FEN: " << fen << endl;
+            continue;
+        }
+        RootMoveGenerator mg(board);
+        Move m;
+        int order;
+        while ((m = mg.nextMove(order)) != NullMove) {
+            Board next(board);
+            next.doMove(m);
+            if (next.checkStatus() == InCheck) continue;
+            MoveGenerator mg2(next);
+            Move moves[Constants::MaxMoves];
+            const int n = mg2.generateCaptures(moves);
+            vector<Move> list;
+            for (int i = 0; i < n; i++) {
+                // skip promotions without capture and king captures
+                if (Capture(moves[i]) != Empty && Capture(moves[i]) != King) {
+                    list.push_back(moves[i]);
+                }
+            }
+            if (!list.empty()) {
+                boards.push_back(next);
+                captures.push_back(list);
+            }
+        }
+    }
+    size_t total = 0;
+    for (const vector<Move> &list : captures) total += list.size();
+    out << boards.size() << " positions, " << total << " captures" << endl;
+    std::ios_base::fmtflags original_flags = out.flags();
+    out << "method                 SEE/sec" << endl;
+    static const char *names[] = {"see", "see (batch)", "seeSign",
+                                  "seeSign (batch)"};
+    score_t scores[Constants::MaxMoves];
+    // Run the methods in turn, several times each, and report the
+    // best rate for each, so they are compared under similar load.
+    static constexpr int METHODS = 4, ROUNDS = 5;
+    double best[METHODS] = {0.0, 0.0, 0.0, 0.0};
+    for (int round = 0; round < ROUNDS; round++) {
+        for (int method = 0; method < METHODS; method++) {
+            uint64_t calls = 0ULL, elapsed = 0ULL;
+            score_t sum = 0;
+            const CLOCK_TYPE startTime = getCurrentTime();
+            while (elapsed < 250) {
+                for (size_t i = 0; i < boards.size(); i++) {
+                    const Board &board = boards[i];
+                    const vector<Move> &list = captures[i];
+                    const int n = (int)list.size();
+                    switch(method) {
+                    case 0:
+                        for (int j = 0; j < n; j++) sum += see(board,list[j]);
+                        break;
+                    case 1:
+                        seeBatch(board,list.data(),n,scores);
+                        for (int j = 0; j < n; j++) sum += scores[j];
+                        break;
+                    case 2:
+                        for (int j = 0; j < n; j++) sum += seeSign(board,list[j],0);
+                        break;
+                    default:
+                        seeSignBatch(board,list.data(),n,0,scores);
+                        for (int j = 0; j < n; j++) sum += scores[j];
+                        break;
+                    }
+                    calls += n;
+                }
+                elapsed = getElapsedTime(startTime,getCurrentTime());
+            }
+            seeSink = sum;
+            best[method] = std::max<double>(best[method],1000.0*calls/elapsed);
+        }
+    }
+    for (int method = 0; method < METHODS; method++) {
+        out << std::left << setw(18) << names[method] << std::right <<
+            setw(12) << std::fixed << setprecision(0) << best[method] << endl;
+    }
+    out.flags(original_flags);
+}
+
+void Bench::bookSpeed(const string &bookFile, ostream &out)
+{
+    BookReader reader;
+    ifstream book_file(bookFile.c_str(), ios_base::in | ios_base::binary);
+    if (reader.open(bookFile.c_str()) || !book_file.good()) {
+        out << "bench: could not open book " << bookFile << endl;
+        return;
+    }
+    // collect positions by following book moves breadth-first
+    vector<Board> boards(1);
+    vector<book::DataEntry> entries, oldEntries;
+    for (size_t i = 0; i < boards.size() && boards.size() < BOOK_BENCH_POSITIONS; i++) {
+        if (reader.lookup(boards[i],entries) <= 0) continue;
+        Move move_list[Constants::MaxMoves];
+        RootMoveGenerator mg(boards[i]);
+        const int n = mg.generateAllMoves(move_list,1 /* repeatable */);
+        for (const book::DataEntry &entry : entries) {
+            if (entry.index < n && boards.size() < BOOK_BENCH_POSITIONS) {
+                Board board(boards[i]);
+                board.doMove(move_list[entry.index]);
+                boards.push_back(board);
+            }
+        }
+    }
+    for (const char *fen : benchPositions) {
+        Board board;
+        if (BoardIO::readFEN(board, fen)) {
+            boards.push_back(board);
+        }
+    }
+    // check that both methods agree
+    const bool paged = reader.version == book::BOOK_VERSION_PAGED;
+    unsigned found = 0, mismatches = 0;
+    for (const Board &board : boards) {
+        const int n = reader.lookup(board,entries);
+        if (n > 0) ++found;
+        if (!paged) continue;
+        if (n != streamLookup(book_file,reader.hdr.num_index_pages,board,oldEntries)) {
+            ++mismatches;
+            continue;
+        }
+        for (int i = 0; i < n; i++) {
+            if (entries[i].index != oldEntries[i].index ||
+                entries[i].count() != oldEntries[i].count()) {
+                ++mismatches;
+                break;
+            }
+        }
+    }
+    out << boards.size() << " positions, " << found << " in book (version " <<
+        reader.version << " format)";
+    if (mismatches) {
+        out << ", " << mismatches << " lookup mismatches";
+    }
+    out << endl;
+    std::ios_base::fmtflags original_flags = out.flags();
+    out << "lookup method      usec/lookup" << endl;
+    // methods: 0 = file read, 1 = mapped (the positions cycle through
+    // more than the reader caches), 2 = repeated probes of a position,
+    // answered from the cache
+    static const char *methodNames[] = {"file read", "mapped", "cached"};
+    for (int method = paged ? 0 : 1; method < 3; method++) {
+        const unsigned repeat = method == 2 ? 4 : 1;
+        uint64_t lookups = 0ULL, elapsed = 0ULL;
+        int total = 0;
+        const CLOCK_TYPE startTime = getCurrentTime();
+        // repeat for at least one second
+        while (elapsed < 1000) {
+            for (const Board &board : boards) {
+                for (unsigned r = 0; r < repeat; r++) {
+                    if (method) {
+                        total += reader.lookup(board,entries);
+                    } else {
+                        total += streamLookup(book_file,reader.hdr.num_index_pages,board,oldEntries);
+                    }
+                }
+            }
+            lookups += repeat*boards.size();
+            elapsed = getElapsedTime(startTime,getCurrentTime());
+        }
+        bookSink = total;
+        out << std::left << setw(18) << methodNames[method] <<
+            std::right << setw(12) << std::fixed << setprecision(3) <<
+            1000.0*elapsed/lookups << endl;
+    }
+    out.flags(original_flags);
+}
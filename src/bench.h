@@ -0,0 +1,96 @@
+// Support for the "bench" command (search speed benchmark).
+// Copyright 2019 by Jon Dart. All Rights Reserved.
+//
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include "search.h"
+
+using namespace std;
+
+class Bench
+{
+
+public:
+    Bench() = default;
+
+    virtual ~Bench() = default;
+
+    static const int DEFAULT_DEPTH = 12;
+
+    struct Results {
+        uint64_t nodes;
+        uint64_t time; // in milliseconds
+        int positions;
+        int hashFull; // percentage x 10, averaged over positions
+
+        Results() :
+            nodes(0ULL),
+            time(0ULL),
+            positions(0),
+            hashFull(0) {
+        }
+
+        friend ostream & operator << (ostream &o, const Results &r);
+    };
+
+    // Search each of a fixed set of positions to the given depth,
+    // using the current thread count and hash size, and return
+    // the totals.
+    Results bench(SearchController *searcher, int depth, bool verbose);
+
+    // Run the benchmark with 1, 2, 4, ... threads, up to maxThreads,
+    // and report time to depth and nps for each thread count, with
+    // the speedup relative to one thread.
+    void scaling(SearchController *searcher, int depth, unsigned maxThreads,
+                 ostream &out);
+
+    // Run the benchmark without, then with, another thread
+    // continuously reading the node count (as for a GUI that polls
+    // for frequent updates), and report nps for each.
+    void polling(SearchController *searcher, int depth, ostream &out);
+
+    static const int DEFAULT_LATENCY_ITERATIONS = 200;
+
+    // Run repeated depth-1 searches with the current thread count and
+    // report the time from the start of each search until the helper
+    // threads begin searching (start latency), and the total time per
+    // search.
+    void latency(SearchController *searcher, int iterations, ostream &out);
+
+    // Report evaluations per second for the standard evaluation and
+    // for the network evaluation with each kernel compiled in (scalar
+    // and SIMD), over the positions reached by one move from each
+    // benchmark position. Uses random network weights if the network
+    // file cannot be loaded.
+    void evalSpeed(ostream &out);
+
+    // Report static exchange evaluations (SEE) per second over the
+    // captures in the positions reached by one move from each
+    // benchmark position, evaluating the captures for each position
+    // one at a time and as a batch, for both see() and seeSign().
+    void seeSpeed(ostream &out);
+
+    // Report the time per opening book lookup, with the book file
+    // memory-mapped (as used by the program) and, for version 15
+    // books, with the previous method of reading index and data
+    // pages from the file for each lookup, over positions reached by
+    // book moves from the starting position and over the benchmark
+    // positions (mostly not in book). Also reports the time for
+    // repeated lookups of a position, answered from the reader's cache.
+    void bookSpeed(const string &bookFile, ostream &out);
+
+private:
+    // Set up for benchmark searches (no book, learning, monitor
+    // or post output) and restore the previous settings.
+    void start(SearchController *searcher);
+
+    void finish(SearchController *searcher);
+
+    Options savedOptions;
+    SearchController::MonitorFunction savedMonitor;
+    SearchController::PostFunction savedPost;
+
+};
+
+#endif
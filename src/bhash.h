@@ -16,6 +16,9 @@ class BoardHash
 	public:
 		
 	static hash_t hashCode(const Board &);
+
+        // Compute the key used by Polyglot format opening books.
+        static hash_t polyglotHashCode(const Board &);
 	
         static hash_t pawnHash(const Board &, ColorType side);
 
@@ -7,6 +7,9 @@
 #include "debug.h"
 #include "boardio.h"
 #include "bhash.h"
+#ifndef TUNE
+#include "params.h"
+#endif
 #include <ctype.h>
 #include <memory.h>
 #include <assert.h>
@@ -29,8 +32,61 @@ const hash_t rep_codes[3] =
 
 static Board *initialBoard = nullptr;
 
+#ifndef TUNE
+PstScore Board::pstTable[2][8][64];
+
+unsigned Board::pstTableVersion = 0;
+
+void Board::initPstTable() {
+   memset(pstTable,'\0',sizeof(pstTable));
+   for (int i = 0; i < 2; i++) {
+      const ColorType side = (ColorType)i;
+      for (Square sq = 0; sq < 64; sq++) {
+         const Square scoreSq = (side == White) ? sq : 63 - sq;
+         pstTable[side][Knight][sq].mid = Params::KNIGHT_PST[0][scoreSq];
+         pstTable[side][Knight][sq].end = Params::KNIGHT_PST[1][scoreSq];
+         pstTable[side][Bishop][sq].mid = Params::BISHOP_PST[0][scoreSq];
+         pstTable[side][Bishop][sq].end = Params::BISHOP_PST[1][scoreSq];
+         pstTable[side][Rook][sq].mid = Params::ROOK_PST[0][scoreSq];
+         pstTable[side][Rook][sq].end = Params::ROOK_PST[1][scoreSq];
+         pstTable[side][Queen][sq].mid = Params::QUEEN_PST[0][scoreSq];
+         pstTable[side][Queen][sq].end = Params::QUEEN_PST[1][scoreSq];
+         // king endgame position is scored separately (see
+         // Scoring::calcKingEndgamePosition)
+         pstTable[side][King][sq].mid = Params::KING_PST[0][scoreSq];
+      }
+   }
+   ++pstTableVersion;
+   // boards created by copying the initial board use its sums
+   if (initialBoard) {
+      initialBoard->setSecondaryVars();
+   }
+}
+
+void Board::updatePst(Move move)
+{
+   const ColorType oside = OppositeColor(side);
+   const Square start = StartSquare(move);
+   const Square dest = DestSquare(move);
+   // pawn entries are zero, so en passant captures and the pawn
+   // side of promotions need no special handling
+   subPst(side,PieceMoved(move),start);
+   addPst(side,TypeOfMove(move) == Promotion ? PromoteTo(move) : PieceMoved(move),dest);
+   subPst(oside,Capture(move),dest);
+   if (TypeOfMove(move) == KCastle) {
+      subPst(side,Rook,start+3);
+      addPst(side,Rook,start+1);
+   }
+   else if (TypeOfMove(move) == QCastle) {
+      subPst(side,Rook,start-4);
+      addPst(side,Rook,start-1);
+   }
+}
+#endif
+
 void Board::setupInitialBoard() {
    initialBoard = (Board*)malloc(sizeof(Board));
+   initialBoard->accStack = nullptr;
    static PieceType pieces[] =
    {
       Rook,
@@ -63,7 +119,12 @@ void Board::setupInitialBoard() {
    initialBoard->state.castleStatus[White] = initialBoard->state.castleStatus[Black] = CanCastleEitherSide;
    initialBoard->state.moveCount = 0;
    initialBoard->repListHead = initialBoard->repList;
+#ifdef TUNE
    initialBoard->setSecondaryVars();
+#else
+   // also sets the initial board's secondary vars
+   initPstTable();
+#endif
    *(initialBoard->repListHead)++ = initialBoard->hashCode();
 }
 
@@ -88,6 +149,10 @@ void Board::setSecondaryVars()
    allOccupied.clear();
    kingPos[White] = InvalidSquare;
    kingPos[Black] = InvalidSquare;
+#ifndef TUNE
+   state.pst[White].mid = state.pst[White].end = 0;
+   state.pst[Black].mid = state.pst[Black].end = 0;
+#endif
    for (i=0;i<64;i++)
    {
       Square sq(i);
@@ -98,6 +163,9 @@ void Board::setSecondaryVars()
          occupied[color].set(sq);
          allOccupied.set(sq);
          material[color].addPiece(TypeOfPiece(piece));
+#ifndef TUNE
+         addPst(color,TypeOfPiece(piece),sq);
+#endif
          switch (TypeOfPiece(piece))
          {
          case King:
@@ -126,6 +194,7 @@ void Board::setSecondaryVars()
    state.hashCode = BoardHash::hashCode(*this);
    pawnHashCodeW = BoardHash::pawnHash(*this,White);
    pawnHashCodeB = BoardHash::pawnHash(*this,Black);
+   if (accStack) accStack->reset();
 }
 
 void Board::setCastleStatus( CastleType t, ColorType side )
@@ -157,11 +226,13 @@ void Board::makeEmpty() {
 }
 
 Board::Board()
+   : accStack(nullptr)
 {
    reset();
 }
 
 Board::Board(const Board &b)
+   : accStack(nullptr)
 {
    // Copy all contents except the repetition list
    memcpy(&contents,&b.contents,(byte*)repList-(byte*)&contents);
@@ -186,10 +257,17 @@ Board &Board::operator = (const Board &b)
           memcpy(repList,b.repList,sizeof(hash_t)*rep_entries);
       }
       repListHead = repList + rep_entries;
+      if (accStack) accStack->reset();
    }
    return *this;
 }
 
+void Board::setAccumulatorStack(nnue::AccumulatorStack *stack)
+{
+   accStack = stack;
+   if (accStack) accStack->reset();
+}
+
 Board::~Board()
 {
 }
@@ -264,6 +342,7 @@ void Board::doNull()
    state.hashCode = BoardHash::setSideToMove(state.hashCode,side);
    *repListHead++ = state.hashCode;
    ASSERT(repListHead-repList < (int)RepListSize);
+   if (accStack) accStack->pushNull();
    ASSERT(state.hashCode == BoardHash::hashCode(*this));
 }
 
@@ -296,6 +375,10 @@ void Board::doMove( Move move )
            }
    }
 #endif
+#ifndef TUNE
+   updatePst(move);
+#endif
+   if (accStack) accStack->push(move,side);
    if (side == White)
    {
       if (moveType == KCastle)
@@ -1027,6 +1110,7 @@ void Board::undoCastling(Square kp, Square oldkingsq, Square newrooksq,
 void Board::undoMove( Move move, const BoardState &old_state )
 {
    side = OppositeColor(side);
+   if (accStack) accStack->pop();
    if (!IsNull(move))
    {
       const MoveType moveType = TypeOfMove(move);
@@ -10,6 +10,7 @@
 #include "bitboard.h"
 #include "attacks.h"
 #include "material.h"
+#include "nnue.h"
 
 class Board;
 
@@ -24,12 +25,26 @@ enum CastleType { CanCastleEitherSide,
           
 enum CheckStatusType { NotInCheck, InCheck, CheckUnknown };
 
+#ifndef TUNE
+// Midgame and endgame piece-square sums for one side.
+struct PstScore {
+   score_t mid, end;
+};
+#endif
+
 struct BoardState {
    hash_t hashCode;
    Square enPassantSq;
    int moveCount;
    CheckStatusType checkStatus;
    CastleType castleStatus[2];
+#ifndef TUNE
+   // Piece-square table sums for non-pawn pieces, maintained
+   // incrementally by doMove (undoMove restores them with the rest of
+   // the state). Not used in tuning builds, where the table values
+   // change at runtime.
+   PstScore pst[2];
+#endif
 };
 
 class Board
@@ -74,6 +89,18 @@ public:
    // update all fields of the board, based on the piece positions.
    void setSecondaryVars();
 
+#ifndef TUNE
+   // rebuild the piece-square table from the current Params values
+   // (and the initial board's sums). Other existing boards need
+   // setSecondaryVars to pick up the new values.
+   static void initPstTable();
+
+   // incremented each time the piece-square table is rebuilt
+   static unsigned pstVersion() {
+      return pstTableVersion;
+   }
+#endif
+
    CastleType castleStatus( ColorType side ) const
    {
        return state.castleStatus[side];        
@@ -140,6 +167,21 @@ public:
    hash_t hashCode() const {
        return state.hashCode;
    }
+
+#ifndef TUNE
+   // piece-square table sums for "side", as used by the evaluator
+   const PstScore &pstScore(ColorType side) const {
+       return state.pst[side];
+   }
+#endif
+
+   // Attach a stack of neural network accumulators, to be updated by
+   // doMove/undoMove (nullptr to detach). The stack is reset.
+   void setAccumulatorStack(nnue::AccumulatorStack *stack);
+
+   nnue::AccumulatorStack *accumulatorStack() const {
+       return accStack;
+   }
    
    // returns a hash code factoring in the position repetition count
    hash_t hashCode(int rep_count) const {
@@ -179,6 +221,7 @@ public:
       state = oldState;
        --repListHead;
       side = OppositeColor(side);
+      if (accStack) accStack->pop();
    }
 
    // Return true if move m would attack square "target" after it is
@@ -394,8 +437,32 @@ public:
 
 private:
 
+   // not copied with the board
+   nnue::AccumulatorStack *accStack;
+
    static void setupInitialBoard();
 
+#ifndef TUNE
+   // piece-square values indexed by color, piece type and square
+   static PstScore pstTable[2][8][64];
+
+   static unsigned pstTableVersion;
+
+   void addPst(ColorType color, PieceType p, Square sq) {
+      const PstScore &val = pstTable[color][p][sq];
+      state.pst[color].mid += val.mid;
+      state.pst[color].end += val.end;
+   }
+
+   void subPst(ColorType color, PieceType p, Square sq) {
+      const PstScore &val = pstTable[color][p][sq];
+      state.pst[color].mid -= val.mid;
+      state.pst[color].end -= val.end;
+   }
+
+   void updatePst(Move move);
+#endif
+
    // calculate the check status
    CheckStatusType getCheckStatus() const;
 
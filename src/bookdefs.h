@@ -10,8 +10,15 @@
 
 namespace book {
 
-const int BOOK_VERSION = 15;
+// Version written by BookWriter. The reader also accepts books in
+// the older paged format (BOOK_VERSION_PAGED).
+const int BOOK_VERSION = 16;
 
+const int BOOK_VERSION_PAGED = 15;
+
+// Version 15 (paged) format: a BookHeader, num_index_pages IndexPages
+// (positions are hashed to a page), then DataPages holding the move
+// chains. Page numbers and indexes are 16 bits.
 const int INDEX_PAGE_SIZE = 1024;
 const int DATA_PAGE_SIZE = 2048;
 const uint16_t NO_NEXT = 65535;
@@ -106,6 +113,53 @@ END_PACKED_STRUCT
 #pragma pack(pop)
 #endif
 
+// Version 16 format: a FlatHeader, then num_positions PositionEntries
+// sorted by hash code, then num_moves MoveEntries. The moves for each
+// position are contiguous. All fields are little-endian.
+struct FlatHeader
+{
+    byte version;
+    byte reserved[7];
+    uint64_t num_positions;
+    uint64_t num_moves;
+    FlatHeader() : version(0), num_positions(0), num_moves(0) {
+        memset(reserved,'\0',sizeof(reserved));
+    }
+};
+
+struct PositionEntry
+{
+    hash_t hashCode;
+    uint32_t first; // index of first MoveEntry
+    uint32_t count; // number of moves
+};
+
+struct MoveEntry
+{
+    byte index;
+    byte weight; // a priori weight, NO_RECOMMEND if not set
+    uint16_t reserved;
+    uint32_t win, loss, draw;
+};
+
+// Polyglot format: an array of PolyglotEntries sorted by key (see
+// BoardHash::polyglotHashCode). All fields are big-endian.
+struct PolyglotEntry
+{
+    uint64_t key;
+    // to file (bits 0-2), to row (3-5), from file (6-8), from row
+    // (9-11), promotion piece (12-14, 1=knight .. 4=queen). Castling
+    // is encoded as the king capturing its own rook.
+    uint16_t move;
+    uint16_t weight;
+    uint32_t learn;
+};
+
+static_assert(sizeof(FlatHeader) == 24, "unexpected FlatHeader size");
+static_assert(sizeof(PositionEntry) == 16, "unexpected PositionEntry size");
+static_assert(sizeof(MoveEntry) == 16, "unexpected MoveEntry size");
+static_assert(sizeof(PolyglotEntry) == 16, "unexpected PolyglotEntry size");
+
 };
 
 #endif
@@ -2,6 +2,7 @@
 // All Rights Reserved.
 
 #include "bookread.h"
+#include "bhash.h"
 #include "constant.h"
 #include "bookdefs.h"
 #include "movegen.h"
@@ -9,7 +10,9 @@
 #include "debug.h"
 #include "params.h"
 #include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <cstring>
 #include <iostream> // for debugging
 #include <assert.h>
 
@@ -21,10 +24,29 @@
 
 static constexpr unsigned NUM_SAMPLES = 50;
 
+// read a big-endian (Polyglot format) value
+template <typename T>
+static T readBigEndian(const T &data) {
+   const byte *p = reinterpret_cast<const byte*>(&data);
+   T value = 0;
+   for (unsigned i = 0; i < sizeof(T); i++) {
+      value = (value << 8) | p[i];
+   }
+   return value;
+}
+
 BookReader::BookReader()
+   : format(Options::BookFormat::Arasan), version(0),
+     positions(nullptr), moves(nullptr),
+     numPositions(0), numMoves(0), writableMoves(nullptr),
+     indexPages(nullptr), dataPages(nullptr), numDataPages(0),
+     polyglotEntries(nullptr), numPolyglotEntries(0)
 {
    // seed the random number generator
    engine.seed(getRandomSeed());
+   entries.reserve(Constants::MaxMoves);
+   polyglotMoves.reserve(Constants::MaxMoves);
+   cache.resize(CACHE_SIZE);
 }
 
 BookReader::~BookReader()
@@ -32,47 +54,123 @@ BookReader::~BookReader()
     close();
 }
 
-int BookReader::open(const char *pathName) {
-    if (book_file.is_open()) return 0;
-    book_file.open(pathName, ios_base::in | ios_base::binary);
-    if (!book_file.is_open()) {
+int BookReader::open(const char *pathName, Options::BookFormat fmt,
+                     bool writable) {
+    if (is_open()) return 0;
+    writable &= fmt == Options::BookFormat::Arasan;
+    std::unique_ptr<MappedFile> file(new MappedFile(pathName, MappedFile::Access::Random, writable));
+    if (writable && file->data() == nullptr) {
+        cerr << "warning: book file " << pathName <<
+            " is not writable, book learning disabled" << endl;
+        writable = false;
+        file.reset(new MappedFile(pathName, MappedFile::Access::Random));
+    }
+    if (file->data() == nullptr) {
         cerr <<"failed to open " << pathName << endl;
         return -1;
-    } else {
-        // read the header
-        book_file.read((char*)&hdr,sizeof(book::BookHeader));
-        if (book_file.bad()) {
+    }
+    const byte *data = file->data();
+    const size_t size = file->size();
+    if (fmt == Options::BookFormat::Polyglot) {
+        // no header, just the sorted entries
+        if (size == 0 || size % sizeof(book::PolyglotEntry)) {
+            cerr << "error reading Polyglot book" << endl;
+            return -1;
+        }
+        polyglotEntries = reinterpret_cast<const book::PolyglotEntry*>(data);
+        numPolyglotEntries = size/sizeof(book::PolyglotEntry);
+        format = fmt;
+        bookMap = std::move(file);
+        return 0;
+    }
+    // the version is the first byte in both Arasan formats
+    if (data[0] == book::BOOK_VERSION) {
+        book::FlatHeader flatHdr;
+        if (size < sizeof(book::FlatHeader)) {
             cerr << "error reading opening book" << endl;
             return -1;
         }
+        memcpy(&flatHdr,data,sizeof(book::FlatHeader));
+        // correct header for endian-ness
+        const uint64_t np = swapEndian64((byte*)&flatHdr.num_positions);
+        const uint64_t nm = swapEndian64((byte*)&flatHdr.num_moves);
+        if (np > size/sizeof(book::PositionEntry) || nm > size/sizeof(book::MoveEntry) ||
+            size != sizeof(book::FlatHeader) + np*sizeof(book::PositionEntry) +
+            nm*sizeof(book::MoveEntry)) {
+            cerr << "error reading opening book" << endl;
+            return -1;
+        }
+        numPositions = np;
+        numMoves = nm;
+        positions = reinterpret_cast<const book::PositionEntry*>(data + sizeof(book::FlatHeader));
+        moves = reinterpret_cast<const book::MoveEntry*>(positions + numPositions);
+        if (writable) {
+            writableMoves = reinterpret_cast<book::MoveEntry*>(
+                file->writableData() + (reinterpret_cast<const byte*>(moves) - data));
+        }
+    }
+    else if (data[0] == book::BOOK_VERSION_PAGED) {
+        if (writable) {
+            cerr << "warning: book learning requires a version " <<
+                book::BOOK_VERSION << " book" << endl;
+        }
+        if (size < sizeof(book::BookHeader)) {
+            cerr << "error reading opening book" << endl;
+            return -1;
+        }
+        memcpy(&hdr,data,sizeof(book::BookHeader));
         // correct header for endian-ness
         hdr.num_index_pages = swapEndian16((byte*)&hdr.num_index_pages);
-        // verify book version is correct
-        if (hdr.version != book::BOOK_VERSION) {
-            cerr << "expected book version " << book::BOOK_VERSION << ", got " << (unsigned)hdr.version << endl;
-			close();
+        const size_t indexSize = hdr.num_index_pages*sizeof(book::IndexPage);
+        if (hdr.num_index_pages == 0 ||
+            size < sizeof(book::BookHeader) + indexSize) {
+            cerr << "error reading opening book" << endl;
             return -1;
-        } else {
-            return 0;
         }
+        indexPages = data + sizeof(book::BookHeader);
+        dataPages = indexPages + indexSize;
+        numDataPages = (size - sizeof(book::BookHeader) - indexSize)/sizeof(book::DataPage);
+        pageOrder.assign(hdr.num_index_pages,PageOrder::Unknown);
+    }
+    else {
+        cerr << "expected book version " << book::BOOK_VERSION << " or " <<
+            book::BOOK_VERSION_PAGED << ", got " << (unsigned)data[0] << endl;
+        return -1;
     }
+    version = data[0];
+    format = fmt;
+    bookMap = std::move(file);
+    return 0;
 }
 
 void BookReader::close() {
-    if (book_file.is_open()) {
-       book_file.close();
-    }
+    waitForPrefetch();
+    clearCache();
+    bookMap.reset();
+    version = 0;
+    positions = nullptr;
+    moves = nullptr;
+    numPositions = numMoves = 0;
+    writableMoves = nullptr;
+    indexPages = dataPages = nullptr;
+    numDataPages = 0;
+    pageOrder.clear();
+    polyglotEntries = nullptr;
+    numPolyglotEntries = 0;
+    format = Options::BookFormat::Arasan;
 }
 
 Move BookReader::pick(const Board &b) {
 #ifdef _TRACE
    cout << "BookReader::pick - hash=" << (hex) << b.hashCode() << (dec) << endl;
 #endif
-   vector <book::DataEntry> rawMoves;
-   vector < pair<Move,int> > results;
+   vector <book::DataEntry> &rawMoves = entries;
    if (b.repCount() > 0) {
       return NullMove;
    }
+   else if (format == Options::BookFormat::Polyglot) {
+      return pickPolyglot(b);
+   }
    else if (lookup(b,rawMoves) <= 0) {
       return NullMove;
    }
@@ -118,11 +216,14 @@ Move BookReader::pick(const Board &b) {
           bestMove = move_list[info.index];
       }
    }
+   if (!IsNull(bestMove)) {
+      prefetch(b,bestMove);
+   }
    return bestMove;
 }
 
 unsigned BookReader::book_moves(const Board &b, vector<Move> &moves) {
-   vector <book::DataEntry> results;
+   vector <book::DataEntry> &results = entries;
    // Don't return a book move if we have repeated this position
    // before .. make the program to search to see if the repetition
    // is desirable or not.
@@ -130,6 +231,18 @@ unsigned BookReader::book_moves(const Board &b, vector<Move> &moves) {
    if (b.repCount() > 0) {
       return 0;
    }
+   else if (format == Options::BookFormat::Polyglot) {
+      if (lookupPolyglot(b,polyglotMoves) <= 0) {
+         return 0;
+      }
+      // highest weight first
+      std::stable_sort(polyglotMoves.begin(),polyglotMoves.end(),
+                       [](const PolyglotMove &a, const PolyglotMove &b) {
+                          return a.weight > b.weight; });
+      moves.resize(polyglotMoves.size());
+      std::transform(polyglotMoves.begin(),polyglotMoves.end(),moves.begin(),
+                     [](const PolyglotMove &m) -> Move { return m.move; });
+   }
    else if ((n=lookup(b,results)) <= 0) {
       return 0;
    }
@@ -147,46 +260,224 @@ unsigned BookReader::book_moves(const Board &b, vector<Move> &moves) {
    return static_cast<unsigned>(moves.size());
 }
 
+const book::IndexEntry *BookReader::findEntry(unsigned page, hash_t hashCode) {
+   // next_free count, followed by the entries
+   const byte *index = indexPages + page*sizeof(book::IndexPage);
+   const unsigned count = std::min<unsigned>(swapEndian32(index),
+                                             book::INDEX_PAGE_SIZE);
+   const book::IndexEntry *begin = reinterpret_cast<const book::IndexEntry*>(
+      index + sizeof(uint32_t));
+   const book::IndexEntry *end = begin + count;
+   auto entryHash = [](const book::IndexEntry &entry) -> hash_t {
+      return (hash_t)swapEndian64((byte*)&entry.hashCode);
+   };
+   if (pageOrder[page] == PageOrder::Unknown) {
+      pageOrder[page] = std::is_sorted(begin, end,
+         [&](const book::IndexEntry &a, const book::IndexEntry &b) {
+            return entryHash(a) < entryHash(b);
+         }) ? PageOrder::Sorted : PageOrder::Unsorted;
+   }
+   if (pageOrder[page] == PageOrder::Sorted) {
+      const book::IndexEntry *it = std::lower_bound(begin, end, hashCode,
+         [&](const book::IndexEntry &entry, hash_t h) {
+            return entryHash(entry) < h;
+         });
+      if (it != end && entryHash(*it) == hashCode) return it;
+   } else {
+      for (const book::IndexEntry *it = begin; it != end; it++) {
+         if (entryHash(*it) == hashCode) return it;
+      }
+   }
+   return nullptr;
+}
+
 int BookReader::lookup(const Board &board, vector<book::DataEntry> &results) {
-   // fetch the index page
-   if (!is_open()) return -1;
-   int probe = (int)(board.hashCode() % hdr.num_index_pages);
-   // seek to index
-   book_file.seekg((std::ios::off_type)(sizeof(book::BookHeader)+probe*sizeof(book::IndexPage)), std::ios_base::beg);
-   if (book_file.fail()) return -1;
-   book::IndexPage index;
-   book_file.read((char*)&index,sizeof(book::IndexPage));
-   if (book_file.fail()) return -1;
-   // correct for endianness
-   index.next_free = swapEndian32((byte*)&index.next_free);
-   book::BookLocation loc(0,book::INVALID_INDEX);
-   for (unsigned i = 0; i < index.next_free; i++) {
-      // correct for endianness
-      uint64_t indexHashCode = (uint64_t)(swapEndian64((byte*)&index.index[i].hashCode));
-      if (indexHashCode == board.hashCode()) {
-         // correct for endianness
-         index.index[i].page = (uint16_t)(swapEndian16((byte*)&index.index[i].page));
-         index.index[i].index = (uint16_t)(swapEndian16((byte*)&index.index[i].index));
-         loc = index.index[i];
-         break;
+   results.clear();
+   if (!is_open() || format != Options::BookFormat::Arasan) return -1;
+   const hash_t hashCode = board.hashCode();
+   CacheEntry &c = cache[hashCode % CACHE_SIZE];
+   if (!c.valid || c.hashCode != hashCode) {
+      if (version == book::BOOK_VERSION) {
+         c.first = c.count = 0;
+         const book::PositionEntry *pos = findPosition(hashCode);
+         if (pos != nullptr) {
+            c.first = swapEndian32((byte*)&pos->first);
+            c.count = swapEndian32((byte*)&pos->count);
+         }
+      } else {
+         c.moves.clear();
+         if (lookupPaged(hashCode,c.moves) < 0) {
+            c.valid = false;
+            return -1;
+         }
+      }
+      c.hashCode = hashCode;
+      c.valid = true;
+   }
+   if (version == book::BOOK_VERSION) {
+      return lookupFlat(c.first,c.count,results);
+   } else {
+      results = c.moves;
+      return (int)results.size();
+   }
+}
+
+void BookReader::clearCache() {
+   for (CacheEntry &c : cache) {
+      c.valid = false;
+   }
+}
+
+void BookReader::prefetch(const Board &board, Move move) {
+   waitForPrefetch();
+   if (version != book::BOOK_VERSION || format != Options::BookFormat::Arasan) {
+      return;
+   }
+   Board next(board);
+   next.doMove(move);
+   prefetchThread = std::thread(&BookReader::prefetchReplies, this, next);
+}
+
+void BookReader::waitForPrefetch() {
+   if (prefetchThread.joinable()) {
+      prefetchThread.join();
+   }
+}
+
+// Keeps the result of the prefetch reads.
+static std::atomic<uint32_t> prefetchSink(0);
+
+void BookReader::prefetchReplies(Board board) const {
+   // Only reads the mapped book: the cache and other members are not
+   // used, so this can run alongside probes from the main thread.
+   const book::PositionEntry *pos = findPosition(board.hashCode());
+   if (pos == nullptr) return;
+   const uint64_t first = swapEndian32((byte*)&pos->first);
+   const uint64_t count = swapEndian32((byte*)&pos->count);
+   if (first + count > numMoves) return;
+   Move move_list[Constants::MaxMoves];
+   RootMoveGenerator mg(board);
+   const int n = mg.generateAllMoves(move_list,1 /* repeatable */);
+   byte sum = 0;
+   for (const book::MoveEntry *m = moves + first; m != moves + first + count; m++) {
+      if (m->index >= n) continue;
+      Board next(board);
+      next.doMove(move_list[m->index]);
+      // the binary search reads the position entries on its path
+      const book::PositionEntry *reply = findPosition(next.hashCode());
+      if (reply == nullptr) continue;
+      const uint64_t replyFirst = swapEndian32((byte*)&reply->first);
+      const uint64_t replyCount = swapEndian32((byte*)&reply->count);
+      if (replyFirst + replyCount > numMoves) continue;
+      // Touch the reply entries. Only the move indexes are read:
+      // the counts may be updated concurrently by book learning.
+      for (uint64_t i = replyFirst; i < replyFirst + replyCount; i++) {
+         sum += *reinterpret_cast<const volatile byte*>(&moves[i].index);
+      }
+   }
+   prefetchSink += sum;
+}
+
+const book::PositionEntry *BookReader::findPosition(hash_t hashCode) const {
+   const book::PositionEntry *end = positions + numPositions;
+   const book::PositionEntry *pos = std::lower_bound(positions, end, hashCode,
+      [](const book::PositionEntry &entry, hash_t h) {
+         return (hash_t)swapEndian64((byte*)&entry.hashCode) < h;
+      });
+   if (pos == end || (hash_t)swapEndian64((byte*)&pos->hashCode) != hashCode) {
+       return nullptr;
+   }
+   return pos;
+}
+
+int BookReader::lookupFlat(uint64_t first, uint64_t count, vector<book::DataEntry> &results) const {
+   if (first + count > numMoves || count > (uint64_t)Constants::MaxMoves) {
+       // corrupt book
+       return -1;
+   }
+   for (const book::MoveEntry *m = moves + first; m != moves + first + count; m++) {
+       book::DataEntry bookEntry;
+       bookEntry.index = m->index;
+       bookEntry.weight = m->weight;
+       bookEntry.next = book::NO_NEXT;
+       bookEntry.win = swapEndian32((byte*)&m->win);
+       bookEntry.loss = swapEndian32((byte*)&m->loss);
+       bookEntry.draw = swapEndian32((byte*)&m->draw);
+       results.push_back(bookEntry);
+   }
+   return (int)results.size();
+}
+
+// Increment a little-endian count in the memory-mapped book. The
+// book may be shared with other processes, so this is done with an
+// atomic compare-and-swap. Counts saturate rather than wrapping.
+static void incrementCount(uint32_t &count) {
+   static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+                 "atomic counts must have the size of the book field");
+   std::atomic<uint32_t> *p = reinterpret_cast<std::atomic<uint32_t>*>(&count);
+   uint32_t expected = p->load(std::memory_order_relaxed);
+   for (;;) {
+      uint32_t value = swapEndian32((byte*)&expected);
+      if (value == UINT32_MAX) return;
+      ++value;
+      const uint32_t desired = swapEndian32((byte*)&value);
+      if (p->compare_exchange_weak(expected, desired)) return;
+   }
+}
+
+bool BookReader::learn(const Board &board, Move move, Outcome outcome) {
+   if (!is_writable()) return false;
+   // the prefetch thread may be reading the entries updated here
+   waitForPrefetch();
+   const book::PositionEntry *pos = findPosition(board.hashCode());
+   if (pos == nullptr) return false;
+   const uint64_t first = swapEndian32((byte*)&pos->first);
+   const uint64_t count = swapEndian32((byte*)&pos->count);
+   if (first + count > numMoves) return false;
+   Move move_list[Constants::MaxMoves];
+   RootMoveGenerator mg(board);
+   const int n = mg.generateAllMoves(move_list,1 /* repeatable */);
+   for (book::MoveEntry *m = writableMoves + first; m != writableMoves + first + count; m++) {
+      if (m->index < n && MovesEqual(move_list[m->index],move)) {
+         switch(outcome) {
+         case Outcome::Win:
+            incrementCount(m->win);
+            break;
+         case Outcome::Loss:
+            incrementCount(m->loss);
+            break;
+         case Outcome::Draw:
+            incrementCount(m->draw);
+            break;
+         }
+         return true;
       }
    }
-   if (!loc.isValid()) {
+   return false;
+}
+
+int BookReader::lookupPaged(hash_t hashCode, vector<book::DataEntry> &results) {
+   const book::IndexEntry *entry = findEntry((unsigned)(hashCode % hdr.num_index_pages),
+                                             hashCode);
+   if (entry == nullptr) {
        // no book moves found
        return 0;
    }
-   book_file.seekg(sizeof(book::BookHeader)+
-                   hdr.num_index_pages*sizeof(book::IndexPage)+
-                   loc.page*sizeof(book::DataPage));
-   if (book_file.fail()) return -1;
-   book::DataPage data;
-   book_file.read((char*)&data,sizeof(book::DataPage));
-   if (book_file.fail()) return -1;
-   while(loc.index != book::NO_NEXT) {
-       ASSERT(loc.index < book::DATA_PAGE_SIZE);
-       book::DataEntry &bookEntry = data.data[loc.index];
+   // correct for endianness
+   book::BookLocation loc((uint16_t)swapEndian16((byte*)&entry->page),
+                          (uint16_t)swapEndian16((byte*)&entry->index));
+   if (loc.page >= numDataPages) return -1;
+   const book::DataPage *data = reinterpret_cast<const book::DataPage*>(
+      dataPages + loc.page*sizeof(book::DataPage));
+   while (loc.index != book::NO_NEXT) {
+       if (loc.index >= book::DATA_PAGE_SIZE ||
+           results.size() >= (size_t)Constants::MaxMoves) {
+           // corrupt book
+           results.clear();
+           return -1;
+       }
+       book::DataEntry bookEntry(data->data[loc.index]);
        bookEntry.next = swapEndian16((byte*)&bookEntry.next);
-       bookEntry.weight = bookEntry.weight;
        bookEntry.win = swapEndian32((byte*)&bookEntry.win);
        bookEntry.loss = swapEndian32((byte*)&bookEntry.loss);
        bookEntry.draw = swapEndian32((byte*)&bookEntry.draw);
@@ -196,6 +487,68 @@ int BookReader::lookup(const Board &board, vector<book::DataEntry> &results) {
    return (int)results.size();
 }
 
+int BookReader::lookupPolyglot(const Board &board, vector<PolyglotMove> &results) {
+   results.clear();
+   if (!is_open() || format != Options::BookFormat::Polyglot) return -1;
+   const hash_t key = BoardHash::polyglotHashCode(board);
+   const book::PolyglotEntry *end = polyglotEntries + numPolyglotEntries;
+   const book::PolyglotEntry *it = std::lower_bound(polyglotEntries, end, key,
+      [](const book::PolyglotEntry &entry, hash_t h) {
+         return readBigEndian(entry.key) < h;
+      });
+   if (it == end || readBigEndian(it->key) != key) {
+      // no book moves found
+      return 0;
+   }
+   Move move_list[Constants::MaxMoves];
+   RootMoveGenerator mg(board);
+   const int n = mg.generateAllMoves(move_list,1 /* repeatable */);
+   for (; it != end && readBigEndian(it->key) == key; it++) {
+      const unsigned weight = readBigEndian(it->weight);
+      if (weight == 0) continue;
+      const uint16_t pgMove = readBigEndian(it->move);
+      const Square start = Square((pgMove >> 6) & 63);
+      Square dest = Square(pgMove & 63);
+      const int promotion = (pgMove >> 12) & 7;
+      // castling is encoded as the king capturing its rook
+      if (TypeOfPiece(board[start]) == King &&
+          PieceColor(board[dest]) == board.sideToMove() &&
+          TypeOfPiece(board[dest]) == Rook) {
+         dest = dest > start ? start + 2 : start - 2;
+      }
+      for (int i = 0; i < n; i++) {
+         const Move m = move_list[i];
+         if (StartSquare(m) == start && DestSquare(m) == dest &&
+             (TypeOfMove(m) == Promotion ? (int)PromoteTo(m) == promotion + 1
+              : promotion == 0)) {
+            if (results.size() < (size_t)Constants::MaxMoves) {
+               results.push_back(PolyglotMove{m, weight});
+            }
+            break;
+         }
+      }
+      // moves that are not legal here (e.g. key collisions) are skipped
+   }
+   return (int)results.size();
+}
+
+Move BookReader::pickPolyglot(const Board &board) {
+   if (lookupPolyglot(board,polyglotMoves) <= 0) {
+      return NullMove;
+   }
+   uint64_t total = 0;
+   for (const PolyglotMove &m : polyglotMoves) {
+      total += m.weight;
+   }
+   std::uniform_int_distribution<uint64_t> dist(0,total-1);
+   uint64_t r = dist(engine);
+   for (const PolyglotMove &m : polyglotMoves) {
+      if (r < m.weight) return m.move;
+      r -= m.weight;
+   }
+   return polyglotMoves.back().move;
+}
+
 double BookReader::calcReward(const std::array<double,OUTCOMES> &sample, score_t contempt) const noexcept
 {
    // calculate reward for a single sample (note outcomes are doubles)
@@ -6,8 +6,11 @@
 #include "bookdefs.h"
 #include "board.h"
 #include "hash.h"
-#include <fstream>
+#include "mmapfile.h"
+#include "options.h"
+#include <memory>
 #include <random>
+#include <thread>
 #include <vector>
 
 using namespace std;
@@ -16,21 +19,42 @@ class BookReader
 {
     // provides read access to the opening book.
 
+    friend class Bench;
+
  public:
 
     BookReader();
 
     ~BookReader();
                 
-    // opens the book. Returns 0 if success
-    int open(const char* pathName);
+    // opens the book. Returns 0 if success. If "writable" is set,
+    // a version 16 Arasan book is mapped writable so that learn()
+    // can update it (if the file cannot be written, it is opened
+    // read-only).
+    int open(const char* pathName,
+             Options::BookFormat format = Options::BookFormat::Arasan,
+             bool writable = false);
 
     // closes the book file.
     void close();
 
     bool is_open() const {
-        return book_file.is_open();
+        return bookMap != nullptr;
+    }
+
+    bool is_writable() const {
+        return writableMoves != nullptr;
     }
+
+    // game outcome for the side making a move
+    enum class Outcome {Win, Loss, Draw};
+
+    // Count a game result for book move "move" in position "board",
+    // updating the win/loss/draw statistics in the book file. Counts
+    // are updated atomically, so other programs using the same book
+    // see them at once. Returns false if the book is not writable
+    // or the move is not in the book.
+    bool learn(const Board &board, Move move, Outcome outcome);
                 
     // Randomly pick a move for board position "b". 
     Move pick( const Board &b);
@@ -39,13 +63,61 @@ class BookReader
     // Returns number of moves found.
     unsigned book_moves(const Board &b, vector< Move> &results);
 
+    // Return the move data structures for a given board position
+    // (Arasan format books only). Return value is # of entries
+    // retrieved, -1 if error. Entries are read from the memory-mapped
+    // book file, or from a cache of recently probed positions.
+    int lookup(const Board &board, vector<book::DataEntry> &results);
+
 protected:
                
     static constexpr unsigned OUTCOMES = 3;
 
-    // Return the move data structures for a given board position.
-    // Return value is # of entries retrieved, -1 if error.
-    int lookup(const Board &board, vector<book::DataEntry> &results);
+    struct PolyglotMove {
+        Move move;
+        unsigned weight;
+    };
+
+    // Return the moves with non-zero weight for a position in a
+    // Polyglot book, found by binary search of the entries. Return
+    // value is # of moves, -1 if error.
+    int lookupPolyglot(const Board &board, vector<PolyglotMove> &results);
+
+    // Pick a Polyglot book move at random, in proportion to its weight.
+    Move pickPolyglot(const Board &board);
+
+    // find the position entry in a current (flat) format book,
+    // nullptr if not found
+    const book::PositionEntry *findPosition(hash_t hashCode) const;
+
+    // Decode the "count" moves starting at "first" in a current
+    // (flat) format book. The win/loss/draw counts are read from the
+    // mapping, so they include updates by book learning in this or
+    // other processes. Return value is # of moves, -1 if error.
+    int lookupFlat(uint64_t first, uint64_t count, vector<book::DataEntry> &results) const;
+
+    // lookup in a version 15 (paged) book
+    int lookupPaged(hash_t hashCode, vector<book::DataEntry> &results);
+
+    // Find the index entry for "hashCode" in an index page of a paged
+    // book. Pages sorted by hash code (as written by makebook before
+    // the flat format) are binary searched; older books are scanned.
+    const book::IndexEntry *findEntry(unsigned page, hash_t hashCode);
+
+    // Read, in a background thread, the parts of a version 16 book
+    // needed to probe the positions that may follow "move" in
+    // position "board": those after the opponent's book replies. This
+    // brings them into memory before the next probe, which matters
+    // when the book file is on slow or network storage.
+    void prefetch(const Board &board, Move move);
+
+    // body of the prefetch thread. "board" is the position after our
+    // move.
+    void prefetchReplies(Board board) const;
+
+    void waitForPrefetch();
+
+    void clearCache();
 
     double calcReward(const std::array<double,OUTCOMES> &sample, score_t contempt = 0) const noexcept;
    
@@ -57,8 +129,55 @@ protected:
        return 1.0/(1.0+exp(-0.75*contempt/Params::PAWN_VALUE));
     }
 
-    ifstream book_file;
+    std::unique_ptr<MappedFile> bookMap;
+    Options::BookFormat format;
+    int version;
+
+    // flat format
+    const book::PositionEntry *positions;
+    const book::MoveEntry *moves;
+    uint64_t numPositions, numMoves;
+    // same as "moves" if the book is writable, else nullptr
+    book::MoveEntry *writableMoves;
+
+    // paged format
     book::BookHeader hdr;
+    const byte *indexPages, *dataPages;
+    size_t numDataPages;
+
+    enum class PageOrder : byte {Unknown, Sorted, Unsorted};
+
+    // sort order of each index page, checked on first access
+    vector<PageOrder> pageOrder;
+
+    // Polyglot format
+    const book::PolyglotEntry *polyglotEntries;
+    uint64_t numPolyglotEntries;
+
+    // Lookup results for recently probed positions (Arasan format
+    // books), direct-mapped by hash code. Positions not in the book
+    // are cached too. For current format books only the location of
+    // the moves is cached, since their counts may be changed by book
+    // learning; version 15 books are not updated, so their decoded
+    // moves are cached.
+    static constexpr unsigned CACHE_SIZE = 256;
+
+    struct CacheEntry {
+        hash_t hashCode;
+        bool valid;
+        uint64_t first, count; // current format
+        vector<book::DataEntry> moves; // version 15
+        CacheEntry() : hashCode(0), valid(false), first(0), count(0) {
+        }
+    };
+
+    vector<CacheEntry> cache;
+
+    std::thread prefetchThread;
+
+    // lookup results, kept to avoid allocation for each probe
+    vector<book::DataEntry> entries;
+    vector<PolyglotMove> polyglotMoves;
 
     std::mt19937_64 engine;
 };
@@ -1,179 +1,175 @@
-// Copyright 2014, 2017-2018 by Jon Dart.  All Rights Reserved.
+// Copyright 2014, 2017-2019 by Jon Dart.  All Rights Reserved.
 
 #include "bookwrit.h"
+#include <algorithm>
+#include <cstdio>
 #include <fstream>
+#include <limits>
 
-BookWriter::BookWriter(int i) :
-   index_pages(i) {
-   index = new book::IndexPage *[index_pages];
-   for (int i = 0; i < index_pages; i++) {
-      index[i] = nullptr; // no index page allocated yet
-   }
-}
-
-BookWriter::~BookWriter() {
-   delete [] index;
-}
-                
 void BookWriter::add(const hash_t hashCode, byte moveIndex, byte weight,
                      uint32_t win, uint32_t loss, uint32_t draw) {
-   const int index_page = (int)(hashCode % index_pages);
-   // fetch index page, allocate if necessary
-   book::IndexPage *idx = index[index_page];
-   if (idx == nullptr) {
-      idx = index[index_page] = new book::IndexPage();
-   }
-   // see if index entry for hashcode is present already
-   int found = -1;
-   for (unsigned i = 0; i < idx->next_free; i++) {
-      if (hashCode == idx->index[i].hashCode) {
-         found = i;
-         break;
-      }
+   // move indexes are 32 bits in the book file
+   if (entries.size() >= std::numeric_limits<uint32_t>::max()) {
+      throw BookFullException();
    }
-   // create and populate new data entry
-   book::DataEntry de;
-   de.index = moveIndex;
-   de.next = book::NO_NEXT;
-   de.weight = weight;
-   de.win = win;
-   de.loss = loss;
-   de.draw = draw;
-   if (found == -1) {
-      // get last data page
-      book::DataPage *dp;
-      int dataIndex;
-      if (!data.size()) {
-         dp = nullptr;
-      } else {
-         dp = data[data.size()-1];
-      }
-      if (!dp || !dp->num_free) {
-         dp = new book::DataPage();
-         data.push_back(dp);
-      }
-      const unsigned dataPage = (unsigned)data.size()-1; // last page after insertion if any
-      // add data to page
-      dataIndex = dp->free_list;
-      int next = dp->data[dataIndex].next;
-      ASSERT(de.next != dataIndex);
-      dp->data[dataIndex] = de;
-      dp->free_list = next;
-      dp->num_free--;
-      // add index entry
-      if (idx->next_free < book::INDEX_PAGE_SIZE) {
-         idx->index[idx->next_free++] = book::IndexEntry(hashCode,dataPage,dataIndex);
-      } else {
-         throw BookFullException();
-      }
-   } else {
-      // at least one move exists in book with the current hash
-      book::IndexEntry &existingIndex = idx->index[found];
-      book::DataPage *dp = data[existingIndex.page];
-      // See if the move we are adding is in the book already
-      int foundIndex = 0;
-      int endOfChain = existingIndex.index;
-      int dataIndex = existingIndex.index;
-      while (dataIndex != book::NO_NEXT) {
-         book::DataEntry &existingDe = dp->data[dataIndex];
-         if (de.index == existingDe.index) {
-            foundIndex++;
-            break;
-         }
-         endOfChain = dataIndex;
-         dataIndex = existingDe.next;
+   Entry e;
+   e.hashCode = hashCode;
+   e.move.index = moveIndex;
+   e.move.weight = weight;
+   e.move.reserved = 0;
+   e.move.win = win;
+   e.move.loss = loss;
+   e.move.draw = draw;
+   entries.push_back(e);
+}
+
+int BookWriter::write(const char* pathName) {
+   // Group the moves by position, keeping the order in which they
+   // were added. Duplicate moves are dropped.
+   std::stable_sort(entries.begin(), entries.end(),
+                    [](const Entry &a, const Entry &b) {
+                       return a.hashCode < b.hashCode;
+                    });
+   BookStreamWriter writer;
+   if (writer.open(pathName)) return -1;
+   vector<book::MoveEntry> moves;
+   for (auto it = entries.begin(); it != entries.end(); ) {
+      auto last = it;
+      while (last != entries.end() && last->hashCode == it->hashCode) {
+         ++last;
       }
-      if (!foundIndex) {
-         // Entry is not already in book, must add a new DataEntry
-         if (dp->num_free) {
-            // add new data entry to this page
-            int nextFree = dp->data[dp->free_list].next;
-            int insert = dp->free_list;
-            // link new entry to the end of the existing move chain
-            ASSERT(endOfChain != insert);
-            dp->data[endOfChain].next = insert;
-            // put new data into data page
-            dp->data[insert] = de;
-            dp->free_list = nextFree;
-            dp->num_free--;
-         } else {
-            // We cannot allocate the new entry in the current data
-            // page. Move existing entries to a new data page, reclaim
-            // their space to the existing data page's free list, and
-            // update the index page to point to the new data page.
-            book::DataPage *newDp = new book::DataPage();
-            data.push_back(newDp);
-            // save existing head of the data chain in the old page.
-            int oldDataIndex = existingIndex.index;
-            // update index to point to new page
-            existingIndex.page = (uint16_t)data.size()-1;
-            existingIndex.index = newDp->free_list;
-            book::DataPage *oldDp = dp;
-            // transfer entries from old to new page
-            while (oldDataIndex != book::NO_NEXT) {
-               book::DataEntry &oldDe = dp->data[oldDataIndex];
-               ASSERT(newDp->free_list < book::DATA_PAGE_SIZE);
-               book::DataEntry &newDe = newDp->data[newDp->free_list];
-               int nextFree = newDe.next;
-               // update new page with old data
-               newDe = oldDe;
-               if (oldDe.next != book::NO_NEXT) {
-                   // We are not at the end of the list so
-                   // make the next pointer go to the next
-                   // free slot - we will allocate that
-                   // in the next pass thru the loop.
-                   newDe.next = nextFree;
-               }
-               // update new page free list
-               newDp->free_list = nextFree;
-               ASSERT(newDp->num_free > 0);
-               newDp->num_free--;
-               oldDataIndex = oldDe.next;
-               // link old data item into old page free list
-               oldDe.next = oldDp->free_list;
-               oldDp->free_list = oldDataIndex;
-               oldDp->num_free++;
-            }
+      moves.clear();
+      for (auto m = it; m != last; m++) {
+         if (std::find_if(it, m, [&](const Entry &e) {
+                  return e.move.index == m->move.index; }) == m) {
+            moves.push_back(m->move);
          }
       }
+      if (writer.add(it->hashCode, moves)) return -1;
+      it = last;
    }
+   return writer.close();
 }
 
-int BookWriter::write(const char* pathName) {
-   ofstream book_file(pathName, ios::out | ios::trunc | ios::binary);
-   book::BookHeader header;
+BookStreamWriter::~BookStreamWriter() {
+   if (moves_file.is_open()) {
+      // not closed normally
+      moves_file.close();
+      std::remove(movesPath.c_str());
+   }
+}
+
+int BookStreamWriter::writeHeader() {
+   book::FlatHeader header;
    header.version = book::BOOK_VERSION;
-   uint16_t pages = (uint16_t)index_pages;
-   header.num_index_pages = (uint16_t)swapEndian16((byte*)&pages);
-   book_file.write((char*)&header, sizeof(book::BookHeader));
-   if (book_file.fail()) return -1;
+   uint64_t positions = num_positions, moves = num_moves;
+   header.num_positions = (uint64_t)swapEndian64((byte*)&positions);
+   header.num_moves = (uint64_t)swapEndian64((byte*)&moves);
+   book_file.write((char*)&header, sizeof(book::FlatHeader));
+   return book_file.fail() ? -1 : 0;
+}
 
-   book::IndexPage empty;
-   for (int i = 0; i < index_pages; i++) {
-      book::IndexPage *ip = (index[i] == nullptr) ? &empty : index[i];
-      // correct for endianness before disk write
-      for (unsigned j = 0; j < ip->next_free; j++) {
-         ip->index[j].page = (uint16_t)swapEndian16((byte*)&ip->index[j].page);
-         ip->index[j].index = (uint16_t)swapEndian16((byte*)&ip->index[j].index);
-         ip->index[j].hashCode = (uint64_t)swapEndian64((byte*)&ip->index[j].hashCode);
-      }
-      ip->next_free = (uint32_t)swapEndian32((byte*)&ip->next_free);
-      book_file.write((char*)ip, sizeof(book::IndexPage));
-      if (book_file.fail()) return -1;
+int BookStreamWriter::open(const string &pathName) {
+   path = pathName;
+   movesPath = pathName + ".moves";
+   num_positions = num_moves = 0;
+   book_file.open(path, ios::out | ios::trunc | ios::binary);
+   moves_file.open(movesPath, ios::out | ios::trunc | ios::binary);
+   if (!book_file.is_open() || !moves_file.is_open()) return -1;
+   // placeholder, rewritten by close()
+   return writeHeader();
+}
+
+int BookStreamWriter::add(const hash_t hashCode,
+                          const vector<book::MoveEntry> &moves) {
+   if (moves.empty()) return 0;
+   if (num_positions && hashCode <= last_hash) return -1;
+   // move indexes are 32 bits in the book file
+   if (num_moves + moves.size() > std::numeric_limits<uint32_t>::max()) {
+      throw BookFullException();
    }
-   for (book::DataPage *dp : data) {
-      // correct for endianness before disk write
-      dp->free_list = (uint32_t)swapEndian32((byte*)&dp->free_list);
-      dp->num_free = (uint32_t)swapEndian32((byte*)&dp->num_free);
-      for (int j = 0; j < book::DATA_PAGE_SIZE; j++) {
-         dp->data[j].next = (uint16_t)swapEndian16((byte*)&dp->data[j].next);
-         dp->data[j].win = (uint32_t)swapEndian32((byte*)&dp->data[j].win);
-         dp->data[j].loss = (uint32_t)swapEndian32((byte*)&dp->data[j].loss);
-         dp->data[j].draw = (uint32_t)swapEndian32((byte*)&dp->data[j].draw);
+   // correct for endianness before disk write
+   book::PositionEntry pos;
+   pos.hashCode = hashCode;
+   pos.first = (uint32_t)num_moves;
+   pos.count = (uint32_t)moves.size();
+   pos.hashCode = (uint64_t)swapEndian64((byte*)&pos.hashCode);
+   pos.first = (uint32_t)swapEndian32((byte*)&pos.first);
+   pos.count = (uint32_t)swapEndian32((byte*)&pos.count);
+   book_file.write((char*)&pos, sizeof(book::PositionEntry));
+   for (book::MoveEntry m : moves) {
+      m.reserved = 0;
+      m.win = (uint32_t)swapEndian32((byte*)&m.win);
+      m.loss = (uint32_t)swapEndian32((byte*)&m.loss);
+      m.draw = (uint32_t)swapEndian32((byte*)&m.draw);
+      moves_file.write((char*)&m, sizeof(book::MoveEntry));
+   }
+   last_hash = hashCode;
+   ++num_positions;
+   num_moves += moves.size();
+   return (book_file.fail() || moves_file.fail()) ? -1 : 0;
+}
+
+int BookStreamWriter::close() {
+   moves_file.close();
+   bool fail = moves_file.fail();
+   if (!fail) {
+      // append the move entries after the position entries
+      ifstream in(movesPath, ios::in | ios::binary);
+      if (num_moves) {
+         book_file << in.rdbuf();
       }
-      book_file.write((char*)dp, sizeof(book::DataPage));
-      if (book_file.fail()) return -1;
+      fail = in.bad();
+   }
+   std::remove(movesPath.c_str());
+   if (!fail) {
+      book_file.seekp(0);
+      fail = writeHeader() != 0;
+   }
+   book_file.close();
+   return (fail || book_file.fail()) ? -1 : 0;
+}
+
+void PolyglotWriter::add(hash_t key, Move move, uint16_t weight) {
+   entries.push_back(Entry{key, encodeMove(move), weight});
+}
+
+uint16_t PolyglotWriter::encodeMove(Move move) {
+   const Square start = StartSquare(move);
+   Square dest = DestSquare(move);
+   // castling is encoded as the king capturing its rook
+   if (TypeOfMove(move) == KCastle) {
+      dest = start + 3;
+   }
+   else if (TypeOfMove(move) == QCastle) {
+      dest = start - 4;
+   }
+   int promotion = 0;
+   if (TypeOfMove(move) == Promotion) {
+      promotion = (int)PromoteTo(move) - 1;
+   }
+   return uint16_t(dest | (start << 6) | (promotion << 12));
+}
+
+int PolyglotWriter::write(const char *pathName) {
+   std::stable_sort(entries.begin(), entries.end(),
+                    [](const Entry &a, const Entry &b) {
+                       return a.key < b.key ||
+                          (a.key == b.key && a.weight > b.weight);
+                    });
+   ofstream book_file(pathName, ios::out | ios::trunc | ios::binary);
+   // entries are big-endian
+   byte buf[sizeof(book::PolyglotEntry)];
+   for (const Entry &e : entries) {
+      byte *p = buf;
+      for (int shift = 56; shift >= 0; shift -= 8) *p++ = byte(e.key >> shift);
+      *p++ = byte(e.move >> 8);
+      *p++ = byte(e.move);
+      *p++ = byte(e.weight >> 8);
+      *p++ = byte(e.weight);
+      std::fill(p, buf + sizeof(buf), byte(0)); // learn
+      book_file.write((char*)buf, sizeof(buf));
    }
    book_file.close();
-   return 0;
+   return book_file.fail() ? -1 : 0;
 }
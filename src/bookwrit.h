@@ -1,12 +1,14 @@
-// Copyright 2014 by Jon Dart.  All Rights Reserved.
+// Copyright 2014, 2019 by Jon Dart.  All Rights Reserved.
 
 #ifndef _BOOK_WRITER_H
 #define _BOOK_WRITER_H
 
 #include "bookdefs.h"
 #include "board.h"
-#include <vector>
 #include <exception>
+#include <fstream>
+#include <string>
+#include <vector>
 
 using namespace std;
 
@@ -15,34 +17,104 @@ class BookFullException: public exception
  public:
   virtual const char* what() const throw()
   {
-    return "too many moves in book, allocate more index space";
+    return "too many moves in book";
   }
 };
 
+class BookStreamWriter {
+
+        // writes the book in a single pass, with memory use independent
+        // of the book size. Positions must be added in ascending order
+        // of hash code. Move entries are spooled to a temporary file
+        // and appended to the book when it is closed.
+
+        public:
+
+        BookStreamWriter() = default;
+
+        ~BookStreamWriter();
+
+        // Open the book file for writing. Returns 0 if no errors, -1
+        // if error
+        int open(const string &pathName);
+
+        // Add the moves for one position. Returns 0 if no errors, -1
+        // if error (including a hash code out of order).
+        int add(const hash_t hashCode, const vector<book::MoveEntry> &moves);
+
+        // Complete the book file. Returns 0 if no errors, -1 if error
+        int close();
+
+        uint64_t positionCount() const {
+           return num_positions;
+        }
+
+        uint64_t moveCount() const {
+           return num_moves;
+        }
+
+ private:
+       int writeHeader();
+
+       string path, movesPath;
+       ofstream book_file, moves_file;
+       uint64_t num_positions = 0, num_moves = 0;
+       hash_t last_hash = 0;
+};
+
 class BookWriter {
 
         // writes to the opening book
 
         public:
 
-        // "Pages" is the number of index pages.
-        BookWriter(int index_pages);
-                
-        // closes book file
-        ~BookWriter();
-                
-        // add a move to the file.
+        BookWriter() = default;
+
+        // add a move to the book. If the move was already added for
+        // this position, the new entry is ignored.
         void add(const hash_t hashCode, byte moveIndex, byte weight,
                  uint32_t win, uint32_t loss, uint32_t draw);
 
-        // Write book contents out to the designated path. Returns 0
-        // if no errors, -1 if error
+        // Write book contents out to the designated path, in the
+        // current (BOOK_VERSION) format. Returns 0 if no errors, -1
+        // if error
         int write(const char* pathName);
 
  protected:
-       int index_pages;
-       book::IndexPage **index;
-       vector<book::DataPage*> data;
+       struct Entry {
+          hash_t hashCode;
+          book::MoveEntry move;
+       };
+
+       vector<Entry> entries;
+};
+
+class PolyglotWriter {
+
+        // writes a book in Polyglot format
+
+        public:
+
+        PolyglotWriter() = default;
+
+        // add a move for the position with Polyglot key "key" (see
+        // BoardHash::polyglotHashCode).
+        void add(hash_t key, Move move, uint16_t weight);
+
+        // Write the book, sorted by key and then by descending
+        // weight. Returns 0 if no errors, -1 if error
+        int write(const char *pathName);
+
+        // Polyglot encoding of a move
+        static uint16_t encodeMove(Move move);
+
+ protected:
+       struct Entry {
+          hash_t key;
+          uint16_t move, weight;
+       };
+
+       vector<Entry> entries;
 };
 
 #endif
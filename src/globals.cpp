@@ -4,6 +4,8 @@
 #include "hash.h"
 #include "bitprobe.h"
 #include "scoring.h"
+#include "nnue.h"
+#include "learn.h"
 #include "bitbase.cpp"
 #ifdef SYZYGY_TBS
 #include "syzygy.h"
@@ -19,6 +21,10 @@ bool tb_init_done()
 int EGTBMenCount = 0;
 #endif
 
+static bool nn_init = false;
+static bool learn_init = false;
+static bool param_init = false;
+
 MoveArray *gameMoves;
 Options options;
 BookReader openingBook;
@@ -31,9 +37,11 @@ ThreadControl inputSem;
 Tune tune_params;
 #endif
 
-static const char * LEARN_FILE_NAME = "arasan.lrn";
+static const char * LEARN_FILE_NAME = "arasan.lrb";
+
+// text format learn file used before version 21.3
+static const char * TEXT_LEARN_FILE_NAME = "arasan.lrn";
 
-static const char * DEFAULT_BOOK_NAME = "book.bin";
 
 static const char * RC_FILE_NAME = "arasan.rc";
 
@@ -131,12 +139,94 @@ void delayedInit() {
        }
     }
 #endif
-    // also initialize the book here
+    if (options.search.nn_eval && !nn_init) {
+       nn_init = true;
+       if (nnue::network.load(options.search.nn_file) ||
+           nnue::network.load(derivePath(options.search.nn_file.c_str()))) {
+          stringstream msg;
+          msg << "loaded network from " << options.search.nn_file << endl;
+          cerr << msg.str();
+#ifdef UCI_LOG
+          ucilog << msg.str();
+#endif
+       }
+       else {
+          cerr << "warning: could not load network file " <<
+             options.search.nn_file << ", using standard evaluation" << endl;
+       }
+    }
+    if (options.search.param_file.length() && !param_init) {
+       param_init = true;
+       // a file name without a directory may also be in the
+       // program's directory
+       ifstream in(options.search.param_file.c_str());
+       if (!in.good()) {
+          in.clear();
+          in.open(derivePath(options.search.param_file.c_str()).c_str());
+       }
+       string err;
+       stringstream msg;
+       if (!in.good()) {
+          msg << "warning: could not open parameter file " <<
+             options.search.param_file << ", using built-in parameters" << endl;
+       } else if (Params::readValues(in,err)) {
+          msg << "loaded scoring parameters from " << options.search.param_file << endl;
+       } else {
+          msg << "warning: error in parameter file " <<
+             options.search.param_file << " (" << err << "), using built-in parameters" << endl;
+       }
+       cerr << msg.str();
+#ifdef UCI_LOG
+       ucilog << msg.str();
+#endif
+    }
+    if (options.learning.position_learning && !learn_init) {
+       learn_init = true;
+       // convert an existing text learn file, the first time the
+       // binary one is needed
+       ifstream existing(learnFileName.c_str());
+       if (!existing.good()) {
+          const string textFile = derivePath(TEXT_LEARN_FILE_NAME);
+          ifstream text(textFile.c_str());
+          if (text.good()) {
+             text.close();
+             int count = LearnStore::importText(textFile,learnFileName);
+             stringstream msg;
+             if (count >= 0) {
+                msg << "converted " << count << " records from " <<
+                   textFile << " to " << learnFileName << endl;
+             }
+             else {
+                msg << "warning: could not convert " << textFile << endl;
+             }
+             cerr << msg.str();
+#ifdef UCI_LOG
+             ucilog << msg.str();
+#endif
+          }
+       }
+    }
+    // also initialize the book here. A book file name without a
+    // directory is in the program's directory.
     if (options.book.book_enabled && !openingBook.is_open()) {
-        openingBook.open(derivePath(DEFAULT_BOOK_NAME).c_str());
+        const string &name = options.book.book_file;
+        const string path = name.find_first_of("/\\") == string::npos ?
+            derivePath(name.c_str()) : name;
+        openingBook.open(path.c_str(),options.book.format,
+                         options.book.book_learning != 0);
     }
 }
 
+void unloadNetwork() {
+   nnue::network.clear();
+   nn_init = false;
+}
+
+void unloadParams() {
+   Params::restoreDefaults();
+   param_init = false;
+}
+
    void unloadTb() {
 #ifdef SYZYGY_TBS
    if (tb_init_done()) {
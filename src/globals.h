@@ -58,4 +58,12 @@ extern void delayedInit();
 // Attempt to unload the tablebases (if in use),
 extern void unloadTb();
 
+// Unload the evaluation network, so it is reloaded by the next
+// delayedInit call if still enabled.
+extern void unloadNetwork();
+
+// Restore the built-in scoring parameters, so the parameter file is
+// reloaded by the next delayedInit call if one is set.
+extern void unloadParams();
+
 #endif
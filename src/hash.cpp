@@ -6,7 +6,12 @@
 #include "globals.h"
 #include "legal.h"
 #include "learn.h"
+#include "mmapfile.h"
 #include "scoring.h"
+#include "threadp.h"
+#ifdef NUMA
+#include "topo.h"
+#endif
 extern "C"
 {
 #if !defined(_MAC) && !defined(__clang__) && !defined(__FreeBSD__)
@@ -14,68 +19,244 @@ extern "C"
 #endif
 #include <memory.h>
 #include <stddef.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+};
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <type_traits>
+
+static const size_t HUGE_PAGE_SIZE = 2*1024*1024;
+
+// Header of a saved hash table file. The bucket array follows
+// immediately after it.
+struct HashFileHeader {
+   char magic[8];
+   uint32_t version;
+   uint32_t entrySize;   // bytes per entry
+   uint32_t bucketSize;  // entries per bucket
+   uint32_t scoreFormat; // 1 if scores are stored as floats (TUNE build)
+   uint64_t buckets;
+   uint64_t used;        // count of non-empty entries
+   uint32_t age;
+   uint32_t reserved;
 };
 
+static_assert(sizeof(HashFileHeader) == 48, "unexpected hash file header size");
+
+static const char HASH_FILE_MAGIC[8] = {'A','R','A','S','A','N','T','T'};
+
+// Change this when the entry layout or encoding changes.
+static const uint32_t HASH_FILE_VERSION = 1;
+
+static void initFileHeader(HashFileHeader &hdr) {
+   memset(&hdr,'\0',sizeof(hdr));
+   memcpy(hdr.magic,HASH_FILE_MAGIC,sizeof(hdr.magic));
+   hdr.version = HASH_FILE_VERSION;
+   hdr.entrySize = sizeof(HashEntry);
+   hdr.bucketSize = Hash::BucketSize;
+   hdr.scoreFormat = std::is_floating_point<stored_score_t>::value;
+}
+
+// Tables smaller than this are cleared on one thread: waking the
+// pool costs more than it saves.
+static const size_t PARALLEL_CLEAR_SIZE = 32*1024*1024;
+
 Hash::Hash() {
    hashTable = nullptr;
    hashSize = 0;
    hashMask = 0x0ULL;
    hashFree = 0;
    hash_init_done = 0;
+   allocSize = 0;
+   pageSize = 0;
+   memType = MemoryType::Standard;
+   numaNodes = 0;
 }
 
-void Hash::initHash(size_t bytes)
+void Hash::initHash(size_t bytes, ThreadPool *pool)
 {
    if (!hash_init_done) {
-      hashSize = (int)(bytes/sizeof(HashEntry));
-      if (!hashSize) {
+      size_t buckets = bytes/sizeof(Bucket);
+      if (!buckets) {
+         hashSize = 0;
          hashMask = 0;
          hash_init_done++;
          return;
       }
       unsigned hashPower;
-      for (hashPower = 1; hashPower < 32; hashPower++) {
-        if ((1ULL << hashPower) > hashSize) {
+      for (hashPower = 1; hashPower < 40; hashPower++) {
+        if ((1ULL << hashPower) > buckets) {
             hashPower--;
             break;
         }
       }
-      hashSize = 1ULL << hashPower;
-      hashMask = (uint64_t)(hashSize-1);
-      size_t hashSizePlus = hashSize + MaxRehash;
-      ALIGNED_MALLOC(hashTable,
-         HashEntry,
-         sizeof(HashEntry)*hashSizePlus,128);
+      buckets = 1ULL << hashPower;
+      hashSize = buckets*BucketSize;
+      hashMask = (uint64_t)(buckets-1);
+      hashTable = allocate(sizeof(Bucket)*buckets);
       if (hashTable == nullptr) {
           cerr << "hash table allocation failed!" << endl;
           hashSize = 0;
       }
-      clearHash();
+      clearHash(pool);
       hash_init_done++;
    }
 }
 
-void Hash::resizeHash(size_t bytes)
+void Hash::resizeHash(size_t bytes, ThreadPool *pool)
 {
    freeHash();
-   initHash(bytes);
+   initHash(bytes, pool);
 }
 
 
 void Hash::freeHash()
 {
-   ALIGNED_FREE(hashTable);
+   deallocate();
    hash_init_done = 0;
 }
 
+Hash::Bucket *Hash::allocate(size_t bytes)
+{
+   void *mem = nullptr;
+   memType = MemoryType::Standard;
+   pageSize = 0;
+   numaNodes = 0;
+   allocSize = bytes;
+   if (options.search.large_pages && bytes >= HUGE_PAGE_SIZE) {
+#if defined(_WIN32)
+      // Requires the "Lock pages in memory" privilege; fails without it.
+      const size_t minSize = GetLargePageMinimum();
+      if (minSize && bytes % minSize == 0) {
+         mem = VirtualAlloc(NULL, bytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+                            PAGE_READWRITE);
+         if (mem) pageSize = minSize;
+      }
+#elif defined(MAP_HUGETLB)
+      // Try explicit huge pages. These must be reserved by the
+      // administrator (vm.nr_hugepages), so this often fails.
+#ifdef MAP_HUGE_SHIFT
+      static const size_t GIGA_PAGE_SIZE = 1024*1024*1024;
+      if (bytes % GIGA_PAGE_SIZE == 0) {
+         mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (30 << MAP_HUGE_SHIFT),
+                    -1, 0);
+         if (mem == MAP_FAILED)
+            mem = nullptr;
+         else
+            pageSize = GIGA_PAGE_SIZE;
+      }
+#endif
+      if (mem == nullptr) {
+         mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+         if (mem == MAP_FAILED)
+            mem = nullptr;
+         else
+            pageSize = HUGE_PAGE_SIZE;
+      }
+#endif
+      if (mem) {
+         memType = MemoryType::HugePages;
+      }
+#ifdef MADV_HUGEPAGE
+      else {
+         // Fall back to transparent huge pages: allocate on a huge
+         // page boundary and ask the kernel to back the range with huge
+         // pages.
+         if (posix_memalign(&mem, HUGE_PAGE_SIZE, bytes)) {
+            mem = nullptr;
+         }
+         else if (madvise(mem, bytes, MADV_HUGEPAGE) == 0) {
+            memType = MemoryType::TransparentHugePages;
+         }
+      }
+#endif
+   }
+   if (mem == nullptr) {
+      ALIGNED_MALLOC(mem, void, bytes, 128);
+   }
+#ifdef NUMA
+   // Spread the table across nodes (must be done before the
+   // memory is first touched, in clearHash).
+   if (mem) {
+      numaNodes = Topology::interleave(mem, bytes);
+   }
+#endif
+   if (mem == nullptr) {
+      allocSize = 0;
+   }
+   return static_cast<Bucket*>(mem);
+}
+
+void Hash::deallocate()
+{
+   if (hashTable == nullptr) return;
+   if (memType == MemoryType::HugePages) {
+#ifdef _WIN32
+      VirtualFree(hashTable, 0, MEM_RELEASE);
+#else
+      munmap(hashTable, allocSize);
+#endif
+   }
+   else if (memType == MemoryType::TransparentHugePages) {
+      free(hashTable);
+   }
+   else {
+      ALIGNED_FREE(hashTable);
+   }
+   hashTable = nullptr;
+   allocSize = 0;
+   memType = MemoryType::Standard;
+   numaNodes = 0;
+}
 
-void Hash::clearHash()
+string Hash::memoryDescription() const
+{
+   stringstream s;
+   s << allocSize/(1024*1024) << " MB";
+   switch (memType) {
+   case MemoryType::Standard:
+      s << ", standard pages";
+      break;
+   case MemoryType::TransparentHugePages:
+      s << ", transparent huge pages";
+      break;
+   case MemoryType::HugePages:
+      if (pageSize >= 1024*1024*1024) {
+         s << ", " << pageSize/(1024*1024*1024) << "GB pages";
+      } else {
+         s << ", " << pageSize/(1024*1024) << "MB pages";
+      }
+      break;
+   }
+   if (numaNodes) {
+      s << ", interleaved on " << numaNodes << " NUMA nodes";
+   }
+   return s.str();
+}
+
+
+void Hash::clearHash(ThreadPool *pool)
 {
    if (hashSize == 0) return;
    hashFree = hashSize;
-   HashEntry empty;
-   for (size_t i = 0; i < hashSize; i++) {
-       hashTable[i] = empty;
+   const size_t buckets = hashMask+1;
+   // an all-zero entry is empty
+   auto clearSlice = [this,buckets](unsigned index, unsigned count) {
+      const size_t start = buckets*index/count;
+      const size_t end = buckets*(index+1)/count;
+      memset(static_cast<void*>(hashTable+start),'\0',sizeof(Bucket)*(end-start));
+   };
+   if (pool && sizeof(Bucket)*buckets >= PARALLEL_CLEAR_SIZE) {
+      pool->runAll(clearSlice);
+   }
+   else {
+      clearSlice(0,1);
    }
    if (options.learning.position_learning) {
       loadLearnInfo();
@@ -83,14 +264,81 @@ void Hash::clearHash()
 }
 
 
+bool Hash::saveHash(const string &fileName, unsigned age) const
+{
+   if (hashSize == 0) return false;
+   HashFileHeader hdr;
+   initFileHeader(hdr);
+   hdr.buckets = hashMask+1;
+   hdr.used = hashSize-hashFree;
+   hdr.age = age;
+   ofstream out(fileName.c_str(), ios::out | ios::binary | ios::trunc);
+   if (!out.good()) return false;
+   out.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+   out.write(reinterpret_cast<const char*>(hashTable),
+             std::streamsize(sizeof(Bucket)*hdr.buckets));
+   out.close();
+   return !out.fail();
+}
+
+bool Hash::loadHash(const string &fileName, unsigned &age, ThreadPool *pool)
+{
+   // we copy the whole file once, front to back
+   MappedFile file(fileName, MappedFile::Access::Sequential);
+   if (file.data() == nullptr || file.size() < sizeof(HashFileHeader)) {
+      return false;
+   }
+   HashFileHeader expected, hdr;
+   initFileHeader(expected);
+   memcpy(&hdr, file.data(), sizeof(hdr));
+   if (memcmp(hdr.magic, expected.magic, sizeof(hdr.magic)) ||
+       hdr.version != expected.version ||
+       hdr.entrySize != expected.entrySize ||
+       hdr.bucketSize != expected.bucketSize ||
+       hdr.scoreFormat != expected.scoreFormat ||
+       hdr.buckets == 0 || (hdr.buckets & (hdr.buckets-1)) ||
+       file.size() != sizeof(hdr) + sizeof(Bucket)*hdr.buckets ||
+       hdr.used > hdr.buckets*BucketSize) {
+      return false;
+   }
+   const size_t buckets = (size_t)hdr.buckets;
+   if (hashTable == nullptr || buckets != hashMask+1) {
+      freeHash();
+      hashTable = allocate(sizeof(Bucket)*buckets);
+      if (hashTable == nullptr) {
+         cerr << "hash table allocation failed!" << endl;
+         hashSize = hashMask = 0;
+         return false;
+      }
+      hashSize = buckets*BucketSize;
+      hashMask = (uint64_t)(buckets-1);
+      hash_init_done++;
+   }
+   // Copy the entries, in slices as in clearHash. This also does
+   // the first touch of a newly allocated table.
+   const Bucket *src = reinterpret_cast<const Bucket*>(file.data() + sizeof(hdr));
+   auto copySlice = [this,src,buckets](unsigned index, unsigned count) {
+      const size_t start = buckets*index/count;
+      const size_t end = buckets*(index+1)/count;
+      memcpy(static_cast<void*>(hashTable+start),src+start,sizeof(Bucket)*(end-start));
+   };
+   if (pool && sizeof(Bucket)*buckets >= PARALLEL_CLEAR_SIZE) {
+      pool->runAll(copySlice);
+   }
+   else {
+      copySlice(0,1);
+   }
+   hashFree = hashSize-(size_t)hdr.used;
+   age = hdr.age;
+   return true;
+}
+
 void Hash::loadLearnInfo()
 {
    if (hashSize && options.learning.position_learning) {
-      ifstream plog;
-      plog.open(learnFileName.c_str(),ios_base::in);
-      while (plog.good() && !plog.eof()) {
-         LearnRecord rec;
-         if (getLearnRecord(plog,rec)) {
+      LearnStore store;
+      if (store.open(learnFileName,LearnStore::Mode::ReadOnly)) {
+         store.forEach([this](const LearnRecord &rec) {
             Move best = NullMove;
             if (rec.start != InvalidSquare)
                best = CreateMove(rec.start,rec.dest,rec.promotion);
@@ -101,7 +349,7 @@ void Hash::loadLearnInfo()
                       Constants::INVALID_SCORE, // TBD
                       HashEntry::LEARNED_MASK,
                       best);
-         }
+         });
       }
    }
 }
@@ -8,9 +8,17 @@
 #include "legal.h"
 #include <climits>
 #include <cstddef>
+#if defined(_MSC_VER) && defined(USE_INTRINSICS)
+#include <xmmintrin.h>
+#endif
 
 extern const hash_t rep_codes[3];
 
+// Transposition table entry. Entries are 16 bytes and are stored in
+// 64-byte buckets (one cache line). For lockless access, the key/value
+// word is stored XORed with the data word, so that an entry modified
+// concurrently by another thread (a "torn" entry) will fail the hash
+// match.
 class HashEntry {
 
 	public:
@@ -36,9 +44,8 @@ class HashEntry {
           contents.flags = Eval;
           contents.start = contents.dest = InvalidSquare;
           contents.promotion = Empty;
-          contents.start = InvalidSquare;
-          contents.value = Constants::INVALID_SCORE;
-          setEffectiveHash(0,Constants::INVALID_SCORE);
+          contents.static_value = (uint16_t)Constants::INVALID_SCORE;
+          encode(0,Constants::INVALID_SCORE);
       }
 
       HashEntry(hash_t hash, score_t val, score_t staticValue, int depth,
@@ -51,8 +58,8 @@ class HashEntry {
          contents.start = StartSquare(bestMove);
          contents.dest = DestSquare(bestMove);
          contents.promotion = PromoteTo(bestMove);
-         contents.value = stored_score_t(val);
-         setEffectiveHash(hash,staticValue);
+         contents.static_value = (uint16_t)(int16_t)staticValue;
+         encode(hash,val);
       }
 
       int empty() const {
@@ -60,7 +67,7 @@ class HashEntry {
       }
 
       void clear() {
-        hc = 0x0ULL;
+        hc = val = 0x0ULL;
       }
 
       int depth() const {
@@ -68,12 +75,14 @@ class HashEntry {
       }
 
       score_t getValue() const {
-         return score_t(contents.value);
+         ScoreBits bits;
+         bits.bits = uint32_t((hc ^ val) & VALUE_MASK);
+         return score_t(bits.score);
       }
 
       // Get value correcting mate scores for ply
       score_t getValue(int ply) const {
-         score_t hashValue = score_t(contents.value);
+         score_t hashValue = getValue();
          if (hashValue >= Constants::MATE_RANGE) {
            hashValue -= ply - 1;
          }
@@ -84,16 +93,11 @@ class HashEntry {
       }
 
       score_t staticValue() const {
-          // assumes 2's complement machine
-          unsigned bits = unsigned(hc & STATIC_VALUE_MASK);
-          if (bits & 0x8000)
-              return score_t(-32768 + (bits & 0x7fff));
-          else
-              return score_t(bits & 0x7fff);
+          return score_t((int16_t)contents.static_value);
       }
 
-      void setValue(score_t val) {
-         contents.value = (stored_score_t)val;
+      void setValue(score_t value) {
+         encode(getEffectiveHash(),value);
       }
 
       ValueType type() const {
@@ -105,7 +109,9 @@ class HashEntry {
       }
 
       void setAge(unsigned age) {
+         const hash_t key = hc ^ val;
          contents.age = age;
+         hc = key ^ val;
       }
 
       int learned() const {
@@ -144,20 +150,35 @@ class HashEntry {
       }
 
       void setEffectiveHash(hash_t hash, score_t static_score) {
-         hc = ((hash ^ val) & HASH_MASK) | (uint16_t)static_score;
+         const score_t value = getValue();
+         contents.static_value = (uint16_t)(int16_t)static_score;
+         encode(hash,value);
       }
 
    protected:
 
-      static const hash_t HASH_MASK = 0xffffffffffff0000;
-      static const hash_t STATIC_VALUE_MASK = ~HASH_MASK;
+      // The key word holds the high-order 32 bits of the hash code
+      // (the low-order bits select the bucket) and the 32-bit value.
+      static const hash_t HASH_MASK = 0xffffffff00000000ULL;
+      static const hash_t VALUE_MASK = ~HASH_MASK;
+
+      union ScoreBits {
+          stored_score_t score;
+          uint32_t bits;
+      };
+
+      void encode(hash_t hash, score_t value) {
+         ScoreBits bits;
+         bits.score = stored_score_t(value);
+         hc = ((hash & HASH_MASK) | bits.bits) ^ val;
+      }
 
 #ifdef __INTEL_COMPILER
 #pragma pack(push,1)
 #endif
       struct Contents
       BEGIN_PACKED_STRUCT
-        stored_score_t value;
+        uint16_t static_value;
         byte depth;
         byte age;
         byte flags;
@@ -173,38 +194,75 @@ class HashEntry {
           uint64_t val;
       };
 
-      // static value is packed in the low-order hash bits
+      // hash code and value, XORed with the data word
       uint64_t hc;
 };
 
+class ThreadPool;
+
 class Hash {
 
   friend class Scoring;
  public:
     Hash();
 
-    void initHash(size_t bytes);
+    // Type of memory the table is allocated in
+    enum class MemoryType { Standard, TransparentHugePages, HugePages };
 
-    void resizeHash(size_t bytes);
+    // Number of entries per bucket. A bucket fills one cache line.
+    static const int BucketSize = 4;
+
+    struct Bucket {
+        HashEntry entries[BucketSize];
+    };
+
+    // If a thread pool is given, initialization and clearing are
+    // divided among its threads (see clearHash).
+    void initHash(size_t bytes, ThreadPool *pool = nullptr);
+
+    void resizeHash(size_t bytes, ThreadPool *pool = nullptr);
 
     void freeHash();
 
-    void clearHash();
+    // Zero the table, then load learned positions. With a pool, each
+    // thread zeroes its own slice of the table. A new table is first
+    // touched here, so this also spreads page faults across threads,
+    // and places each slice on its thread's NUMA node unless the
+    // table is interleaved.
+    void clearHash(ThreadPool *pool = nullptr);
 
     // put info from the external permanent hash table into the
     // in-memory hash table
     void loadLearnInfo();
 
+    // Write the table contents, with a header describing the entry
+    // format and table size, to a file. "age" is the search age
+    // the entries are relative to. Returns false on failure.
+    bool saveHash(const string &fileName, unsigned age) const;
+
+    // Load a table written by saveHash. The table is resized to match
+    // the file if necessary. On success, "age" is set to the saved
+    // search age. Returns false if the file cannot be read or its
+    // format does not match, in which case the table is unchanged.
+    bool loadHash(const string &fileName, unsigned &age,
+                  ThreadPool *pool = nullptr);
+
+    // Start loading the bucket for a hash code into the cache.
+    void prefetch(hash_t hashCode) const {
+#if defined(_MSC_VER) && defined(USE_INTRINSICS)
+        _mm_prefetch((const char*)&hashTable[hashCode & hashMask], _MM_HINT_T0);
+#elif defined(__GNUC__)
+        __builtin_prefetch(&hashTable[hashCode & hashMask]);
+#endif
+    }
+
     HashEntry::ValueType searchHash(hash_t hashCode,
                                     int depth, unsigned age,
                                     HashEntry &he)
     {
         if (!hashSize) return HashEntry::NoHit;
-        int probe = (int)(hashCode & hashMask);
-
-        HashEntry *p = &hashTable[probe];
-        HashEntry *hit = nullptr;
-        for (int i = MaxRehash; i != 0; --i, p++) {
+        HashEntry *p = hashTable[hashCode & hashMask].entries;
+        for (int i = BucketSize; i != 0; --i, p++) {
             // Copy hashtable entry before hash test below (avoids
             // race where entry is validated, then changed).
             HashEntry entry(*p);
@@ -213,26 +271,20 @@ class Hash {
                 // so update the age to discourage replacement:
                 if (entry.age() && (entry.age() != age)) {
                    entry.setAge(age);
-                   entry.setEffectiveHash(hashCode,entry.staticValue());
                    *p = entry;
                 }
-                hit = p;
                 he = entry;
                 if (entry.depth() >= depth) {
                     // usable depth
                     return he.type();
                 }
                 else {
-                    break;
+                    // hash hit, but with insufficient depth:
+                    return HashEntry::Invalid;
                 }
             }
         }
-        if (hit) {
-          // hash hit, but with insufficient depth:
-          return HashEntry::Invalid;
-        } else {
-          return HashEntry::NoHit;
-        }
+        return HashEntry::NoHit;
     }
 
     void storeHash(hash_t hashCode, const int depth,
@@ -244,15 +296,14 @@ class Hash {
                           Move best_move) {
 
         if (!hashSize) return;
-        int probe = (int)(hashCode & hashMask);
-        HashEntry *p = &hashTable[probe];
+        HashEntry *p = hashTable[hashCode & hashMask].entries;
 
         HashEntry *best = nullptr;
         ASSERT(value >= SHRT_MIN && value <= SHRT_MAX);
-        // Of the positions that hash to the same locations
+        // Of the positions that hash to the same bucket
         // as this one, find the best one to replace.
         score_t maxScore = score_t(-Constants::MaxPly*DEPTH_INCREMENT);
-        for (int i = MaxRehash; i != 0; --i) {
+        for (int i = BucketSize; i != 0; --i) {
             HashEntry &q = *p;
 
             if (q.empty()) {
@@ -286,10 +337,24 @@ class Hash {
        }
     }
 
+    // Size in entries
     size_t getHashSize() const {
         return hashSize;
     }
 
+    MemoryType getMemoryType() const {
+        return memType;
+    }
+
+    // Number of NUMA nodes the table is interleaved across (0 if
+    // not interleaved).
+    unsigned getNumaNodes() const {
+        return numaNodes;
+    }
+
+    // Describe the table size and the memory it is allocated in
+    string memoryDescription() const;
+
     // Percent full (percentage x 10)
     int pctFull() const {
         if (hashSize == 0)
@@ -303,11 +368,20 @@ private:
         return score_t((std::abs((int)pos.age()-(int)age)<<12) - pos.depth());
     }
 
-    HashEntry *hashTable;
+    // Allocate table memory, using huge pages if enabled and
+    // available.
+    Bucket *allocate(size_t bytes);
+
+    void deallocate();
+
+    Bucket *hashTable;
     size_t hashSize, hashFree;
     hash_t hashMask;
-    static const int MaxRehash = 4;
     int hash_init_done;
+    size_t allocSize; // in bytes
+    size_t pageSize; // page size if HugePages
+    MemoryType memType;
+    unsigned numaNodes;
 };
 
 #endif
@@ -4,8 +4,11 @@
 #include "learn.h"
 #include "globals.h"
 #include "scoring.h"
+#include <algorithm>
 #include <cstddef>
+#include <cstdio>
 #include <sstream>
+#include <vector>
 
 // max ply for position learning
 #define POSITION_MAX_PLY 60
@@ -52,16 +55,21 @@ void learn(const Board &board, int rep_count)
              (diff1 > score_threshold || diff2 > score_threshold)) {
             // last 2 or more moves were not from book, and score has changed
             // significantly. Append to the learn file.
-            stringstream s;
-            s << (hex) << board.hashCode(rep_count);
-            s << ' ' << (dec) << (board.checkStatus() == InCheck) << 
-               ' ' << last_score << ' ' << last_depth << ' ';
-            MoveImage(last_entry.move(),s);
-            s << '\n';
-            ofstream log;
-            log.open(learnFileName.c_str(),ios_base::out | ios_base::app);
-            log << s.str();
-            log.close();
+            LearnRecord rec;
+            rec.hashcode = board.hashCode(rep_count);
+            rec.in_check = board.checkStatus() == InCheck;
+            rec.score = last_score;
+            rec.depth = last_depth;
+            const Move move = last_entry.move();
+            rec.start = IsNull(move) ? InvalidSquare : StartSquare(move);
+            rec.dest = IsNull(move) ? InvalidSquare : DestSquare(move);
+            rec.promotion = TypeOfMove(move) == Promotion ? PromoteTo(move) : Empty;
+            LearnStore store;
+            if (!store.open(learnFileName,LearnStore::Mode::ReadWrite) ||
+                !store.add(rec)) {
+               theLog->write("warning: could not update learn file\n");
+               return;
+            }
             stringstream str;
             str << "learning position, score = ";
             Scoring::printScore(last_score,str);
@@ -72,6 +80,48 @@ void learn(const Board &board, int rep_count)
    }
 }
 
+void learnBook(const Board &board)
+{
+   if (!options.book.book_learning || !openingBook.is_writable()) return;
+   const Log::GameResult result = theLog->getResult();
+   if (result == Log::Incomplete) return;
+   const unsigned n = theLog->current();
+   // Recover the start position, then replay the game to check that
+   // the log matches the final position.
+   Board b(board);
+   for (unsigned i = n; i > 0; i--) {
+      const LogEntry &entry = (*theLog)[i-1];
+      b.undoMove(entry.move(),entry.state());
+   }
+   Board start(b);
+   for (unsigned i = 0; i < n; i++) {
+      const LogEntry &entry = (*theLog)[i];
+      if (b.hashCode() != entry.state().hashCode) return;
+      b.doMove(entry.move());
+   }
+   if (b.hashCode() != board.hashCode()) return;
+   // Update the moves played until the game leaves the book.
+   b = start;
+   unsigned updated = 0;
+   for (unsigned i = 0; i < n; i++) {
+      const Move move = (*theLog)[i].move();
+      BookReader::Outcome outcome = BookReader::Outcome::Draw;
+      if (result != Log::DrawResult) {
+         const bool whiteWin = result == Log::WhiteWin;
+         outcome = whiteWin == (b.sideToMove() == White) ?
+            BookReader::Outcome::Win : BookReader::Outcome::Loss;
+      }
+      if (!openingBook.learn(b,move,outcome)) break;
+      ++updated;
+      b.doMove(move);
+   }
+   if (updated) {
+      stringstream str;
+      str << "book learning: updated " << updated << " move(s)\n";
+      theLog->write(str.str());
+   }
+}
+
 int getLearnRecord(istream &learnFile, LearnRecord &rec) {
   learnFile >> (hex) >> rec.hashcode >> (dec) >> rec.in_check >>
     rec.score >> rec.depth;
@@ -101,3 +151,220 @@ int getLearnRecord(istream &learnFile, LearnRecord &rec) {
   }
   return learnFile.good() && !learnFile.eof();
 }
+
+static const char LEARN_FILE_MAGIC[8] = {'A','R','A','S','A','N','L','N'};
+
+// Change this when the entry layout or encoding changes.
+static const uint32_t LEARN_FILE_VERSION = 1;
+
+static_assert(sizeof(LearnStore::Header) == 32, "unexpected learn file header size");
+static_assert(sizeof(LearnStore::Entry) == 16, "unexpected learn file entry size");
+
+// Entry flags
+static const uint8_t LEARN_USED = 1;
+static const uint8_t LEARN_IN_CHECK = 2;
+static const uint8_t LEARN_HAS_MOVE = 4;
+
+static void initHeader(LearnStore::Header &hdr, uint64_t capacity) {
+   memset(&hdr,'\0',sizeof(hdr));
+   memcpy(hdr.magic,LEARN_FILE_MAGIC,sizeof(hdr.magic));
+   hdr.version = LEARN_FILE_VERSION;
+   hdr.entrySize = sizeof(LearnStore::Entry);
+   hdr.capacity = capacity;
+}
+
+static void encode(const LearnRecord &rec, LearnStore::Entry &e) {
+   e.hashcode = rec.hashcode;
+   e.score = int32_t(rec.score);
+   e.depth = uint8_t(std::max<int>(0,std::min<int>(255,int(rec.depth))));
+   e.flags = LEARN_USED;
+   if (rec.in_check) e.flags |= LEARN_IN_CHECK;
+   e.move = 0;
+   if (OnBoard(rec.start) && OnBoard(rec.dest)) {
+      e.flags |= LEARN_HAS_MOVE;
+      e.move = uint16_t(rec.start | (rec.dest << 6) | (rec.promotion << 12));
+   }
+}
+
+static void decode(const LearnStore::Entry &e, LearnRecord &rec) {
+   rec.hashcode = e.hashcode;
+   rec.in_check = (e.flags & LEARN_IN_CHECK) != 0;
+   rec.score = score_t(e.score);
+   rec.depth = e.depth;
+   if (e.flags & LEARN_HAS_MOVE) {
+      rec.start = Square(e.move & 63);
+      rec.dest = Square((e.move >> 6) & 63);
+      rec.promotion = PieceType((e.move >> 12) & 7);
+   }
+   else {
+      rec.start = rec.dest = InvalidSquare;
+      rec.promotion = Empty;
+   }
+}
+
+// Write a complete file: header followed by the table.
+static bool writeTable(const string &fileName,
+                       const std::vector<LearnStore::Entry> &table,
+                       uint64_t count) {
+   LearnStore::Header hdr;
+   initHeader(hdr,table.size());
+   hdr.count = count;
+   ofstream out(fileName.c_str(), ios::out | ios::binary | ios::trunc);
+   if (!out.good()) return false;
+   out.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+   out.write(reinterpret_cast<const char*>(table.data()),
+             std::streamsize(sizeof(LearnStore::Entry)*table.size()));
+   out.close();
+   return !out.fail();
+}
+
+LearnStore::LearnStore()
+   : mode(Mode::ReadOnly), header(nullptr), entries(nullptr)
+{
+}
+
+bool LearnStore::create(const string &fileName, uint64_t capacity) {
+   std::vector<Entry> table(capacity);
+   memset(static_cast<void*>(table.data()),'\0',sizeof(Entry)*capacity);
+   return writeTable(fileName,table,0);
+}
+
+bool LearnStore::open(const string &name, Mode m) {
+   close();
+   fileName = name;
+   mode = m;
+   if (map(m)) return true;
+   if (m == Mode::ReadWrite) {
+      // create the file if it does not exist (but do not
+      // overwrite a file we cannot read)
+      ifstream existing(name.c_str());
+      if (!existing.good() && create(name,INITIAL_CAPACITY)) {
+         return map(m);
+      }
+   }
+   return false;
+}
+
+bool LearnStore::map(Mode m) {
+   file.reset(new MappedFile(fileName, MappedFile::Access::Random,
+                             m == Mode::ReadWrite));
+   byte *data = m == Mode::ReadWrite ? file->writableData() :
+      const_cast<byte *>(file->data()); // not written through
+   Header expected;
+   initHeader(expected,0);
+   if (data == nullptr || file->size() < sizeof(Header)) {
+      file.reset();
+      return false;
+   }
+   Header *hdr = reinterpret_cast<Header *>(data);
+   if (memcmp(hdr->magic,expected.magic,sizeof(hdr->magic)) ||
+       hdr->version != expected.version ||
+       hdr->entrySize != expected.entrySize ||
+       hdr->capacity == 0 || (hdr->capacity & (hdr->capacity-1)) ||
+       hdr->count > hdr->capacity ||
+       file->size() != sizeof(Header) + sizeof(Entry)*hdr->capacity) {
+      file.reset();
+      return false;
+   }
+   header = hdr;
+   entries = reinterpret_cast<Entry *>(data + sizeof(Header));
+   return true;
+}
+
+void LearnStore::close() {
+   file.reset();
+   header = nullptr;
+   entries = nullptr;
+}
+
+uint64_t LearnStore::count() const {
+   return header ? header->count : 0;
+}
+
+LearnStore::Entry *LearnStore::slot(hash_t hashcode) const {
+   const uint64_t mask = header->capacity-1;
+   uint64_t i = hashcode & mask;
+   // the table is never full, so this terminates
+   while ((entries[i].flags & LEARN_USED) && entries[i].hashcode != hashcode) {
+      i = (i+1) & mask;
+   }
+   return entries + i;
+}
+
+bool LearnStore::find(hash_t hashcode, LearnRecord &rec) const {
+   if (!isOpen()) return false;
+   const Entry *e = slot(hashcode);
+   if (!(e->flags & LEARN_USED)) return false;
+   decode(*e,rec);
+   return true;
+}
+
+bool LearnStore::add(const LearnRecord &rec) {
+   if (!isOpen() || mode != Mode::ReadWrite) return false;
+   Entry *e = slot(rec.hashcode);
+   if (!(e->flags & LEARN_USED)) {
+      if (4*(header->count+1) > 3*header->capacity) {
+         if (!grow()) return false;
+         e = slot(rec.hashcode);
+      }
+      ++header->count;
+   }
+   encode(rec,*e);
+   return true;
+}
+
+bool LearnStore::grow() {
+   const uint64_t capacity = 2*header->capacity;
+   const uint64_t mask = capacity-1;
+   std::vector<Entry> table(capacity);
+   memset(static_cast<void*>(table.data()),'\0',sizeof(Entry)*capacity);
+   for (uint64_t i = 0; i < header->capacity; i++) {
+      if (entries[i].flags & LEARN_USED) {
+         uint64_t j = entries[i].hashcode & mask;
+         while (table[j].flags & LEARN_USED) j = (j+1) & mask;
+         table[j] = entries[i];
+      }
+   }
+   const uint64_t count = header->count;
+   close();
+   // write a new file and replace the old one with it, so an
+   // interrupted write does not lose the existing entries
+   const string tmpName = fileName + ".tmp";
+   if (!writeTable(tmpName,table,count)) {
+      std::remove(tmpName.c_str());
+      map(mode);
+      return false;
+   }
+   std::remove(fileName.c_str());
+   if (std::rename(tmpName.c_str(),fileName.c_str())) {
+      return false;
+   }
+   return map(mode);
+}
+
+void LearnStore::forEach(const std::function<void (const LearnRecord &)> &f) const {
+   if (!isOpen()) return;
+   for (uint64_t i = 0; i < header->capacity; i++) {
+      if (entries[i].flags & LEARN_USED) {
+         LearnRecord rec;
+         decode(entries[i],rec);
+         f(rec);
+      }
+   }
+}
+
+int LearnStore::importText(const string &textFile, const string &storeFile) {
+   ifstream in(textFile.c_str());
+   if (!in.good()) return -1;
+   LearnStore store;
+   if (!store.open(storeFile,Mode::ReadWrite)) return -1;
+   int records = 0;
+   while (in.good() && !in.eof()) {
+      LearnRecord rec;
+      if (getLearnRecord(in,rec)) {
+         if (!store.add(rec)) return -1;
+         ++records;
+      }
+   }
+   return records;
+}
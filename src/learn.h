@@ -7,12 +7,21 @@
 
 #include "board.h"
 #include "log.h"
+#include "mmapfile.h"
+#include <functional>
 #include <istream>
+#include <memory>
 
 // Activate the book learning feature. Call after a move
 // has been added to the log. Board is the position before the move.
 extern void learn(const Board &board, int rep_count);
 
+// Book learning: if enabled, add the game result to the opening
+// book statistics for the book moves played (by either side). Call
+// once at the end of a game, after the result has been set in the
+// log. Board is the final position.
+extern void learnBook(const Board &board);
+
 struct LearnRecord {
   hash_t hashcode;
   int in_check;
@@ -22,7 +31,84 @@ struct LearnRecord {
   PieceType promotion;
 };
 
-// Retrieve position learning info
+// Retrieve position learning info from a text learn file (the
+// format used before version 21.3)
 extern int getLearnRecord(istream &learnFile, LearnRecord &);
 
+// Position learning file. The file is a header followed by a hash
+// table of fixed-size entries keyed by position hash code (linear
+// probing, so there is one entry per position). It is memory-mapped:
+// learning a position already in the file updates its entry in
+// place, and the table is doubled in size when it becomes 3/4 full.
+// Fields are in native byte order, as for saved hash files.
+class LearnStore {
+public:
+   enum class Mode {ReadOnly, ReadWrite};
+
+   LearnStore();
+
+   // Open the file. In ReadWrite mode it is created if it does not
+   // exist. Returns false on failure.
+   bool open(const string &fileName, Mode mode);
+
+   void close();
+
+   bool isOpen() const {
+      return entries != nullptr;
+   }
+
+   // Add a record, replacing any previous record for the same
+   // position. Returns false if the store is not writable or could
+   // not be enlarged.
+   bool add(const LearnRecord &rec);
+
+   bool find(hash_t hashcode, LearnRecord &rec) const;
+
+   // number of positions stored
+   uint64_t count() const;
+
+   // Call "f" for each stored record, in file order.
+   void forEach(const std::function<void (const LearnRecord &)> &f) const;
+
+   // Add the records from a text learn file to a store, creating it
+   // if necessary. Later records for a position replace earlier ones.
+   // Returns the number of records read, or -1 on error.
+   static int importText(const string &textFile, const string &storeFile);
+
+   struct Header {
+      char magic[8];
+      uint32_t version;
+      uint32_t entrySize;
+      uint64_t capacity; // number of entries, a power of 2
+      uint64_t count;    // number of entries in use
+   };
+
+   struct Entry {
+      uint64_t hashcode;
+      int32_t score;
+      uint16_t move; // start | dest << 6 | promotion << 12
+      uint8_t depth;
+      uint8_t flags;
+   };
+
+private:
+   static const uint64_t INITIAL_CAPACITY = 4096;
+
+   // Write an empty table with "capacity" entries
+   static bool create(const string &fileName, uint64_t capacity);
+
+   bool map(Mode mode);
+
+   // double the table size
+   bool grow();
+
+   Entry *slot(hash_t hashcode) const;
+
+   string fileName;
+   Mode mode;
+   std::unique_ptr<MappedFile> file;
+   Header *header;
+   Entry *entries;
+};
+
 #endif
@@ -0,0 +1,67 @@
+// Copyright 2019 by Jon Dart. All Rights Reserved.
+
+#include "mmapfile.h"
+extern "C"
+{
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+};
+
+MappedFile::MappedFile(const string &fileName, Access access, bool write)
+   : addr(nullptr), len(0), writable(write)
+{
+#ifdef _WIN32
+   mapping = NULL;
+   // Allow other processes to have the file open for writing, as
+   // they do when updating it through a writable mapping (book
+   // learning for example).
+   file = CreateFileA(fileName.c_str(),
+                      write ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+                      FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                      OPEN_EXISTING,
+                      access == Access::Sequential ? FILE_FLAG_SEQUENTIAL_SCAN :
+                      FILE_FLAG_RANDOM_ACCESS, NULL);
+   if (file == INVALID_HANDLE_VALUE) return;
+   LARGE_INTEGER fileSize;
+   if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) return;
+   mapping = CreateFileMapping(file, NULL,
+                               write ? PAGE_READWRITE : PAGE_READONLY,
+                               0, 0, NULL);
+   if (mapping == NULL) return;
+   addr = MapViewOfFile(mapping, write ? FILE_MAP_WRITE : FILE_MAP_READ,
+                        0, 0, 0);
+   if (addr) len = (size_t)fileSize.QuadPart;
+#else
+   int fd = open(fileName.c_str(), write ? O_RDWR : O_RDONLY);
+   if (fd == -1) return;
+   struct stat st;
+   if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      addr = mmap(nullptr, (size_t)st.st_size,
+                  write ? PROT_READ | PROT_WRITE : PROT_READ,
+                  MAP_SHARED, fd, 0);
+      if (addr == MAP_FAILED) {
+         addr = nullptr;
+      } else {
+         len = (size_t)st.st_size;
+         madvise(addr, len, access == Access::Sequential ? MADV_SEQUENTIAL :
+                 MADV_RANDOM);
+      }
+   }
+   close(fd);
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+   if (addr) UnmapViewOfFile(addr);
+   if (mapping != NULL) CloseHandle(mapping);
+   if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+   if (addr) munmap(addr, len);
+#endif
+}
@@ -0,0 +1,46 @@
+// Copyright 2019 by Jon Dart. All Rights Reserved.
+#ifndef _MMAP_FILE_H
+#define _MMAP_FILE_H
+
+#include "types.h"
+#include <string>
+
+using namespace std;
+
+// Memory mapping of a file. The mapping is read-only unless
+// "writable" is set, in which case changes are written to the file.
+class MappedFile {
+public:
+   // Expected access pattern (a hint to the OS)
+   enum class Access {Sequential, Random};
+
+   MappedFile(const string &fileName, Access access, bool writable = false);
+   ~MappedFile();
+
+   MappedFile(const MappedFile &) = delete;
+   MappedFile &operator = (const MappedFile &) = delete;
+
+   // nullptr if the file could not be opened or mapped, or is empty
+   const byte *data() const {
+      return static_cast<const byte *>(addr);
+   }
+
+   // nullptr unless the file was mapped writable
+   byte *writableData() const {
+      return writable ? static_cast<byte *>(addr) : nullptr;
+   }
+
+   size_t size() const {
+      return len;
+   }
+
+private:
+   void *addr;
+   size_t len;
+   bool writable;
+#ifdef _WIN32
+   HANDLE file, mapping;
+#endif
+};
+
+#endif
@@ -52,36 +52,13 @@ RootMoveGenerator::RootMoveGenerator(const Board &board,
      excluded(0)
 {
    batch = moves;
-   batch_count = MoveGenerator::generateAllMoves(batch,0);
+   batch_count = generateLegalMoves(batch);
    for (int i=0; i < batch_count; i++) {
       MoveEntry me;
       me.move = batch[i];
       me.score = 0;
       moveList.push_back(me);
    }
-   int j = batch_count;
-   if (board.checkStatus() != InCheck) {
-      // exclude illegal moves
-      const BoardState state(board.state);
-      Board tmp(board);
-      j = 0;
-      for (int i=0; i<batch_count; i++) {
-         Move move = moveList[i].move;
-         tmp.doMove(move);
-         if (tmp.anyAttacks(tmp.kingSquare(tmp.oppositeSide()),tmp.sideToMove())) {
-            // move was illegal, own king is in check
-            tmp.undoMove(move,state);
-            continue;
-         }
-         if (j != i) {
-            // compress the move list so illegal moves are excluded
-            moveList[j] = moveList[i];
-         }
-         ++j;
-         tmp.undoMove(move,state);
-      }
-      moveList.erase(moveList.begin()+j,moveList.end());
-   }
    reorder(pvMove,0,true);
 #ifdef _TRACE
    if (master) {
@@ -91,7 +68,6 @@ RootMoveGenerator::RootMoveGenerator(const Board &board,
       }
    }
 #endif
-   batch_count = j;
    phase = LAST_PHASE;
 }
 
@@ -102,6 +78,18 @@ void RootMoveGenerator::reorder(Move pvMove,int depth,bool initial)
       // If this is the first sort, use SEE to sort move list.
       // Else, if in the "easy move" part of the search leave the scores
       // intact: they are set according to the search results.
+      vector<score_t> seeScores;
+      if (initial) {
+         vector<Move> captures;
+         for (const MoveEntry &m : moveList) {
+            if (!MovesEqual(m.move,pvMove) && CaptureOrPromotion(m.move)) {
+               captures.push_back(m.move);
+            }
+         }
+         seeScores.resize(captures.size());
+         seeBatch(board,captures.data(),(int)captures.size(),seeScores.data());
+      }
+      unsigned capture = 0;
       for (MoveEntry &m : moveList) {
            ClearUsed(m.move);
            if (initial) {
@@ -111,7 +99,7 @@ void RootMoveGenerator::reorder(Move pvMove,int depth,bool initial)
                  m.score = int(Params::PAWN_VALUE*100);
               } else if (CaptureOrPromotion(m.move)) {
                  int est;
-                 if ((est = (int)see(board,m.move)) >= 0) {
+                 if ((est = (int)seeScores[capture++]) >= 0) {
                     SetPhase(m.move,WINNING_CAPTURE_PHASE);
                  } else {
                     SetPhase(m.move,LOSERS_PHASE);
@@ -238,6 +226,20 @@ Move MoveGenerator::nextEvasion(int &ord) {
      else if (batch_count > 1) {
        int scores[40];
        ASSERT(batch_count < 40);
+       // SEE values for captures that are not clearly winning,
+       // computed together
+       Move seeMoves[40];
+       score_t seeScores[40];
+       int seeIndex[40];
+       int seeCount = 0;
+       for (int i = 0; i < batch_count; i++) {
+          if (CaptureOrPromotion(moves[i]) && !MovesEqual(moves[i],hashMove) &&
+              Params::Gain(moves[i])-Params::PieceValue(PieceMoved(moves[i])) <= 0) {
+             seeIndex[i] = seeCount;
+             seeMoves[seeCount++] = moves[i];
+          }
+       }
+       seeBatch(board,seeMoves,seeCount,seeScores);
        int poscaps = 0, negcaps = 0;
        for (int i = 0; i < batch_count; i++) {
           if (MovesEqual(moves[i],hashMove)) {
@@ -254,7 +256,9 @@ Move MoveGenerator::nextEvasion(int &ord) {
              score_t gain = Params::Gain(moves[i]);
              score_t pieceVal = Params::PieceValue(PieceMoved(moves[i]));
              scores[i] = int(Params::MVV_LVA(moves[i]));
-             if (gain-pieceVal > 0 || (scores[i] = (int)see(board,moves[i])) >= 0) {
+             // (swaps in this loop only move entries that were already
+             // processed, so seeIndex[i] still refers to moves[i])
+             if (gain-pieceVal > 0 || (scores[i] = (int)seeScores[seeIndex[i]]) >= 0) {
                 ++poscaps;
                 SetPhase(moves[i],WINNING_CAPTURE_PHASE);
                 if (i > poscaps) {
@@ -305,7 +309,7 @@ int MoveGenerator::getBatch(Move *&batch,int &index)
       switch(phase) {
          case HASH_MOVE_PHASE:
          {
-            if (!IsNull(hashMove)) {
+            if (!IsNull(hashMove) && (!legal || isLegal(hashMove))) {
                *moves = hashMove;
                SetPhase(*moves,phase);
 #ifdef _TRACE
@@ -323,6 +327,7 @@ int MoveGenerator::getBatch(Move *&batch,int &index)
          case WINNING_CAPTURE_PHASE:
          {
             numMoves = MoveGenerator::generateCaptures(moves);
+            if (legal) numMoves = filterLegal(moves,numMoves);
             initialSortCaptures(moves,numMoves);
             index = 0;
             break;
@@ -332,7 +337,7 @@ int MoveGenerator::getBatch(Move *&batch,int &index)
             if (!context) continue;
             context->getKillers(ply,killer1,killer2);
             if (!IsNull(killer1) && !MovesEqual(hashMove,killer1)) {
-               if (validMove(board,killer1)) {
+               if (validMove(board,killer1) && (!legal || isLegal(killer1))) {
                   SetPhase(killer1,KILLER1_PHASE);
                   moves[numMoves++] = killer1;
                   index = 0;
@@ -344,7 +349,7 @@ int MoveGenerator::getBatch(Move *&batch,int &index)
          {
             if (!context) continue;
             if (!IsNull(killer2) && !MovesEqual(hashMove,killer2)) {
-               if (validMove(board,killer2)) {
+               if (validMove(board,killer2) && (!legal || isLegal(killer2))) {
                   SetPhase(killer2,KILLER2_PHASE);
                   moves[numMoves++] = killer2;
                   index = 0;
@@ -357,6 +362,7 @@ int MoveGenerator::getBatch(Move *&batch,int &index)
          case HISTORY_PHASE:
          {
             numMoves = generateNonCaptures(moves);
+            if (legal) numMoves = filterLegal(moves,numMoves);
             if (numMoves) {
                Move counter(context && node && ply > 0 ? context->getCounterMove(board,(node-1)->last_move) :
                             NullMove);
@@ -743,11 +749,86 @@ MoveGenerator::MoveGenerator( const Board &ABoard,
       forced(0),
       phase(START_PHASE),
       hashMove(pvMove),
+      legal(false),
       master(trace)
 {
 }
 
 
+void MoveGenerator::setLegal()
+{
+   legal = true;
+   pinned = board.getPinned(board.kingSquare(board.sideToMove()),
+                            board.oppositeSide(),board.sideToMove());
+}
+
+
+bool MoveGenerator::isLegal(Move move) const
+{
+   ASSERT(legal);
+   ASSERT(board.checkStatus() != InCheck);
+   const ColorType side = board.sideToMove();
+   const Square kp = board.kingSquare(side);
+   const Square start = StartSquare(move);
+   const Square dest = DestSquare(move);
+   switch (TypeOfMove(move)) {
+      case KCastle:
+      case QCastle:
+         // checked for legality when generated
+         return true;
+      case EnPassant:
+      {
+         // Both pawns leave their squares, which may uncover a
+         // slider attack on the king along the rank.
+         const ColorType oside = board.oppositeSide();
+         Bitboard occ(board.allOccupied);
+         occ.clear(start);
+         occ.clear(side == White ? dest - 8 : dest + 8);
+         occ.set(dest);
+         return !(Attacks::rookAttacks(kp,occ) &
+                  (board.rook_bits[oside] | board.queen_bits[oside])) &&
+            !(Attacks::bishopAttacks(kp,occ) &
+              (board.bishop_bits[oside] | board.queen_bits[oside]));
+      }
+      default:
+         break;
+   }
+   if (start == kp) {
+      // Not in check, so no slider attack passes through the king's
+      // square and the current attacks are valid after the move.
+      return !board.anyAttacks(dest,board.oppositeSide());
+   }
+   // a pinned piece may only move along the line to its king
+   return !pinned.isSet(start) ||
+      Attacks::directions[kp][start] == Attacks::directions[kp][dest];
+}
+
+
+int MoveGenerator::filterLegal(Move *moves, int n) const
+{
+   int j = 0;
+   for (int i = 0; i < n; i++) {
+      if (isLegal(moves[i])) {
+         moves[j++] = moves[i];
+      }
+   }
+   return j;
+}
+
+
+int MoveGenerator::generateLegalMoves(Move *moves)
+{
+   if (board.checkStatus() == InCheck) {
+      // evasions are always legal
+      return generateEvasions(moves);
+   }
+   if (!legal) setLegal();
+   int n = generateCaptures(moves);
+   n += generateNonCaptures(moves+n);
+   return filterLegal(moves,n);
+}
+
+
 int MoveGenerator::generateEvasions(Move * moves)
 {
    int n = generateEvasionsCaptures(moves);
@@ -1231,24 +1312,34 @@ int MoveGenerator::generateAllMoves(Move *moves,int repeatable)
 }
 
 
-uint64_t RootMoveGenerator::perft(Board &b, int depth) {
+uint64_t RootMoveGenerator::perft(Board &b, int depth, bool legal) {
    if (depth == 0) return 1;
 
    uint64_t nodes = 0ULL;
-   Move m;
-   RootMoveGenerator mg(b);
-   BoardState state = b.state;
-   int order;
-   while ((m = mg.nextMove(order)) != NullMove) {
-      if (depth > 1) {
-         b.doMove(m);
-         nodes += perft(b,depth-1);
-         b.undoMove(m,state);
-      } else {
-         // skip do/undo
-         nodes++;
+   // ply 0, so that all underpromotions are generated
+   MoveGenerator mg(b);
+   Move moves[Constants::MaxMoves];
+   const BoardState state = b.state;
+   if (legal) {
+      const int n = mg.generateLegalMoves(moves);
+      // no need to make the moves at the last ply
+      if (depth == 1) return n;
+      for (int i = 0; i < n; i++) {
+         b.doMove(moves[i]);
+         nodes += perft(b,depth-1,true);
+         b.undoMove(moves[i],state);
+      }
+   } else {
+      const bool inCheck = b.checkStatus() == InCheck;
+      const int n = mg.generateAllMoves(moves,0);
+      for (int i = 0; i < n; i++) {
+         b.doMove(moves[i]);
+         // evasions are already legal
+         if (inCheck || b.wasLegal(moves[i])) {
+            nodes += perft(b,depth-1,false);
+         }
+         b.undoMove(moves[i],state);
       }
    }
    return nodes;
 }
-
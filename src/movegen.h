@@ -79,6 +79,17 @@ class MoveGenerator
       // Generate the next check evasion, NullMove if none left
       virtual Move nextEvasion(int &order);
 
+      // Generate only strictly legal moves from nextMove(). The pinned
+      // pieces are computed once here, and moves are tested against
+      // them as they are generated, so the caller does not need to make
+      // a move to find out it was illegal. Moves from nextEvasion() are
+      // always legal (evasions use the checking pieces, computed once
+      // per node).
+      void setLegal();
+
+      // Return all legal moves, in no particular order.
+      int generateLegalMoves(Move *moves);
+
       // Generate only non-capturing moves.
       int generateNonCaptures(Move *moves);
 
@@ -153,6 +164,12 @@ class MoveGenerator
       int generateEvasions(Move * moves,
          const Bitboard &mask);
 
+      // true if "move" is legal (not valid in check: see setLegal)
+      bool isLegal(Move move) const;
+
+      // remove illegal moves from a list, return the new count
+      int filterLegal(Move *moves, int n) const;
+
       const Board &board;
       SearchContext *context;
       NodeInfo *node;
@@ -164,6 +181,8 @@ class MoveGenerator
       Bitboard king_attacks;                      // for evasions
       int num_attacks;                            // for evasions
       Square source;                              // for evasions
+      Bitboard pinned;                            // for legal moves
+      bool legal;
       Move *batch;
       Move losers[100];
       Move moves[Constants::MaxMoves];
@@ -235,7 +254,10 @@ class RootMoveGenerator : public MoveGenerator
       }
 
       // enumerate the nodes for a "depth" ply search (for testing).
-      static uint64_t perft(Board &, int depth);
+      // If "legal" is true, only legal moves are generated and the
+      // last ply is counted without making the moves; otherwise
+      // pseudo-legal moves are made and then checked for legality.
+      static uint64_t perft(Board &, int depth, bool legal = true);
 
       score_t getScore(Move m) const noexcept {
          for (auto &it : moveList) {
@@ -0,0 +1,324 @@
+// Copyright 2019 by Jon Dart. All Rights Reserved.
+//
+#include "nnue.h"
+#include "board.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <random>
+
+#if defined(NNUE_AVX2)
+#include <immintrin.h>
+#elif defined(NNUE_SSE41)
+#include <smmintrin.h>
+#endif
+
+using namespace nnue;
+
+Network nnue::network;
+
+// File layout: this header, then the first layer biases and weights,
+// then biases followed by weights for each remaining layer, in native
+// byte order.
+struct NetworkFileHeader {
+   char magic[8];
+   uint32_t version;
+   uint32_t inputs, l1, l2, l3;
+};
+
+static const uint32_t NETWORK_FILE_VERSION = 1;
+
+static void initFileHeader(NetworkFileHeader &hdr) {
+   memcpy(hdr.magic,"ARASANNN",sizeof(hdr.magic));
+   hdr.version = NETWORK_FILE_VERSION;
+   hdr.inputs = INPUTS;
+   hdr.l1 = L1;
+   hdr.l2 = L2;
+   hdr.l3 = L3;
+}
+
+// index of the input for piece "p" on "sq" from the point of view
+// of "side"
+static FORCEINLINE int featureIndex(ColorType side, Piece p, Square sq) {
+   const int own = PieceColor(p) == side ? 0 : 1;
+   const int oriented = (side == White) ? sq : sq ^ 56;
+   return (((own*6) + TypeOfPiece(p) - 1) << 6) | oriented;
+}
+
+static FORCEINLINE void addFeature(int16_t *values, const int16_t *weights) {
+   for (int i = 0; i < L1; i++) values[i] += weights[i];
+}
+
+static FORCEINLINE void subFeature(int16_t *values, const int16_t *weights) {
+   for (int i = 0; i < L1; i++) values[i] -= weights[i];
+}
+
+// Clip first layer values to 0..127.
+static FORCEINLINE void clipScalar(const int16_t *in, uint8_t *out, int n) {
+   for (int i = 0; i < n; i++) {
+      out[i] = uint8_t(std::max<int>(0,std::min<int>(127,in[i])));
+   }
+}
+
+static FORCEINLINE int32_t dotScalar(const uint8_t *in, const int8_t *w, int n) {
+   int32_t sum = 0;
+   for (int i = 0; i < n; i++) sum += int32_t(in[i])*int32_t(w[i]);
+   return sum;
+}
+
+#if defined(NNUE_AVX2)
+static FORCEINLINE void clipSimd(const int16_t *in, uint8_t *out, int n) {
+   const __m256i zero = _mm256_setzero_si256();
+   for (int i = 0; i < n; i += 32) {
+      const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in+i));
+      const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in+i+16));
+      // pack saturates to -128..127; packing works within 128-bit
+      // lanes, so restore the element order afterwards
+      __m256i packed = _mm256_max_epi8(_mm256_packs_epi16(a,b),zero);
+      packed = _mm256_permute4x64_epi64(packed,0xd8);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out+i),packed);
+   }
+}
+
+// Inputs are at most 127, so the pairwise products summed by
+// maddubs cannot saturate.
+static FORCEINLINE int32_t dotSimd(const uint8_t *in, const int8_t *w, int n) {
+   const __m256i ones = _mm256_set1_epi16(1);
+   __m256i sum = _mm256_setzero_si256();
+   for (int i = 0; i < n; i += 32) {
+      const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in+i));
+      const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w+i));
+      sum = _mm256_add_epi32(sum,_mm256_madd_epi16(_mm256_maddubs_epi16(a,b),ones));
+   }
+   __m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum),_mm256_extracti128_si256(sum,1));
+   s = _mm_add_epi32(s,_mm_shuffle_epi32(s,0x4e));
+   s = _mm_add_epi32(s,_mm_shuffle_epi32(s,0xb1));
+   return _mm_cvtsi128_si32(s);
+}
+#elif defined(NNUE_SSE41)
+static FORCEINLINE void clipSimd(const int16_t *in, uint8_t *out, int n) {
+   const __m128i zero = _mm_setzero_si128();
+   for (int i = 0; i < n; i += 16) {
+      const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in+i));
+      const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in+i+8));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out+i),
+                       _mm_max_epi8(_mm_packs_epi16(a,b),zero));
+   }
+}
+
+static FORCEINLINE int32_t dotSimd(const uint8_t *in, const int8_t *w, int n) {
+   const __m128i ones = _mm_set1_epi16(1);
+   __m128i sum = _mm_setzero_si128();
+   for (int i = 0; i < n; i += 16) {
+      const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in+i));
+      const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(w+i));
+      sum = _mm_add_epi32(sum,_mm_madd_epi16(_mm_maddubs_epi16(a,b),ones));
+   }
+   sum = _mm_add_epi32(sum,_mm_shuffle_epi32(sum,0x4e));
+   sum = _mm_add_epi32(sum,_mm_shuffle_epi32(sum,0xb1));
+   return _mm_cvtsi128_si32(sum);
+}
+#else
+static FORCEINLINE void clipSimd(const int16_t *in, uint8_t *out, int n) {
+   clipScalar(in,out,n);
+}
+
+static FORCEINLINE int32_t dotSimd(const uint8_t *in, const int8_t *w, int n) {
+   return dotScalar(in,w,n);
+}
+#endif
+
+template <bool simd>
+static FORCEINLINE uint8_t hidden(int32_t bias, const uint8_t *in, const int8_t *w, int n) {
+   const int32_t sum = bias + (simd ? dotSimd(in,w,n) : dotScalar(in,w,n));
+   return uint8_t(std::max<int32_t>(0,std::min<int32_t>(127,sum >> WEIGHT_SHIFT)));
+}
+
+Network::Network()
+   : loaded(false) {
+}
+
+const char *Network::simdKernel() {
+#if defined(NNUE_AVX2)
+   return "AVX2";
+#elif defined(NNUE_SSE41)
+   return "SSE4.1";
+#else
+   return nullptr;
+#endif
+}
+
+bool Network::load(const string &fileName) {
+   loaded = false;
+   ifstream in(fileName.c_str(), ios::in | ios::binary);
+   if (!in.good()) {
+      return false;
+   }
+   NetworkFileHeader expected, hdr;
+   initFileHeader(expected);
+   in.read(reinterpret_cast<char*>(&hdr),sizeof(hdr));
+   if (in.fail() || memcmp(&hdr,&expected,sizeof(hdr))) {
+      return false;
+   }
+   in.read(reinterpret_cast<char*>(ftBiases),sizeof(ftBiases));
+   in.read(reinterpret_cast<char*>(ftWeights),sizeof(ftWeights));
+   in.read(reinterpret_cast<char*>(l2Biases),sizeof(l2Biases));
+   in.read(reinterpret_cast<char*>(l2Weights),sizeof(l2Weights));
+   in.read(reinterpret_cast<char*>(l3Biases),sizeof(l3Biases));
+   in.read(reinterpret_cast<char*>(l3Weights),sizeof(l3Weights));
+   in.read(reinterpret_cast<char*>(&outBias),sizeof(outBias));
+   in.read(reinterpret_cast<char*>(outWeights),sizeof(outWeights));
+   // the file must end after the weights
+   if (in.fail() || in.peek() != char_traits<char>::eof()) {
+      return false;
+   }
+   loaded = true;
+   return true;
+}
+
+bool Network::save(const string &fileName) const {
+   ofstream out(fileName.c_str(), ios::out | ios::binary | ios::trunc);
+   if (!out.good()) {
+      return false;
+   }
+   NetworkFileHeader hdr;
+   initFileHeader(hdr);
+   out.write(reinterpret_cast<const char*>(&hdr),sizeof(hdr));
+   out.write(reinterpret_cast<const char*>(ftBiases),sizeof(ftBiases));
+   out.write(reinterpret_cast<const char*>(ftWeights),sizeof(ftWeights));
+   out.write(reinterpret_cast<const char*>(l2Biases),sizeof(l2Biases));
+   out.write(reinterpret_cast<const char*>(l2Weights),sizeof(l2Weights));
+   out.write(reinterpret_cast<const char*>(l3Biases),sizeof(l3Biases));
+   out.write(reinterpret_cast<const char*>(l3Weights),sizeof(l3Weights));
+   out.write(reinterpret_cast<const char*>(&outBias),sizeof(outBias));
+   out.write(reinterpret_cast<const char*>(outWeights),sizeof(outWeights));
+   out.close();
+   return !out.fail();
+}
+
+void Network::randomize(uint64_t seed) {
+   std::mt19937_64 engine(seed);
+   std::uniform_int_distribution<int> small(-16,16), weight(-64,64), bias(-2048,2048);
+   for (int16_t &x : ftBiases) x = int16_t(small(engine)+16);
+   for (int16_t &x : ftWeights) x = int16_t(small(engine));
+   for (int32_t &x : l2Biases) x = bias(engine);
+   for (int8_t &x : l2Weights) x = int8_t(weight(engine));
+   for (int32_t &x : l3Biases) x = bias(engine);
+   for (int8_t &x : l3Weights) x = int8_t(weight(engine));
+   outBias = bias(engine);
+   for (int8_t &x : outWeights) x = int8_t(weight(engine));
+   loaded = true;
+}
+
+void Network::refresh(const Board &board, Accumulator &acc) const {
+   for (int i = 0; i < 2; i++) {
+      const ColorType side = (ColorType)i;
+      int16_t *values = acc.values[side];
+      memcpy(values,ftBiases,sizeof(ftBiases));
+      Bitboard all(board.allOccupied);
+      Square sq;
+      while (all.iterate(sq)) {
+         addFeature(values,ftWeights+L1*featureIndex(side,board[sq],sq));
+      }
+   }
+   acc.computed = true;
+}
+
+void Network::applyChanges(const Accumulator &prev, Accumulator &acc) const {
+   for (int i = 0; i < 2; i++) {
+      const ColorType side = (ColorType)i;
+      int16_t *values = acc.values[side];
+      memcpy(values,prev.values[side],sizeof(acc.values[side]));
+      for (int j = 0; j < acc.dirtyCount; j++) {
+         const DirtyPiece &dp = acc.dirty[j];
+         if (dp.from != InvalidSquare) {
+            subFeature(values,ftWeights+L1*featureIndex(side,dp.piece,dp.from));
+         }
+         if (dp.to != InvalidSquare) {
+            addFeature(values,ftWeights+L1*featureIndex(side,dp.piece,dp.to));
+         }
+      }
+   }
+   acc.computed = true;
+}
+
+void Network::revertChanges(const Accumulator &acc, Accumulator &prev) const {
+   for (int i = 0; i < 2; i++) {
+      const ColorType side = (ColorType)i;
+      int16_t *values = prev.values[side];
+      memcpy(values,acc.values[side],sizeof(prev.values[side]));
+      for (int j = 0; j < acc.dirtyCount; j++) {
+         const DirtyPiece &dp = acc.dirty[j];
+         if (dp.to != InvalidSquare) {
+            subFeature(values,ftWeights+L1*featureIndex(side,dp.piece,dp.to));
+         }
+         if (dp.from != InvalidSquare) {
+            addFeature(values,ftWeights+L1*featureIndex(side,dp.piece,dp.from));
+         }
+      }
+   }
+   prev.computed = true;
+}
+
+void Network::update(const Board &board, AccumulatorStack &stack) const {
+   // Find the nearest computed entry and update forward from it. If
+   // it is far enough back that the updates would cost more than a
+   // full computation, refresh instead.
+   static const int MAX_UPDATES = 8;
+   int i = stack.top;
+   while (i > 0 && !stack.entries[i].computed && stack.top - i < MAX_UPDATES) --i;
+   if (stack.entries[i].computed) {
+      for (int j = i + 1; j <= stack.top; j++) {
+         applyChanges(stack.entries[j-1],stack.entries[j]);
+      }
+      return;
+   }
+   refresh(board,stack.current());
+   if (i == 0) {
+      // No entry was computed (as after a reset): also compute the
+      // earlier positions, so that positions reached from them can
+      // be updated incrementally.
+      for (int j = stack.top; j > 0; j--) {
+         revertChanges(stack.entries[j],stack.entries[j-1]);
+      }
+   }
+}
+
+template <bool simd>
+int32_t Network::forward(const Accumulator &acc, ColorType side) const {
+   uint8_t input[2*L1], h2[L2], h3[L3];
+   if (simd) {
+      clipSimd(acc.values[side],input,L1);
+      clipSimd(acc.values[OppositeColor(side)],input+L1,L1);
+   }
+   else {
+      clipScalar(acc.values[side],input,L1);
+      clipScalar(acc.values[OppositeColor(side)],input+L1,L1);
+   }
+   for (int i = 0; i < L2; i++) {
+      h2[i] = hidden<simd>(l2Biases[i],input,l2Weights+i*2*L1,2*L1);
+   }
+   for (int i = 0; i < L3; i++) {
+      h3[i] = hidden<simd>(l3Biases[i],h2,l3Weights+i*L2,L2);
+   }
+   return outBias + dotScalar(h3,outWeights,L3);
+}
+
+score_t Network::evaluate(const Board &board, bool scalar) const {
+   AccumulatorStack *stack = board.accumulatorStack();
+   Accumulator tmp;
+   Accumulator *acc = &tmp;
+   if (stack) {
+      acc = &stack->current();
+      if (!acc->computed) update(board,*stack);
+   }
+   else {
+      refresh(board,tmp);
+   }
+   const int32_t out = scalar ? forward<false>(*acc,board.sideToMove()) :
+      forward<true>(*acc,board.sideToMove());
+   return score_t(std::max<int32_t>(-Constants::BITBASE_WIN+1,
+                                    std::min<int32_t>(Constants::BITBASE_WIN-1,
+                                                      out/OUTPUT_DIVISOR)));
+}
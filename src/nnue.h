@@ -0,0 +1,197 @@
+// Copyright 2019 by Jon Dart. All Rights Reserved.
+//
+// Neural network evaluation using an efficiently updatable first
+// layer (NNUE).
+//
+#ifndef _NNUE_H
+#define _NNUE_H
+
+#include "types.h"
+#include "chess.h"
+#include "constant.h"
+#include "debug.h"
+
+#include <string>
+using namespace std;
+
+#if defined(__AVX2__)
+#define NNUE_AVX2
+#elif defined(__SSE4_1__)
+#define NNUE_SSE41
+#endif
+
+class Board;
+
+namespace nnue {
+
+// Network architecture. Inputs are piece-square features (own and
+// opponent piece type x square, with squares flipped for Black so each
+// side's pieces move up the board). The first layer is kept for both
+// sides and updated incrementally as moves are made. Its clipped
+// outputs (side to move first) feed two 32-element hidden layers and
+// a single output.
+static constexpr int INPUTS = 768;
+static constexpr int L1 = 256;
+static constexpr int L2 = 32;
+static constexpr int L3 = 32;
+
+// Hidden layer sums are shifted right by this many bits before
+// clipping to 0..127.
+static constexpr int WEIGHT_SHIFT = 6;
+
+// Divisor converting network output to score units.
+static constexpr int OUTPUT_DIVISOR = 16;
+
+// A piece removed from "from" and/or placed on "to" by a move
+// (InvalidSquare if none).
+struct DirtyPiece {
+   Piece piece;
+   Square from, to;
+};
+
+struct Accumulator {
+   int16_t values[2][L1]; // indexed by perspective (side)
+   DirtyPiece dirty[3]; // changes from the previous position
+   int dirtyCount;
+   bool computed;
+};
+
+// Accumulators for the current line of play. Board::doMove records
+// the pieces changed by each move; the first layer values are computed
+// when the position is evaluated, from the nearest computed entry.
+class AccumulatorStack {
+public:
+   static constexpr int SIZE = 2*Constants::MaxPly;
+
+   AccumulatorStack() {
+      reset();
+   }
+
+   void reset() {
+      top = 0;
+      entries[0].dirtyCount = 0;
+      entries[0].computed = false;
+   }
+
+   // record the changes made by "move" for "side" (the side making
+   // the move)
+   void push(Move move, ColorType side) {
+      ASSERT(top < SIZE-1);
+      Accumulator &acc = entries[++top];
+      acc.computed = false;
+      const Square start = StartSquare(move);
+      const Square dest = DestSquare(move);
+      const Piece moved = MakePiece(PieceMoved(move),side);
+      int n = 0;
+      switch (TypeOfMove(move)) {
+      case Promotion:
+         acc.dirty[n++] = {moved, start, InvalidSquare};
+         acc.dirty[n++] = {MakePiece(PromoteTo(move),side), InvalidSquare, dest};
+         break;
+      case KCastle:
+         acc.dirty[n++] = {moved, start, dest};
+         acc.dirty[n++] = {MakePiece(Rook,side), Square(start+3), Square(start+1)};
+         break;
+      case QCastle:
+         acc.dirty[n++] = {moved, start, dest};
+         acc.dirty[n++] = {MakePiece(Rook,side), Square(start-4), Square(start-1)};
+         break;
+      default:
+         acc.dirty[n++] = {moved, start, dest};
+         break;
+      }
+      if (Capture(move) != Empty) {
+         Square target = dest;
+         if (TypeOfMove(move) == EnPassant) {
+            target = (side == White) ? dest - 8 : dest + 8;
+         }
+         acc.dirty[n++] = {MakePiece(Capture(move),OppositeColor(side)),
+                           target, InvalidSquare};
+      }
+      acc.dirtyCount = n;
+   }
+
+   void pushNull() {
+      ASSERT(top < SIZE-1);
+      Accumulator &acc = entries[++top];
+      acc.dirtyCount = 0;
+      acc.computed = false;
+   }
+
+   void pop() {
+      ASSERT(top > 0);
+      --top;
+   }
+
+   Accumulator &current() {
+      return entries[top];
+   }
+
+   int top;
+   Accumulator entries[SIZE];
+};
+
+class Network {
+public:
+   Network();
+
+   // Load weights from a file. Returns false if the file is missing
+   // or has an incompatible format (the network is then unloaded).
+   bool load(const string &fileName);
+
+   bool save(const string &fileName) const;
+
+   // Set random weights (for testing and benchmarking).
+   void randomize(uint64_t seed);
+
+   void clear() {
+      loaded = false;
+   }
+
+   bool isLoaded() const {
+      return loaded;
+   }
+
+   // Return the evaluation of "board" from the side to move's point
+   // of view. If the board has an accumulator stack, the current
+   // entry is brought up to date and used, otherwise the first layer
+   // is computed from scratch. If "scalar" is true the hidden layers
+   // are computed without SIMD instructions.
+   score_t evaluate(const Board &board, bool scalar = false) const;
+
+   // Compute the first layer for "board" from scratch.
+   void refresh(const Board &board, Accumulator &acc) const;
+
+   // Name of the SIMD kernel selected at build time, or nullptr if
+   // only the scalar kernel is available.
+   static const char *simdKernel();
+
+private:
+   void update(const Board &board, AccumulatorStack &stack) const;
+
+   // compute "acc" from the previous position's values
+   void applyChanges(const Accumulator &prev, Accumulator &acc) const;
+
+   // compute the previous position's values from "acc"
+   void revertChanges(const Accumulator &acc, Accumulator &prev) const;
+
+   template <bool simd>
+   int32_t forward(const Accumulator &acc, ColorType side) const;
+
+   int16_t ftBiases[L1];
+   int16_t ftWeights[INPUTS*L1];
+   int32_t l2Biases[L2];
+   int8_t l2Weights[L2*2*L1];
+   int32_t l3Biases[L3];
+   int8_t l3Weights[L3*L2];
+   int32_t outBias;
+   int8_t outWeights[L3];
+   bool loaded;
+};
+
+// network used by the evaluator
+extern Network network;
+
+}
+
+#endif
@@ -42,6 +42,11 @@ Options::SearchOptions::SearchOptions() :
 #ifdef NUMA
       set_processor_affinity(0),
 #endif
+      large_pages(1),
+      hash_file("arasan.hsh"),
+      nn_eval(0),
+      nn_file("arasan.nnue"),
+      param_file(""),
       move_overhead(15),
       minimum_search_time(10)
 {
@@ -101,6 +106,25 @@ static void set_boolean_option(const string &name,const string &valueString,int
     cerr << "warning: invalid value for option " << name << " (expected 'true' or 'false')"  << endl;
 }
 
+bool Options::stringToBookFormat(const string &value, BookFormat &format) {
+  string lower(value);
+  std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+  if (lower == "arasan") {
+    format = BookFormat::Arasan;
+  }
+  else if (lower == "polyglot") {
+    format = BookFormat::Polyglot;
+  }
+  else {
+    return false;
+  }
+  return true;
+}
+
+string Options::bookFormatToString(BookFormat format) {
+  return format == BookFormat::Polyglot ? "Polyglot" : "Arasan";
+}
+
 void Options::set_option(const string &name, const string &value) {
   if (name == "log.enabled") {
      set_boolean_option(name,value,log_enabled);
@@ -120,6 +144,17 @@ void Options::set_option(const string &name, const string &value) {
   else if (name == "book.book_enabled") {
     set_boolean_option(name,value,book.book_enabled);
   }
+  else if (name == "book.book_file") {
+    book.book_file = value;
+  }
+  else if (name == "book.format") {
+    if (!stringToBookFormat(value,book.format)) {
+      cerr << "warning: invalid value for option " << name << " (expected 'arasan' or 'polyglot')" << endl;
+    }
+  }
+  else if (name == "book.book_learning") {
+    set_boolean_option(name,value,book.book_learning);
+  }
   else if (name == "book.frequency") {
      setOption<unsigned>(name,value,book.frequency);
      book.frequency = std::min<unsigned>(100,std::max<unsigned>(0,book.frequency));
@@ -181,6 +216,21 @@ void Options::set_option(const string &name, const string &value) {
     set_boolean_option(name,value,search.set_processor_affinity);
   }
 #endif
+  else if (name == "search.large_pages") {
+    set_boolean_option(name,value,search.large_pages);
+  }
+  else if (name == "search.hash_file") {
+    search.hash_file = value;
+  }
+  else if (name == "search.nn_eval") {
+    set_boolean_option(name,value,search.nn_eval);
+  }
+  else if (name == "search.nn_file") {
+    search.nn_file = value;
+  }
+  else if (name == "search.param_file") {
+    search.param_file = value;
+  }
   else if (name == "search.move_overhead") {
     setOption<int>(name,value,search.move_overhead);
   }
@@ -14,16 +14,24 @@ class Options
  public:
   enum class TbType {None, NalimovTb, GaviotaTb, SyzygyTb};
 
+  enum class BookFormat {Arasan, Polyglot};
+
   struct BookOptions {
     BookOptions()
        : frequency(50),
          weighting(50),
          scoring(50),
-         book_enabled(1)
+         book_enabled(1),
+         book_file("book.bin"),
+         format(BookFormat::Arasan),
+         book_learning(0)
     { }
 
     unsigned frequency, weighting, scoring;
     int book_enabled;
+    string book_file; // in the program directory if no path is given
+    BookFormat format;
+    int book_learning; // update book statistics with game results
   } book;
 
   struct SearchOptions {
@@ -48,6 +56,11 @@ class Options
 #ifdef NUMA
    int set_processor_affinity; // lock threads to processors
 #endif
+   int large_pages; // use huge pages for hash table if available
+   string hash_file; // default file for savehash/loadhash
+   int nn_eval; // use neural network evaluation
+   string nn_file; // network file for nn_eval
+   string param_file; // scoring parameter file (built-in values if empty)
    int move_overhead; // in milliseconds
    int minimum_search_time; // in milliseconds
   } search;
@@ -96,6 +109,12 @@ class Options
 
    static string tbTypeToString(TbType);
 
+   // Parse a book format name ("Arasan" or "Polyglot", case is
+   // ignored). Returns false if not recognized.
+   static bool stringToBookFormat(const string &, BookFormat &);
+
+   static string bookFormatToString(BookFormat);
+
    string tbPath() const;
 
    // sets options based on a .rc file
@@ -0,0 +1,113 @@
+// Copyright 2019 by Jon Dart. All Rights Reserved.
+#ifndef _PACKPOS_H
+#define _PACKPOS_H
+
+// Fixed-size binary records for training positions. datagen writes
+// them, and the tuner reads them, either from datagen output or from
+// its own position cache (-b option). Files begin with a
+// PackedPositionHeader and records follow it. All fields are in
+// native byte order.
+
+#include "board.h"
+#include <algorithm>
+#include <cstring>
+
+struct PackedPosition
+{
+   uint64_t occupied;     // bit set for each occupied square
+   uint8_t pieces[16];    // Piece values (4 bits each, low nibble first)
+                          // for occupied squares, in square order
+   int16_t score;         // search score, from White's point of view
+                          // (0 if not known)
+   uint8_t flags;         // bit 0: side to move (1 = Black),
+                          // bits 1-3: White CastleType,
+                          // bits 4-6: Black CastleType
+   uint8_t epSquare;      // en passant pawn square (as in BoardState)
+   uint8_t result;        // 0 = Black wins, 1 = draw, 2 = White wins
+   uint8_t moveCount;     // moves since last capture or pawn move
+   uint16_t ply;          // game ply (0 if not known)
+
+   // Set the position fields from "board". The score, result and
+   // ply are zero. Returns false if the board has more than 32
+   // pieces.
+   bool pack(const Board &board) {
+      std::memset(this,'\0',sizeof(PackedPosition));
+      int n = 0;
+      for (Square sq = 0; sq < 64; sq++) {
+         const Piece p = board[sq];
+         if (p != EmptyPiece) {
+            if (n == 32) return false;
+            occupied |= (uint64_t)1 << sq;
+            pieces[n/2] |= (uint8_t)p << (4*(n%2));
+            ++n;
+         }
+      }
+      flags = uint8_t((board.sideToMove() == Black) |
+                      (board.castleStatus(White) << 1) |
+                      (board.castleStatus(Black) << 4));
+      epSquare = uint8_t(board.enPassantSq());
+      moveCount = uint8_t(std::min<int>(255,board.state.moveCount));
+      return true;
+   }
+
+   void unpack(Board &board) const {
+      board.makeEmpty();
+      Bitboard occ(occupied);
+      Square sq;
+      int n = 0;
+      while (occ.iterate(sq)) {
+         board.setContents(Piece((pieces[n/2] >> (4*(n%2))) & 0xf),sq);
+         ++n;
+      }
+      board.setSideToMove(sideToMove());
+      board.state.castleStatus[White] = CastleType((flags >> 1) & 7);
+      board.state.castleStatus[Black] = CastleType((flags >> 4) & 7);
+      board.state.enPassantSq = Square(epSquare);
+      board.state.moveCount = moveCount;
+      board.setSecondaryVars();
+   }
+
+   ColorType sideToMove() const {
+      return (flags & 1) ? Black : White;
+   }
+
+   // set the result from a game score (0.0, 0.5 or 1.0)
+   void setResult(double res) {
+      result = uint8_t(res < 0.25 ? 0 : (res > 0.75 ? 2 : 1));
+   }
+
+   // result as a game score, from White's point of view
+   double resultValue() const {
+      return result/2.0;
+   }
+};
+
+static_assert(sizeof(PackedPosition) == 32, "unexpected PackedPosition size");
+
+static const char PACKED_POSITION_MAGIC[8] = {'A','R','A','S','A','N','T','P'};
+
+struct PackedPositionHeader
+{
+   char magic[8];
+   uint32_t version;
+   uint32_t recordSize;
+   uint64_t count;
+   uint64_t sourceSize; // size of the tuner's training file (0 if none)
+
+   static const uint32_t VERSION = 2;
+
+   PackedPositionHeader(uint64_t n = 0, uint64_t size = 0)
+      : version(VERSION), recordSize(sizeof(PackedPosition)),
+        count(n), sourceSize(size) {
+      std::memcpy(magic,PACKED_POSITION_MAGIC,sizeof(magic));
+   }
+
+   // true if the header is valid, for a file of "fileSize" bytes
+   bool valid(uint64_t fileSize) const {
+      return std::memcmp(magic,PACKED_POSITION_MAGIC,sizeof(magic)) == 0 &&
+         version == VERSION && recordSize == sizeof(PackedPosition) &&
+         fileSize == sizeof(PackedPositionHeader) + count*sizeof(PackedPosition);
+   }
+};
+
+#endif
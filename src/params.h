@@ -5,14 +5,9 @@
 
 #include "chess.h"
 
-#ifdef TUNE
-// scoring parameters that are not const, so can be
-// modified during tuning
+// Scoring parameters are not const, so they can be modified during
+// tuning, or read from a parameter file (see Params::readValues).
 #define PARAM_MOD score_t
-#else
-// parameters are const so can be optimized better
-#define PARAM_MOD const score_t
-#endif
 
 #ifdef __INTEL_COMPILER
 #pragma pack(push,1)
@@ -194,6 +189,22 @@ BEGIN_PACKED_STRUCT
 #ifdef TUNE
     static void write(ostream &, const string &comment);
 #endif
+
+    // Write the parameter values in parameter file format: one line
+    // per parameter, with its name followed by its value(s) (arrays
+    // in row-major order).
+    static void writeValues(ostream &);
+
+    // Read parameter values written by writeValues. Parameters not in
+    // the file keep their current values. Returns false, with a
+    // message in "err", if the file has an error, in which case no
+    // values are changed. The piece-square table is rebuilt (see
+    // Board::initPstTable).
+    static bool readValues(istream &, string &err);
+
+    // Restore the values compiled into the program (undoes
+    // readValues).
+    static void restoreDefaults();
 END_PACKED_STRUCT
 
 #ifdef __INTEL_COMPILER
@@ -0,0 +1,158 @@
+// Copyright 2019 by Jon Dart. All Rights Reserved.
+//
+#include "perft.h"
+#include "movegen.h"
+
+#include <algorithm>
+#include <thread>
+
+Perft::Perft(unsigned t, size_t hashSize, bool l)
+    : threads(std::max<unsigned>(1,t)),
+      legal(l),
+      hashMask(0),
+      hits(0)
+{
+    if (hashSize >= sizeof(HashEntry)) {
+        // use the largest power of 2 number of entries that fits
+        size_t entries = 1;
+        while (2*entries*sizeof(HashEntry) <= hashSize) {
+            entries *= 2;
+        }
+        hashTable.reset(new HashEntry[entries]);
+        hashMask = entries-1;
+    }
+}
+
+uint64_t Perft::run(const Board &board, int depth,
+                    vector<DivideEntry> *divide)
+{
+    hits = 0;
+    if (divide) divide->clear();
+    if (depth <= 0) return 1;
+    if (hashTable) {
+        for (size_t i = 0; i <= hashMask; i++) {
+            hashTable[i].key.store(0ULL,std::memory_order_relaxed);
+            hashTable[i].data.store(0ULL,std::memory_order_relaxed);
+        }
+    }
+    // The root moves are always checked for legality, so that only
+    // legal moves are listed.
+    Board root(board);
+    Move moves[Constants::MaxMoves];
+    const int n = MoveGenerator(root).generateLegalMoves(moves);
+
+    // Each task counts one subtree. With more than one thread, the
+    // subtrees start two plies down, so that there are enough tasks
+    // to keep all threads busy until near the end.
+    struct Task {
+        int rootIndex;
+        Board board;
+        int depth;
+        uint64_t nodes;
+    };
+    vector<Task> tasks;
+    for (int i = 0; i < n; i++) {
+        Board b(root);
+        b.doMove(moves[i]);
+        if (threads > 1 && depth >= 3) {
+            Move replies[Constants::MaxMoves];
+            const int count = MoveGenerator(b).generateLegalMoves(replies);
+            for (int j = 0; j < count; j++) {
+                Board b2(b);
+                b2.doMove(replies[j]);
+                tasks.push_back(Task{i,b2,depth-2,0ULL});
+            }
+        } else {
+            tasks.push_back(Task{i,b,depth-1,0ULL});
+        }
+    }
+
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        uint64_t hashHits = 0ULL;
+        size_t i;
+        while ((i = next++) < tasks.size()) {
+            tasks[i].nodes = count(tasks[i].board,tasks[i].depth,hashHits);
+        }
+        hits += hashHits;
+    };
+    vector<std::thread> workers;
+    for (unsigned i = 1; i < threads; i++) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (std::thread &t : workers) {
+        t.join();
+    }
+
+    vector<uint64_t> rootCounts(n,0ULL);
+    for (const Task &task : tasks) {
+        rootCounts[task.rootIndex] += task.nodes;
+    }
+    uint64_t total = 0ULL;
+    for (int i = 0; i < n; i++) {
+        total += rootCounts[i];
+        if (divide) divide->push_back(DivideEntry{moves[i],rootCounts[i]});
+    }
+    return total;
+}
+
+uint64_t Perft::count(Board &board, int depth, uint64_t &hashHits)
+{
+    if (depth == 0) return 1;
+
+    // counts for the last ply are cheap, so are not hashed
+    const bool useHash = hashTable && depth > 1;
+    uint64_t nodes = 0ULL;
+    if (useHash && probe(board.hashCode(),depth,nodes)) {
+        ++hashHits;
+        return nodes;
+    }
+    MoveGenerator mg(board);
+    Move moves[Constants::MaxMoves];
+    const BoardState state = board.state;
+    if (legal) {
+        const int n = mg.generateLegalMoves(moves);
+        // no need to make the moves at the last ply
+        if (depth == 1) return n;
+        for (int i = 0; i < n; i++) {
+            board.doMove(moves[i]);
+            nodes += count(board,depth-1,hashHits);
+            board.undoMove(moves[i],state);
+        }
+    } else {
+        const bool inCheck = board.checkStatus() == InCheck;
+        const int n = mg.generateAllMoves(moves,0);
+        for (int i = 0; i < n; i++) {
+            board.doMove(moves[i]);
+            // evasions are already legal
+            if (inCheck || board.wasLegal(moves[i])) {
+                nodes += count(board,depth-1,hashHits);
+            }
+            board.undoMove(moves[i],state);
+        }
+    }
+    if (useHash) store(board.hashCode(),depth,nodes);
+    return nodes;
+}
+
+bool Perft::probe(hash_t hashCode, int depth, uint64_t &nodes) const
+{
+    const HashEntry &entry = hashTable[hashCode & hashMask];
+    const uint64_t data = entry.data.load(std::memory_order_relaxed);
+    const uint64_t key = entry.key.load(std::memory_order_relaxed);
+    if ((key ^ data) == hashCode && int(data & 0xff) == depth) {
+        nodes = data >> 8;
+        return true;
+    }
+    return false;
+}
+
+void Perft::store(hash_t hashCode, int depth, uint64_t nodes)
+{
+    // always replace
+    HashEntry &entry = hashTable[hashCode & hashMask];
+    const uint64_t data = (nodes << 8) | uint64_t(depth);
+    entry.key.store(hashCode ^ data,std::memory_order_relaxed);
+    entry.data.store(data,std::memory_order_relaxed);
+}
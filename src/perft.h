@@ -0,0 +1,70 @@
+// Support for the "perft" command (move generator node counts).
+// Copyright 2019 by Jon Dart. All Rights Reserved.
+//
+#ifndef _PERFT_H
+#define _PERFT_H
+
+#include "board.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+using namespace std;
+
+class Perft
+{
+
+public:
+    // "threads" threads are used to count the subtrees. If "hashSize"
+    // (in bytes) is nonzero, a hash table of that size shared by all
+    // threads caches subtree counts for transposed positions. If "legal"
+    // is true, only legal moves are generated, otherwise pseudo-legal
+    // moves are generated and tested for legality after they are made.
+    Perft(unsigned threads = 1, size_t hashSize = 0, bool legal = true);
+
+    virtual ~Perft() = default;
+
+    struct DivideEntry {
+        Move move;
+        uint64_t nodes;
+    };
+
+    // Return the number of leaf nodes of a "depth" ply tree from
+    // "board". If "divide" is not null, it is filled with the count
+    // for each move from "board".
+    uint64_t run(const Board &board, int depth,
+                 vector<DivideEntry> *divide = nullptr);
+
+    // number of subtree counts found in the hash table during the
+    // last run
+    uint64_t hashHits() const {
+        return hits;
+    }
+
+private:
+
+    // Entries are written without locking. The key is stored xor'd
+    // with the data, so an entry torn by concurrent writes fails
+    // the key test.
+    struct HashEntry {
+        std::atomic<uint64_t> key;
+        std::atomic<uint64_t> data; // nodes << 8 | depth
+    };
+
+    // count the nodes below "board", adding the number of hash table
+    // hits to "hashHits"
+    uint64_t count(Board &board, int depth, uint64_t &hashHits);
+
+    bool probe(hash_t hashCode, int depth, uint64_t &nodes) const;
+
+    void store(hash_t hashCode, int depth, uint64_t nodes);
+
+    unsigned threads;
+    bool legal;
+    std::unique_ptr<HashEntry[]> hashTable;
+    size_t hashMask;
+    std::atomic<uint64_t> hits;
+};
+
+#endif
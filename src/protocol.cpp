@@ -3,6 +3,8 @@
 #include "protocol.h"
 
 #include "attacks.h"
+#include "bench.h"
+#include "perft.h"
 #include "bitprobe.h"
 #include "boardio.h"
 #include "calctime.h"
@@ -61,6 +63,7 @@ Protocol::Protocol(const Board &board, bool traceOn, bool icsMode, bool cpus_set
       moves(0),
       ponder_board(new Board()),
       main_board(new Board(board)),
+      pstVersion(Board::pstVersion()),
       ponder_move_ok(false),
       predicted_move(NullMove),
       ponder_move(NullMove),
@@ -88,6 +91,7 @@ Protocol::Protocol(const Board &board, bool traceOn, bool icsMode, bool cpus_set
 {
     ecoCoder = new ECO();
     searcher = new SearchController();
+    cout << "hash table: " << searcher->hashTable.memoryDescription() << endl;
     searcher->registerPostFunction(std::bind(&Protocol::post_output,this,_1));
     searcher->registerMonitorFunction(std::bind(&Protocol::monitor,this,_1,_2));
 
@@ -502,7 +506,19 @@ void Protocol::do_help() {
    cout << "test <file> <-t seconds> <-x # moves> <-v> <-o outfile>: "<< endl;
    cout << "   - run an EPD testsuite" << endl;
    cout << "eval <file>:     evaluate a FEN position." << endl;
-   cout << "perft <depth>:   compute perft value for a given depth" << endl;
+   cout << "perft <depth> <-p> <-t threads> <-h hash MB> <-d>: compute perft value for a given depth" << endl;
+   cout << "   - with -p, generate pseudo-legal moves and test them after making them" << endl;
+   cout << "   - with -t, count subtrees with multiple threads" << endl;
+   cout << "   - with -h, cache subtree counts in a hash table of the given size" << endl;
+   cout << "   - with -d, also show the count for each move (divide)" << endl;
+   cout << "bench <depth> <-v> <-t threads> <-l [searches]> <-p> <-e> <-s> <-b [book file]>: search benchmark positions, report speed" << endl;
+   cout << "   - with -t, report scaling for 1 up to the given number of threads" << endl;
+   cout << "   - with -l, report search start latency over a number of searches" << endl;
+   cout << "   - with -p, compare speed with and without node count polling" << endl;
+   cout << "   - with -e, report evaluation speed for each evaluation kernel" << endl;
+   cout << "   - with -s, report static exchange evaluation (SEE) speed" << endl;
+   cout << "savehash <file>: save the hash table to a file" << endl;
+   cout << "loadhash <file>: load a hash table saved with savehash" << endl;
 }
 
 
@@ -1672,6 +1688,27 @@ void Protocol::execute_move(Board &board,Move m)
     gameMoves->add_move(board,previous_state,m,last_move_image,false);
 }
 
+void Protocol::setParamFile(const string &fileName)
+{
+    unloadParams();
+    options.search.param_file = fileName;
+    delayedInit();
+    // cached scores were computed with the old parameters
+    searcher->clearHashTables();
+}
+
+void Protocol::delayedInit()
+{
+    ::delayedInit();
+    if (pstVersion != Board::pstVersion()) {
+        // parameters were loaded or restored since the boards' sums
+        // were computed
+        main_board->setSecondaryVars();
+        ponder_board->setSecondaryVars();
+        pstVersion = Board::pstVersion();
+    }
+}
+
 #ifdef TUNE
 void Protocol::setTuningParam(const string &name, const string &value)
 {
@@ -1722,7 +1759,24 @@ void Protocol::processWinboardOptions(const string &args) {
     if (doTrace) {
         cout << "# setting option " << name << "=" << value << endl;
     }
-    if (name == "Favor frequent book moves") {
+    if (name == "Book file") {
+        openingBook.close();
+        options.book.book_file = value;
+        delayedInit();
+    } else if (name == "Book format") {
+        if (Options::stringToBookFormat(value,options.book.format)) {
+            openingBook.close();
+            delayedInit();
+        }
+    } else if (name == "Book learning") {
+        int tmp = options.book.book_learning;
+        setCheckOption(value,options.book.book_learning);
+        if (tmp != options.book.book_learning) {
+            // reopen, writable if learning
+            openingBook.close();
+            delayedInit();
+        }
+    } else if (name == "Favor frequent book moves") {
         Options::setOption<unsigned>(value,options.book.frequency);
     } else if (name == "Favor high-weighted book moves") {
         Options::setOption<unsigned>(value,options.book.weighting);
@@ -1734,6 +1788,25 @@ void Protocol::processWinboardOptions(const string &args) {
         setCheckOption(value,options.learning.position_learning);
     } else if (name == "Strength") {
         Options::setOption<int>(value,options.search.strength);
+    } else if (name == "Large pages") {
+        int tmp = options.search.large_pages;
+        setCheckOption(value,options.search.large_pages);
+        if (tmp != options.search.large_pages) {
+            searcher->resizeHash(options.search.hash_table_size);
+        }
+    } else if (name == "Clear Hash") {
+        searcher->clearHashTables();
+    } else if (name == "Use NN eval") {
+        int tmp = options.search.nn_eval;
+        setCheckOption(value,tmp);
+        setNNEval(tmp != 0);
+        delayedInit();
+    } else if (name == "NN file") {
+        unloadNetwork();
+        options.search.nn_file = value;
+        delayedInit();
+    } else if (name == "Param file") {
+        setParamFile(value);
 #ifdef NUMA
     } else if (name == "Set processor affinity") {
        int tmp = options.search.set_processor_affinity;
@@ -1758,27 +1831,6 @@ void Protocol::processWinboardOptions(const string &args) {
    searcher->updateSearchOptions();
 }
 
-uint64_t Protocol::perft(Board &board, int depth) {
-   if (depth == 0) return 1;
-
-   uint64_t nodes = 0ULL;
-   RootMoveGenerator mg(board);
-   Move m;
-   BoardState state = board.state;
-   int order = 0;
-   while ((m = mg.nextMove(order)) != NullMove) {
-      if (depth > 1) {
-         board.doMove(m);
-         nodes += perft(board,depth-1);
-         board.undoMove(m,state);
-      } else {
-         // skip do/undo
-         nodes++;
-      }
-   }
-   return nodes;
-}
-
 void Protocol::loadgame(Board &board,ifstream &file) {
     vector<ChessIO::Header> hdrs(20);
     long first;
@@ -1820,6 +1872,40 @@ void Protocol::loadgame(Board &board,ifstream &file) {
 }
 
 
+void Protocol::saveHash(const string &fileName) {
+    const string prefix(uci ? "info string " : "");
+    if (searcher->saveHash(fileName)) {
+        cout << prefix << "hash table saved to " << fileName << endl;
+    }
+    else {
+        cout << prefix << "error saving hash table to " << fileName << endl;
+    }
+}
+
+void Protocol::setNNEval(bool enable) {
+    if (enable != (options.search.nn_eval != 0)) {
+        options.search.nn_eval = enable;
+        // cached static evaluations are from the other evaluator
+        searcher->clearHashTables();
+    }
+}
+
+void Protocol::loadHash(const string &fileName) {
+    const string prefix(uci ? "info string " : "");
+    if (searcher->loadHash(fileName)) {
+        // table may have been resized to match the file
+        options.search.hash_table_size =
+            searcher->hashTable.getHashSize()*sizeof(HashEntry);
+        cout << prefix << "hash table loaded from " << fileName <<
+            " (" << searcher->hashTable.memoryDescription() << ", " <<
+            searcher->hashTable.pctFull()/10 << "% full)" << endl;
+    }
+    else {
+        cout << prefix << "error loading hash table from " << fileName <<
+            " (missing file or incompatible format)" << endl;
+    }
+}
+
 #ifdef SYZYGY_TBS
 bool Protocol::validTbPath(const string &path) {
    // Shredder at least sets path to "<empty>" for tb types that are disabled
@@ -1880,6 +1966,11 @@ bool Protocol::do_command(const string &cmd, Board &board) {
 #endif
         cout << "option name MultiPV type spin default 1 min 1 max " << Statistics::MAX_PV << endl;
         cout << "option name OwnBook type check default true" << endl;
+        cout << "option name Book file type string default " <<
+            options.book.book_file << endl;
+        cout << "option name Book format type combo default " <<
+            Options::bookFormatToString(options.book.format) <<
+            " var Arasan var Polyglot" << endl;
         cout << "option name Favor frequent book moves type spin default " <<
             options.book.frequency << " min 0 max 100" << endl;
         cout << "option name Favor best book moves type spin default " <<
@@ -1898,6 +1989,19 @@ bool Protocol::do_command(const string &cmd, Board &board) {
 #endif
         cout << "option name Move overhead type spin default " <<
             30 << " min 0 max 1000" << endl;
+        cout << "option name Large pages type check default " <<
+           (options.search.large_pages ? "true" : "false") << endl;
+        cout << "option name Clear Hash type button" << endl;
+        cout << "option name Hash file type string default " <<
+           options.search.hash_file << endl;
+        cout << "option name Save Hash type button" << endl;
+        cout << "option name Load Hash type button" << endl;
+        cout << "option name Use NN eval type check default " <<
+           (options.search.nn_eval ? "true" : "false") << endl;
+        cout << "option name NN file type string default " <<
+           options.search.nn_file << endl;
+        cout << "option name Param file type string default " <<
+           (options.search.param_file.length() ? options.search.param_file : "<empty>") << endl;
         cout << "uciok" << endl;
         return true;
     }
@@ -1919,6 +2023,12 @@ bool Protocol::do_command(const string &cmd, Board &board) {
                value = value.erase(0, value.find_first_not_of(' '));
                value = value.erase(value.find_last_not_of(' ') + 1);
             }
+            else {
+               // button: name only
+               name = cmd_args.substr(nam+4);
+               name = name.erase(0 , name.find_first_not_of(' ') );
+               name = name.erase( name.find_last_not_of(' ') + 1);
+            }
         }
         if (uciOptionCompare(name,"Hash")) {
             if (!memorySet) {
@@ -1971,9 +2081,49 @@ bool Protocol::do_command(const string &cmd, Board &board) {
            Options::setOption<int>(value,options.search.syzygy_probe_depth);
         }
 #endif
+        else if (uciOptionCompare(name,"Large pages")) {
+            int tmp = options.search.large_pages;
+            options.search.large_pages = (value == "true");
+            if (tmp != options.search.large_pages) {
+                searcher->resizeHash(options.search.hash_table_size);
+                cout << "info string hash table: " <<
+                    searcher->hashTable.memoryDescription() << endl;
+            }
+        }
+        else if (uciOptionCompare(name,"Clear Hash")) {
+            searcher->clearHashTables();
+        }
+        else if (uciOptionCompare(name,"Hash file")) {
+            options.search.hash_file = value;
+        }
+        else if (uciOptionCompare(name,"Save Hash")) {
+            saveHash(options.search.hash_file);
+        }
+        else if (uciOptionCompare(name,"Load Hash")) {
+            loadHash(options.search.hash_file);
+        }
+        else if (uciOptionCompare(name,"Use NN eval")) {
+            setNNEval(value == "true");
+        }
+        else if (uciOptionCompare(name,"NN file")) {
+            unloadNetwork();
+            options.search.nn_file = value;
+        }
+        else if (uciOptionCompare(name,"Param file")) {
+            setParamFile(value == "<empty>" ? "" : value);
+        }
         else if (uciOptionCompare(name,"OwnBook")) {
             options.book.book_enabled = (value == "true");
         }
+        else if (uciOptionCompare(name,"Book file")) {
+            openingBook.close();
+            options.book.book_file = value;
+        }
+        else if (uciOptionCompare(name,"Book format")) {
+            if (Options::stringToBookFormat(value,options.book.format)) {
+                openingBook.close();
+            }
+        }
         else if (uciOptionCompare(name,"Favor frequent book moves")) {
             Options::setOption<unsigned>(value,options.book.frequency);
         }
@@ -2047,6 +2197,9 @@ bool Protocol::do_command(const string &cmd, Board &board) {
         return true;
     }
     else if (uci && cmd == "isready") {
+        // Commands are executed in order, and hash clearing and
+        // resizing (ucinewgame, setoption) return only when all
+        // threads have finished, so the table is ready at this point.
         delayedInit();
         cout << "readyok" << endl;
 #ifdef UCI_LOG
@@ -2192,19 +2345,126 @@ bool Protocol::do_command(const string &cmd, Board &board) {
         else
             cout << "invalid command" << endl;
     }
+    else if (cmd_word == "bench") {
+       int depth = Bench::DEFAULT_DEPTH;
+       bool verbose = false;
+       int threads = 0, latencyIterations = 0;
+       bool polling = false, evalSpeed = false, bookSpeed = false,
+          seeSpeed = false;
+       string bookFile = derivePath("book.bin");
+       stringstream ss(cmd_args);
+       string arg;
+       while (ss >> arg) {
+          if (arg == "-v") {
+             verbose = true;
+          } else if (arg == "-t") {
+             if ((ss >> threads).fail() || threads <= 0) {
+                cerr << "usage: bench <depth> <-v> <-t threads> <-l [searches]> <-p> <-e> <-s> <-b [book file]>" << endl;
+                return true;
+             }
+          } else if (arg == "-p") {
+             polling = true;
+          } else if (arg == "-e") {
+             evalSpeed = true;
+          } else if (arg == "-s") {
+             seeSpeed = true;
+          } else if (arg == "-b") {
+             bookSpeed = true;
+             const auto pos = ss.tellg();
+             string file;
+             if (ss >> file && file[0] != '-') {
+                bookFile = file;
+             } else {
+                // no file given
+                ss.clear();
+                ss.seekg(pos);
+             }
+          } else if (arg == "-l") {
+             latencyIterations = Bench::DEFAULT_LATENCY_ITERATIONS;
+             const auto pos = ss.tellg();
+             if ((ss >> latencyIterations).fail() || latencyIterations <= 0) {
+                // no count given
+                ss.clear();
+                ss.seekg(pos);
+                latencyIterations = Bench::DEFAULT_LATENCY_ITERATIONS;
+             }
+          } else {
+             stringstream num(arg);
+             if ((num >> depth).fail() || depth <= 0) {
+                cerr << "usage: bench <depth> <-v> <-t threads> <-l [searches]> <-p> <-e> <-s> <-b [book file]>" << endl;
+                return true;
+             }
+          }
+       }
+       Bench b;
+       if (evalSpeed) {
+          b.evalSpeed(cout);
+       } else if (seeSpeed) {
+          b.seeSpeed(cout);
+       } else if (bookSpeed) {
+          b.bookSpeed(bookFile,cout);
+       } else if (latencyIterations) {
+          b.latency(searcher,latencyIterations,cout);
+       } else if (polling) {
+          b.polling(searcher,depth,cout);
+       } else if (threads) {
+          b.scaling(searcher,depth,unsigned(threads),cout);
+       } else {
+          Bench::Results results = b.bench(searcher,depth,verbose);
+          cout << results;
+       }
+    }
+    else if (cmd_word == "savehash") {
+       saveHash(cmd_args.length() ? cmd_args : options.search.hash_file);
+    }
+    else if (cmd_word == "loadhash") {
+       loadHash(cmd_args.length() ? cmd_args : options.search.hash_file);
+    }
     else if (cmd_word == "perft") {
-       if (cmd_args.length()) {
-          stringstream ss(cmd_args);
-          int depth;
-          if ((ss >> depth).fail()) {
-             cerr << "usage: perft <depth>" << endl;
+       int depth = 0;
+       bool legal = true, divide = false, ok = true;
+       unsigned threads = 1;
+       size_t hashMB = 0;
+       stringstream ss(cmd_args);
+       string arg;
+       while (ok && ss >> arg) {
+          if (arg == "-p") {
+             legal = false;
+          } else if (arg == "-d") {
+             divide = true;
+          } else if (arg == "-t") {
+             ok = !(ss >> threads).fail() && threads > 0;
+          } else if (arg == "-h") {
+             ok = !(ss >> hashMB).fail();
           } else {
-             Board b;
-             cout << "perft " << depth << " = " << perft(b,depth) << endl;
+             stringstream num(arg);
+             ok = !(num >> depth).fail();
           }
        }
-       else {
-          cerr << "usage: perft <depth>" << endl;
+       if (!ok || depth <= 0) {
+          cerr << "usage: perft <depth> <-p> <-t threads> <-h hash MB> <-d>" << endl;
+       } else {
+          Perft perft(threads,hashMB*1024*1024,legal);
+          vector<Perft::DivideEntry> counts;
+          const CLOCK_TYPE startTime = getCurrentTime();
+          const uint64_t nodes = perft.run(*main_board,depth,
+                                           divide ? &counts : nullptr);
+          const uint64_t elapsed = getElapsedTime(startTime,getCurrentTime());
+          for (const Perft::DivideEntry &entry : counts) {
+             Notation::image(*main_board,entry.move,Notation::OutputFormat::UCI,cout);
+             cout << ": " << entry.nodes << endl;
+          }
+          cout << "perft " << depth << " = " << nodes << endl;
+          cout << (legal ? "legal" : "pseudo-legal") << " move generation, " <<
+             threads << (threads == 1 ? " thread, " : " threads, ") <<
+             elapsed << " ms";
+          if (elapsed) {
+             cout << ", " << (uint64_t)(1000.0*nodes/elapsed) << " nodes/sec";
+          }
+          if (hashMB) {
+             cout << ", " << perft.hashHits() << " hash hits";
+          }
+          cout << endl;
        }
     }
     else if (cmd_word == "eval") {
@@ -2472,6 +2732,13 @@ bool Protocol::do_command(const string &cmd, Board &board) {
 #ifdef SYZYGY_TBS
         cout << " egt=\"syzygy\"";
 #endif
+        cout << " option=\"Book file -file " <<
+            options.book.book_file << "\"";
+        cout << " option=\"Book format -combo " <<
+            (options.book.format == Options::BookFormat::Arasan ?
+             "*Arasan /// Polyglot" : "Arasan /// *Polyglot") << "\"";
+        cout << " option=\"Book learning -check " <<
+            options.book.book_learning << "\"";
         cout << " option=\"Favor frequent book moves -spin " <<
             options.book.frequency << " 1 100\"";
         cout << " option=\"Favor best book moves -spin " <<
@@ -2484,6 +2751,15 @@ bool Protocol::do_command(const string &cmd, Board &board) {
             options.learning.position_learning << "\"";
         // strength option (new for 14.2)
         cout << " option=\"Strength -spin " << options.search.strength << " 0 100\"";
+        cout << " option=\"Large pages -check " <<
+            options.search.large_pages << "\"";
+        cout << " option=\"Clear Hash -button\"";
+        cout << " option=\"Use NN eval -check " <<
+            options.search.nn_eval << "\"";
+        cout << " option=\"NN file -file " <<
+            options.search.nn_file << "\"";
+        cout << " option=\"Param file -file " <<
+            options.search.param_file << "\"";
 #ifdef NUMA
         cout << " option=\"Set processor affinity -check " <<
             options.search.set_processor_affinity << "\"" << endl;
@@ -2572,6 +2848,7 @@ bool Protocol::do_command(const string &cmd, Board &board) {
         // Game has ended
         theLog->setResult(cmd_args.c_str());
         save_game();
+        learnBook(board);
         game_end = true;
         gameMoves->removeAll();
         // Note: xboard may not send "new" before starting a new
@@ -160,6 +160,14 @@ private:
     // make a move on the board, add to log and search history
     void execute_move(Board &board,Move m);
 
+    // Load scoring parameters from a file (built-in values if
+    // "fileName" is empty).
+    void setParamFile(const string &fileName);
+
+    // Call the global delayedInit, and recompute the piece-square sums
+    // in our boards if it loaded a parameter file.
+    void delayedInit();
+
 #ifdef _TUNE
     // Set a tuning parameter passed on the command line (used for
     // CLOP for example).
@@ -169,12 +177,18 @@ private:
     // Process options for Winboard
     void processWinboardOptions(const string &args);
 
-    // Execute a perft test and return node count
-    uint64_t perft(Board &board, int depth);
-
     // Set the board position from a file
     void loadgame(Board &board,ifstream &file);
 
+    // Save the hash table to, or load it from, a file and report
+    // the result
+    void saveHash(const string &fileName);
+
+    void loadHash(const string &fileName);
+
+    // Enable or disable the neural network evaluation
+    void setNNEval(bool enable);
+
 #ifdef SYZYGY_TBS
     // Validate a TB path sent from the UI (UCI)
     bool validTbPath(const string &path);
@@ -211,6 +225,8 @@ private:
     ColorType side;
     int moves;
     Board *ponder_board, *main_board;
+    // Board::pstVersion() when the boards' sums were last computed
+    unsigned pstVersion;
     bool ponder_move_ok;
     Move predicted_move;
     Move ponder_move, best_move;
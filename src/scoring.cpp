@@ -13,7 +13,10 @@
 #include <cstddef>
 #include <algorithm>
 #include <climits>
+#include <cmath>
 #include <iomanip>
+#include <sstream>
+#include <vector>
 
 //#define PAWN_DEBUG
 //#define EVAL_DEBUG
@@ -867,18 +870,28 @@ void Scoring::pieceScore(const Board &board,
    int simpleAttackWeight = 0;
    Square sq;
 
+#ifndef TUNE
+   // piece-square table values (including the king's midgame value)
+   // are maintained incrementally by the Board class
+   scores.mid += board.pstScore(side).mid;
+   scores.end += board.pstScore(side).end;
+#endif
    while(b.iterate(sq))
    {
 #ifdef EVAL_DEBUG
       Scores tmp = scores;
 #endif
+#ifdef TUNE
       Square scoreSq = (side == White) ? sq : 63 - sq;
+#endif
       switch(TypeOfPiece(board[sq]))
       {
       case Knight:
          {
+#ifdef TUNE
             scores.mid += PARAM(KNIGHT_PST)[Midgame][scoreSq];
             scores.end += PARAM(KNIGHT_PST)[Endgame][scoreSq];
+#endif
 
             const Bitboard &knattacks = Attacks::knight_attacks[sq];
             const score_t mobl = PARAM(KNIGHT_MOBILITY)[Bitboard(knattacks &~board.allOccupied &~ourPawnData.opponent_pawn_attacks).bitCount()];
@@ -917,8 +930,10 @@ void Scoring::pieceScore(const Board &board,
 
       case Bishop:
          {
+#ifdef TUNE
             scores.mid += PARAM(BISHOP_PST)[Midgame][scoreSq];
             scores.end += PARAM(BISHOP_PST)[Endgame][scoreSq];
+#endif
 
             const Bitboard battacks(board.bishopAttacks(sq));
             allAttacks |= battacks;
@@ -973,8 +988,10 @@ void Scoring::pieceScore(const Board &board,
 
       case Rook:
          {
+#ifdef TUNE
             scores.mid += PARAM(ROOK_PST)[Midgame][scoreSq];
             scores.end += PARAM(ROOK_PST)[Endgame][scoreSq];
+#endif
             const Bitboard rattacks(board.rookAttacks(sq));
             const int r = Rank(sq, side);
             if (r == 7 && (Rank(okp,side) == 8 || (board.pawn_bits[oside] & Attacks::rank7mask[side]))) {
@@ -1038,8 +1055,10 @@ void Scoring::pieceScore(const Board &board,
 
       case Queen:
          {
+#ifdef TUNE
             scores.mid += PARAM(QUEEN_PST)[Midgame][scoreSq];
             scores.end += PARAM(QUEEN_PST)[Endgame][scoreSq];
+#endif
             int qmobl = 0;
             Bitboard battacks(board.bishopAttacks(sq));
             allAttacks |= battacks;
@@ -1154,7 +1173,9 @@ void Scoring::pieceScore(const Board &board,
          scores.mid - tmp.mid << ", " << scores.end - tmp.end << ")" << endl;
 #endif
    }
+#ifdef TUNE
    scores.mid += PARAM(KING_PST)[Midgame][(side == White) ? kp : 63 - kp];
+#endif
 
    allAttacks |= oppPawnData.opponent_pawn_attacks;
    allAttacks |= Attacks::king_attacks[kp];
@@ -1768,6 +1789,12 @@ score_t Scoring::evalu8(const Board &board, bool useCache) {
        return score;
    }
 
+#ifndef TUNE
+   if (options.search.nn_eval && nnue::network.isLoaded()) {
+       return nnue::network.evaluate(board);
+   }
+#endif
+
    const score_t matScore = materialScore(board);
 
    const hash_t pawnHash = board.pawnHashCodeW ^ board.pawnHashCodeB;
@@ -2572,6 +2599,212 @@ void Scoring::clearHashTables() {
    }
 }
 
+// Parameters in the parameter file (see Params::readValues), in the
+// order they are written.
+struct ParamEntry {
+   const char *name;
+   score_t *values;
+   size_t size;
+};
+
+#define PARAM_ENTRY(x) {#x,reinterpret_cast<score_t*>(&Params::x),sizeof(Params::x)/sizeof(score_t)}
+
+static const ParamEntry paramEntries[] = {
+   PARAM_ENTRY(RB_ADJUST),
+   PARAM_ENTRY(RBN_ADJUST),
+   PARAM_ENTRY(QR_ADJUST),
+   PARAM_ENTRY(KN_VS_PAWN_ADJUST),
+   PARAM_ENTRY(CASTLING),
+   PARAM_ENTRY(KING_COVER),
+   PARAM_ENTRY(KING_COVER_BASE),
+   PARAM_ENTRY(KING_DISTANCE_BASIS),
+   PARAM_ENTRY(KING_DISTANCE_MULT),
+   PARAM_ENTRY(PIN_MULTIPLIER_MID),
+   PARAM_ENTRY(PIN_MULTIPLIER_END),
+   PARAM_ENTRY(KRMINOR_VS_R_NO_PAWNS),
+   PARAM_ENTRY(KQMINOR_VS_Q_NO_PAWNS),
+   PARAM_ENTRY(MINOR_FOR_PAWNS),
+   PARAM_ENTRY(ENDGAME_PAWN_ADVANTAGE),
+   PARAM_ENTRY(PAWN_ENDGAME1),
+   PARAM_ENTRY(PAWN_ATTACK_FACTOR),
+   PARAM_ENTRY(MINOR_ATTACK_FACTOR),
+   PARAM_ENTRY(MINOR_ATTACK_BOOST),
+   PARAM_ENTRY(ROOK_ATTACK_FACTOR),
+   PARAM_ENTRY(ROOK_ATTACK_BOOST),
+   PARAM_ENTRY(ROOK_ATTACK_BOOST2),
+   PARAM_ENTRY(QUEEN_ATTACK_FACTOR),
+   PARAM_ENTRY(QUEEN_ATTACK_BOOST),
+   PARAM_ENTRY(QUEEN_ATTACK_BOOST2),
+   PARAM_ENTRY(OWN_PIECE_KING_PROXIMITY_MIN),
+   PARAM_ENTRY(OWN_PIECE_KING_PROXIMITY_MAX),
+   PARAM_ENTRY(OWN_MINOR_KING_PROXIMITY),
+   PARAM_ENTRY(OWN_ROOK_KING_PROXIMITY),
+   PARAM_ENTRY(OWN_QUEEN_KING_PROXIMITY),
+   PARAM_ENTRY(KING_ATTACK_COVER_BOOST_BASE),
+   PARAM_ENTRY(KING_ATTACK_COVER_BOOST_SLOPE),
+   PARAM_ENTRY(PAWN_THREAT_ON_PIECE_MID),
+   PARAM_ENTRY(PAWN_THREAT_ON_PIECE_END),
+   PARAM_ENTRY(PIECE_THREAT_MM_MID),
+   PARAM_ENTRY(PIECE_THREAT_MR_MID),
+   PARAM_ENTRY(PIECE_THREAT_MQ_MID),
+   PARAM_ENTRY(PIECE_THREAT_MM_END),
+   PARAM_ENTRY(PIECE_THREAT_MR_END),
+   PARAM_ENTRY(PIECE_THREAT_MQ_END),
+   PARAM_ENTRY(MINOR_PAWN_THREAT_END),
+   PARAM_ENTRY(MINOR_PAWN_THREAT_MID),
+   PARAM_ENTRY(PIECE_THREAT_RM_MID),
+   PARAM_ENTRY(PIECE_THREAT_RR_MID),
+   PARAM_ENTRY(PIECE_THREAT_RQ_MID),
+   PARAM_ENTRY(PIECE_THREAT_RM_END),
+   PARAM_ENTRY(PIECE_THREAT_RR_END),
+   PARAM_ENTRY(PIECE_THREAT_RQ_END),
+   PARAM_ENTRY(ROOK_PAWN_THREAT_MID),
+   PARAM_ENTRY(ROOK_PAWN_THREAT_END),
+   PARAM_ENTRY(ENDGAME_KING_THREAT),
+   PARAM_ENTRY(BISHOP_TRAPPED),
+   PARAM_ENTRY(BISHOP_PAIR_MID),
+   PARAM_ENTRY(BISHOP_PAIR_END),
+   PARAM_ENTRY(BISHOP_PAWN_PLACEMENT_END),
+   PARAM_ENTRY(BAD_BISHOP_MID),
+   PARAM_ENTRY(BAD_BISHOP_END),
+   PARAM_ENTRY(CENTER_PAWN_BLOCK),
+   PARAM_ENTRY(OUTSIDE_PASSER_MID),
+   PARAM_ENTRY(OUTSIDE_PASSER_END),
+   PARAM_ENTRY(WEAK_PAWN_MID),
+   PARAM_ENTRY(WEAK_PAWN_END),
+   PARAM_ENTRY(WEAK_ON_OPEN_FILE_MID),
+   PARAM_ENTRY(WEAK_ON_OPEN_FILE_END),
+   PARAM_ENTRY(SPACE),
+   PARAM_ENTRY(PAWN_CENTER_SCORE_MID),
+   PARAM_ENTRY(ROOK_ON_7TH_MID),
+   PARAM_ENTRY(ROOK_ON_7TH_END),
+   PARAM_ENTRY(TWO_ROOKS_ON_7TH_MID),
+   PARAM_ENTRY(TWO_ROOKS_ON_7TH_END),
+   PARAM_ENTRY(ROOK_ON_OPEN_FILE_MID),
+   PARAM_ENTRY(ROOK_ON_OPEN_FILE_END),
+   PARAM_ENTRY(ROOK_BEHIND_PP_MID),
+   PARAM_ENTRY(ROOK_BEHIND_PP_END),
+   PARAM_ENTRY(QUEEN_OUT),
+   PARAM_ENTRY(PAWN_SIDE_BONUS),
+   PARAM_ENTRY(KING_OWN_PAWN_DISTANCE),
+   PARAM_ENTRY(KING_OPP_PAWN_DISTANCE),
+   PARAM_ENTRY(QUEENING_SQUARE_CONTROL_MID),
+   PARAM_ENTRY(QUEENING_SQUARE_CONTROL_END),
+   PARAM_ENTRY(QUEENING_SQUARE_OPP_CONTROL_MID),
+   PARAM_ENTRY(QUEENING_SQUARE_OPP_CONTROL_END),
+   PARAM_ENTRY(SIDE_PROTECTED_PAWN),
+   PARAM_ENTRY(KING_OPP_PASSER_DISTANCE),
+   PARAM_ENTRY(KING_POSITION_LOW_MATERIAL),
+   PARAM_ENTRY(KING_ATTACK_SCALE),
+   PARAM_ENTRY(PASSED_PAWN),
+   PARAM_ENTRY(PASSED_PAWN_FILE_ADJUST),
+   PARAM_ENTRY(POTENTIAL_PASSER),
+   PARAM_ENTRY(CONNECTED_PASSER),
+   PARAM_ENTRY(ADJACENT_PASSER),
+   PARAM_ENTRY(PP_OWN_PIECE_BLOCK),
+   PARAM_ENTRY(PP_OPP_PIECE_BLOCK),
+   PARAM_ENTRY(DOUBLED_PAWNS),
+   PARAM_ENTRY(TRIPLED_PAWNS),
+   PARAM_ENTRY(ISOLATED_PAWN),
+   PARAM_ENTRY(KNIGHT_PST),
+   PARAM_ENTRY(BISHOP_PST),
+   PARAM_ENTRY(ROOK_PST),
+   PARAM_ENTRY(QUEEN_PST),
+   PARAM_ENTRY(KING_PST),
+   PARAM_ENTRY(KNIGHT_MOBILITY),
+   PARAM_ENTRY(BISHOP_MOBILITY),
+   PARAM_ENTRY(ROOK_MOBILITY),
+   PARAM_ENTRY(QUEEN_MOBILITY),
+   PARAM_ENTRY(KING_MOBILITY_ENDGAME),
+   PARAM_ENTRY(KNIGHT_OUTPOST),
+   PARAM_ENTRY(BISHOP_OUTPOST),
+   PARAM_ENTRY(PAWN_STORM),
+};
+
+#undef PARAM_ENTRY
+
+// compiled-in values, saved before they are first changed by readValues
+static vector<score_t> defaultParams;
+
+void Params::writeValues(ostream &o)
+{
+   for (const ParamEntry &entry : paramEntries) {
+      o << entry.name;
+      for (size_t i = 0; i < entry.size; i++) {
+         // values are integers except in tuning builds
+         o << ' ' << long(std::round(entry.values[i]));
+      }
+      o << endl;
+   }
+}
+
+bool Params::readValues(istream &in, string &err)
+{
+   // parse the whole file before changing anything
+   vector<pair<const ParamEntry *,vector<score_t>>> values;
+   string line;
+   int lineNum = 0;
+   while (getline(in,line)) {
+      ++lineNum;
+      stringstream s(line);
+      string name;
+      if (!(s >> name) || name[0] == '#') {
+         // blank line or comment
+         continue;
+      }
+      const ParamEntry *entry = nullptr;
+      for (const ParamEntry &e : paramEntries) {
+         if (name == e.name) {
+            entry = &e;
+            break;
+         }
+      }
+      stringstream msg;
+      if (!entry) {
+         msg << "line " << lineNum << ": unknown parameter " << name;
+         err = msg.str();
+         return false;
+      }
+      vector<score_t> vals;
+      score_t val;
+      while (s >> val) {
+         vals.push_back(val);
+      }
+      if (!s.eof() || vals.size() != entry->size) {
+         msg << "line " << lineNum << ": expected " << entry->size <<
+            " value(s) for " << name;
+         err = msg.str();
+         return false;
+      }
+      values.push_back(std::make_pair(entry,vals));
+   }
+   if (defaultParams.empty()) {
+      for (const ParamEntry &entry : paramEntries) {
+         defaultParams.insert(defaultParams.end(),entry.values,entry.values+entry.size);
+      }
+   }
+   for (const auto &v : values) {
+      std::copy(v.second.begin(),v.second.end(),v.first->values);
+   }
+#ifndef TUNE
+   Board::initPstTable();
+#endif
+   return true;
+}
+
+void Params::restoreDefaults()
+{
+   if (defaultParams.empty()) return;
+   auto it = defaultParams.begin();
+   for (const ParamEntry &entry : paramEntries) {
+      std::copy(it,it+entry.size,entry.values);
+      it += entry.size;
+   }
+#ifndef TUNE
+   Board::initPstTable();
+#endif
+}
+
 #ifdef TUNE
 #include "tune.h"
 
@@ -2610,17 +2843,17 @@ void Params::write(ostream &o, const string &comment)
    o << "//" << endl;
    o << endl << "#include \"params.h\"" << endl;
    o << endl;
-   o << "const int Params::RB_ADJUST[6] = ";
+   o << "int Params::RB_ADJUST[6] = ";
    print_array(o,Params::RB_ADJUST,6);
-   o << "const int Params::RBN_ADJUST[6] = ";
+   o << "int Params::RBN_ADJUST[6] = ";
    print_array(o,Params::RBN_ADJUST,6);
-   o << "const int Params::QR_ADJUST[5] = ";
+   o << "int Params::QR_ADJUST[5] = ";
    print_array(o,Params::QR_ADJUST,5);
-   o << "const int Params::KN_VS_PAWN_ADJUST[3] = ";
+   o << "int Params::KN_VS_PAWN_ADJUST[3] = ";
    print_array(o,Params::KN_VS_PAWN_ADJUST,3);
-   o << "const int Params::CASTLING[6] = ";
+   o << "int Params::CASTLING[6] = ";
    print_array(o,Params::CASTLING,6);
-   o << "const int Params::KING_COVER[6][4] = {";
+   o << "int Params::KING_COVER[6][4] = {";
    for (int i = 0; i < 6; i++) {
       print_array(o,Params::KING_COVER[i],4,0);
       if (i<5) o << "," << endl;
@@ -2628,69 +2861,69 @@ void Params::write(ostream &o, const string &comment)
    o << "};" << endl;
    int start = Tune::KING_COVER_BASE;
    for (int i = start; i < start+tune_params.paramArraySize(); i++) {
-      o << "const int Params::";
+      o << "int Params::";
       for (auto it : tune_params[i].name) {
          o << (char)toupper((int)it);
       }
       o << " = " << std::round(tune_params[i].current) << ";" << endl;
    }
-   o << "const int Params::KING_OPP_PASSER_DISTANCE[6] = ";
+   o << "int Params::KING_OPP_PASSER_DISTANCE[6] = ";
    print_array(o,Params::KING_OPP_PASSER_DISTANCE,6);
-   o << "const int Params::KING_POSITION_LOW_MATERIAL[3] =";
+   o << "int Params::KING_POSITION_LOW_MATERIAL[3] =";
    print_array(o,Params::KING_POSITION_LOW_MATERIAL,3);
-   o << "const int Params::KING_ATTACK_SCALE[Params::KING_ATTACK_SCALE_SIZE] = ";
+   o << "int Params::KING_ATTACK_SCALE[Params::KING_ATTACK_SCALE_SIZE] = ";
    print_array(o,Params::KING_ATTACK_SCALE,Params::KING_ATTACK_SCALE_SIZE);
-   o << "const int Params::PASSED_PAWN[2][8] = ";
+   o << "int Params::PASSED_PAWN[2][8] = ";
    print_array(o,Params::PASSED_PAWN[0], Params::PASSED_PAWN[1], 8);
    score_t file_adjust[8];
    for (int i = 0; i < 8; i++) {
       int j = i < 4 ? i : 7-i;
       file_adjust[i] = tune_params[Tune::PASSED_PAWN_FILE_ADJUST1+j].current;
    }
-   o << "const int Params::PASSED_PAWN_FILE_ADJUST[8] = ";
+   o << "int Params::PASSED_PAWN_FILE_ADJUST[8] = ";
    print_array(o,file_adjust,8);
-   o << "const int Params::POTENTIAL_PASSER[2][8] = ";
+   o << "int Params::POTENTIAL_PASSER[2][8] = ";
    print_array(o,Params::POTENTIAL_PASSER[0], Params::POTENTIAL_PASSER[1], 8);
-   o << "const int Params::CONNECTED_PASSER[2][8] = ";
+   o << "int Params::CONNECTED_PASSER[2][8] = ";
    print_array(o,Params::CONNECTED_PASSER[0], Params::CONNECTED_PASSER[1], 8);
-   o << "const int Params::ADJACENT_PASSER[2][8] = ";
+   o << "int Params::ADJACENT_PASSER[2][8] = ";
    print_array(o,Params::ADJACENT_PASSER[0], Params::ADJACENT_PASSER[1], 8);
-   o << "const int Params::PP_OWN_PIECE_BLOCK[2][21] = ";
+   o << "int Params::PP_OWN_PIECE_BLOCK[2][21] = ";
    print_array(o,Params::PP_OWN_PIECE_BLOCK[0], Params::PP_OWN_PIECE_BLOCK[1], 21);
-   o << "const int Params::PP_OPP_PIECE_BLOCK[2][21] = ";
+   o << "int Params::PP_OPP_PIECE_BLOCK[2][21] = ";
    print_array(o,Params::PP_OPP_PIECE_BLOCK[0], Params::PP_OPP_PIECE_BLOCK[1], 21);
-   o << "const int Params::DOUBLED_PAWNS[2][8] = ";
+   o << "int Params::DOUBLED_PAWNS[2][8] = ";
    print_array(o,Params::DOUBLED_PAWNS[0], Params::DOUBLED_PAWNS[1], 8);
-   o << "const int Params::TRIPLED_PAWNS[2][8] = ";
+   o << "int Params::TRIPLED_PAWNS[2][8] = ";
    print_array(o,Params::TRIPLED_PAWNS[0], Params::TRIPLED_PAWNS[1], 8);
-   o << "const int Params::ISOLATED_PAWN[2][8] = ";
+   o << "int Params::ISOLATED_PAWN[2][8] = ";
    print_array(o,Params:: ISOLATED_PAWN[0], Params::ISOLATED_PAWN[1], 8);
    o << endl;
-   o << "const int Params::KNIGHT_PST[2][64] = ";
+   o << "int Params::KNIGHT_PST[2][64] = ";
    print_array(o,Params::KNIGHT_PST[0],Params::KNIGHT_PST[1],64);
-   o << "const int Params::BISHOP_PST[2][64] = ";
+   o << "int Params::BISHOP_PST[2][64] = ";
    print_array(o,Params::BISHOP_PST[0],Params::BISHOP_PST[1],64);
-   o << "const int Params::ROOK_PST[2][64] = ";
+   o << "int Params::ROOK_PST[2][64] = ";
    print_array(o,Params::ROOK_PST[0],Params::ROOK_PST[1],64);
-   o << "const int Params::QUEEN_PST[2][64] = ";
+   o << "int Params::QUEEN_PST[2][64] = ";
    print_array(o,Params::QUEEN_PST[0],Params::QUEEN_PST[1],64);
-   o << "const int Params::KING_PST[2][64] = ";
+   o << "int Params::KING_PST[2][64] = ";
    print_array(o,Params::KING_PST[0],Params::KING_PST[1],64);
-   o << "const int Params::KNIGHT_MOBILITY[9] = ";
+   o << "int Params::KNIGHT_MOBILITY[9] = ";
    print_array(o,Params::KNIGHT_MOBILITY,9);
-   o << "const int Params::BISHOP_MOBILITY[15] = ";
+   o << "int Params::BISHOP_MOBILITY[15] = ";
    print_array(o,Params::BISHOP_MOBILITY,15);
-   o << "const int Params::ROOK_MOBILITY[2][15] = ";
+   o << "int Params::ROOK_MOBILITY[2][15] = ";
    print_array(o,Params::ROOK_MOBILITY[0],Params::ROOK_MOBILITY[1],15);
-   o << "const int Params::QUEEN_MOBILITY[2][24] = ";
+   o << "int Params::QUEEN_MOBILITY[2][24] = ";
    print_array(o,Params::QUEEN_MOBILITY[0],Params::QUEEN_MOBILITY[1],24);
-   o << "const int Params::KING_MOBILITY_ENDGAME[5] = ";
+   o << "int Params::KING_MOBILITY_ENDGAME[5] = ";
    print_array(o,Params::KING_MOBILITY_ENDGAME,5);
-   o << "const int Params::KNIGHT_OUTPOST[2][2] = ";
+   o << "int Params::KNIGHT_OUTPOST[2][2] = ";
    print_array(o,Params::KNIGHT_OUTPOST[0],Params::KNIGHT_OUTPOST[1],2);
-   o << "const int Params::BISHOP_OUTPOST[2][2] = ";
+   o << "int Params::BISHOP_OUTPOST[2][2] = ";
    print_array(o,Params::BISHOP_OUTPOST[0],Params::BISHOP_OUTPOST[1],2);
-   o << "const int Params::PAWN_STORM[4][2] = {";
+   o << "int Params::PAWN_STORM[4][2] = {";
    for (int z = 0; z < 4; z++) {
        print_array(o,Params::PAWN_STORM[z],2,0);
        if (z < 3) o << ',';
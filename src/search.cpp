@@ -94,6 +94,10 @@ static const score_t QSEARCH_FORWARD_PRUNE_MARGIN = static_cast<score_t>(1.25*Pa
 // thread contention for global memory):
 static const int NODE_ACCUM_THRESHOLD = 16;
 
+// Base weight of a thread's vote for its best move, added to its
+// score margin (see getBestThreadStats).
+static const score_t VOTE_SCORE_BASE = score_t(0.125*Params::PAWN_VALUE);
+
 #ifdef SMP_STATS
 static const int SAMPLE_INTERVAL = 10000/NODE_ACCUM_THRESHOLD;
 #endif
@@ -196,7 +200,7 @@ SearchController::SearchController()
       }}
 
  */
-    hashTable.initHash((size_t)(options.search.hash_table_size));
+    hashTable.initHash((size_t)(options.search.hash_table_size),pool);
 }
 
 SearchController::~SearchController() {
@@ -252,7 +256,9 @@ Move SearchController::findBestMove(
     xtra_time = search_xtra_time;
     searchHistoryBoostFactor = 0.0;
     searchHistoryReductionFactor = 1.0;
-    search_counts.fill(0);
+    for (auto &count : search_counts) {
+        count.store(0,std::memory_order_relaxed);
+    }
     search_counts[0] = options.search.ncpus;
     if (srcType == FixedTime || srcType == TimeLimit) {
         ply_limit = Constants::MaxPly-1;
@@ -457,6 +463,7 @@ Move SearchController::findBestMove(
    stats->value = stats->display_value = value;
 
    // Start all searches
+   pool->clearCounters();
    pool->unblockAll();
 
    // Start searching in the main thread
@@ -613,7 +620,7 @@ void SearchController::clearHashTables()
 {
     age = 0;
     pool->forEachSearch<&Search::clearHashTables>();
-    hashTable.clearHash();
+    hashTable.clearHash(pool);
 }
 
 void SearchController::stopAllThreads() {
@@ -655,7 +662,22 @@ void SearchController::uciSendInfos(const Board &board, Move move, int move_inde
 }
 
 void SearchController::resizeHash(size_t newSize) {
-   hashTable.resizeHash(newSize);
+   hashTable.resizeHash(newSize,pool);
+}
+
+bool SearchController::saveHash(const string &fileName) const {
+   return hashTable.saveHash(fileName,age);
+}
+
+bool SearchController::loadHash(const string &fileName) {
+   unsigned savedAge;
+   if (!hashTable.loadHash(fileName,savedAge,pool)) {
+      return false;
+   }
+   // continue from the saved age so the loaded entries are
+   // treated as current by the replacement strategy
+   age = savedAge;
+   return true;
 }
 
 void SearchController::outOfBoundsTimeAdjust() {
@@ -752,6 +774,7 @@ Search::Search(SearchController *c, ThreadInfo *threadInfo)
     iterationDepth(0),
     terminate(0),
     nodeAccumulator(0),
+    counters(threadInfo->counters),
     node(nullptr),
     ti(threadInfo),
     computerSide(White),
@@ -1139,7 +1162,7 @@ Move Search::ply0_search()
                break;
             }
             if (controller->elapsed_time > 200) {
-               Time_Check_Interval = int((20L*stats.num_nodes)/(controller->elapsed_time*NODE_ACCUM_THRESHOLD));
+               Time_Check_Interval = int((20L*counters->nodes.load(std::memory_order_relaxed))/(controller->elapsed_time*NODE_ACCUM_THRESHOLD));
                if ((int)controller->time_limit - (int)controller->elapsed_time < 100) {
                   Time_Check_Interval /= 2;
                }
@@ -1283,6 +1306,7 @@ Move Search::ply0_search()
             if (srcOpts.multipv > 1) {
                // Accumulate multiple pvs until we are ready to output
                // them.
+               updateCounts();
                stats.multi_pvs[stats.multipv_count] = Statistics::MultiPVEntry(stats);
             }
 #ifdef _TRACE
@@ -1460,6 +1484,7 @@ score_t Search::ply0_search(RootMoveGenerator &mg, score_t alpha, score_t beta,
            continue;
         }
         board.doMove(move);
+        controller->hashTable.prefetch(board.hashCode(0));
         setCheckStatus(board,in_check_after_move);
         score_t lobound = wide ? node->alpha : node->best_score;
 #ifdef _TRACE
@@ -1606,7 +1631,7 @@ score_t Search::ply0_search(RootMoveGenerator &mg, score_t alpha, score_t beta,
     }
 #endif
     ASSERT(node->best_score >= -Constants::MATE && node->best_score <= Constants::MATE);
-    stats.num_nodes += nodeAccumulator;
+    counters->addNodes(nodeAccumulator);
     nodeAccumulator = 0;
     return node->best_score;
 }
@@ -1634,8 +1659,8 @@ void SearchController::updateGlobalStats(const Statistics &mainStats) {
     for (unsigned i = 0; i < pool->nThreads; i++) {
        const Statistics &s = pool->data[i]->work->stats;
        stats->tb_probes += s.tb_probes;
-       stats->tb_hits += s.tb_hits;
-       stats->num_nodes += s.num_nodes;
+       stats->tb_hits += pool->counters[i].tb_hits.load(std::memory_order_relaxed);
+       stats->num_nodes += pool->counters[i].nodes.load(std::memory_order_relaxed);
 #ifdef SEARCH_STATS
        stats->num_qnodes += s.num_qnodes;
        stats->reg_nodes += s.reg_nodes;
@@ -1664,10 +1689,21 @@ void SearchController::updateGlobalStats(const Statistics &mainStats) {
 
 Statistics *SearchController::getBestThreadStats(bool trace) const
 {
-    Statistics * best = stats;
-    for (int thread = 1; thread < options.search.ncpus; thread++) {
-        Statistics &threadStats = pool->data[thread]->work->stats;
-        if (trace) {
+    // Select the best thread by voting. Each thread votes for its
+    // best move, with a weight that increases with its completed
+    // depth and with the amount by which its score exceeds the
+    // lowest thread score. The thread whose move has the most votes
+    // is selected (deepest first, then highest score, if more than
+    // one thread has that move). A mate score found by any thread
+    // takes precedence. Thread 0 is represented by the controller
+    // statistics.
+    const unsigned nThreads = unsigned(options.search.ncpus);
+    std::array<Statistics *,Constants::MaxCPUs> candidates;
+    unsigned count = 0;
+    score_t minScore = Constants::MATE;
+    for (unsigned thread = 0; thread < nThreads; thread++) {
+        Statistics &threadStats = thread == 0 ? *stats : pool->data[thread]->work->stats;
+        if (trace && thread > 0) {
             cout << "# thread " << thread << " depth=" <<
                 threadStats.completedDepth << " score=";
             Scoring::printScore(threadStats.display_value,cout);
@@ -1676,44 +1712,68 @@ Statistics *SearchController::getBestThreadStats(bool trace) const
             cout << " pv=" << threadStats.best_line_image << endl;
         }
         if (!IsNull(threadStats.best_line[0])) {
-            if (IsNull(best->best_line[0]) ||
-                (threadStats.display_value > best->display_value &&
-                (threadStats.completedDepth >= best->completedDepth ||
-                 threadStats.value >= Constants::MATE_RANGE))) {
-                best = &threadStats;
+            candidates[count++] = &threadStats;
+            minScore = std::min<score_t>(minScore,threadStats.display_value);
+        }
+    }
+    if (count <= 1) {
+        return count ? candidates[0] : stats;
+    }
+    Statistics *best = nullptr;
+    for (unsigned i = 0; i < count; i++) {
+        Statistics *s = candidates[i];
+        if (s->value >= Constants::MATE_RANGE &&
+            (best == nullptr || s->value > best->value)) {
+            best = s;
+        }
+    }
+    if (best) return best;
+    std::array<double,Constants::MaxCPUs> votes;
+    for (unsigned i = 0; i < count; i++) {
+        votes[i] = 0.0;
+        const Move m = candidates[i]->best_line[0];
+        for (unsigned j = 0; j < count; j++) {
+            const Statistics *s = candidates[j];
+            if (MovesEqual(s->best_line[0],m)) {
+                votes[i] += (double(s->display_value - minScore) + VOTE_SCORE_BASE)*
+                    (1 + s->completedDepth);
             }
-
         }
     }
-    return best;
+    unsigned bestIndex = 0;
+    for (unsigned i = 1; i < count; i++) {
+        const Statistics *s = candidates[i], *b = candidates[bestIndex];
+        if (votes[i] > votes[bestIndex] ||
+            (votes[i] == votes[bestIndex] &&
+             (s->completedDepth > b->completedDepth ||
+              (s->completedDepth == b->completedDepth &&
+               s->display_value > b->display_value)))) {
+            bestIndex = i;
+        }
+    }
+    return candidates[bestIndex];
 }
 
 unsigned SearchController::nextSearchDepth(unsigned current_depth, unsigned thread_id,
     unsigned max_depth)
 {
+    // The main thread always searches the next depth. Other threads
+    // skip a depth if half the threads are already searching it.
+    // A depth is claimed with an atomic increment, so no lock is
+    // needed: if the count before the increment shows the depth is
+    // already full, the claim is released and the next depth tried.
+    const unsigned threshold = std::max<unsigned>(1,unsigned(options.search.ncpus)/2);
     unsigned d = current_depth+1;
-    const unsigned ncpus = unsigned(options.search.ncpus);
-    std::unique_lock<std::mutex> lock(search_count_mtx);
-    if (thread_id > 0) {
-        if (current_depth == 0) {
-            if (d < max_depth) d += ((thread_id+1) % 2 == 0);
-            if (d < max_depth) d += ((thread_id+1) % 4 == 0);
-        } else {
-            unsigned inc = 1;
-            while (inc < 8 && d < max_depth) {
-                unsigned threshold = ncpus/(1<<inc);
-                if (threshold == 0 || search_counts[d] < threshold) {
-                    break;
-                } else {
-                    ++d;
-                    ++inc;
-                }
-            }
+    while (d < Constants::MaxPly) {
+        const unsigned count = search_counts[d]++;
+        if (thread_id == 0 || d >= max_depth || count < threshold) {
+            break;
         }
+        search_counts[d]--;
+        ++d;
     }
-    if (d<Constants::MaxPly) {
+    if (current_depth < Constants::MaxPly) {
         search_counts[current_depth]--;
-        search_counts[d]++;
     }
     return d;
 }
@@ -1724,7 +1784,7 @@ score_t Search::quiesce(int ply,int depth)
    //
    ASSERT(ply < Constants::MaxPly);
    if (++nodeAccumulator > NODE_ACCUM_THRESHOLD) {
-      stats.num_nodes += nodeAccumulator;
+      counters->addNodes(nodeAccumulator);
       nodeAccumulator = 0;
 #ifdef SMP_STATS
       --controller->sample_counter;
@@ -2149,6 +2209,7 @@ score_t Search::quiesce(int ply,int depth)
             }
             node->last_move = move;
             board.doMove(move);
+            controller->hashTable.prefetch(board.hashCode(0));
             try_score = -quiesce(-node->beta, -node->best_score, ply+1, depth-1);
             board.undoMove(move,state);
             if (try_score != Illegal) {
@@ -2227,6 +2288,7 @@ score_t Search::quiesce(int ply,int depth)
                }
                node->last_move = move;
                board.doMove(move);
+               controller->hashTable.prefetch(board.hashCode(0));
                // verify opposite side in check:
                ASSERT(board.anyAttacks(board.kingSquare(board.sideToMove()),board.oppositeSide()));
                // and verify quick check confirms it
@@ -2528,7 +2590,7 @@ score_t Search::search()
     int depth = node->depth;
     ASSERT(ply < Constants::MaxPly);
     if (++nodeAccumulator > NODE_ACCUM_THRESHOLD) {
-        stats.num_nodes += nodeAccumulator;
+        counters->addNodes(nodeAccumulator);
         nodeAccumulator = 0;
 #if defined(SMP_STATS)
         // sample thread usage
@@ -2700,7 +2762,7 @@ score_t Search::search()
        score_t tb_score;
        int tb_hit = SyzygyTb::probe_wdl(board, tb_score, srcOpts.syzygy_50_move_rule != 0);
        if (tb_hit) {
-            stats.tb_hits++;
+            counters->addTbHit();
 #ifdef _TRACE
             if (mainThread()) {
                 indent(ply); cout << "EGTB hit: score " << tb_score << endl;
@@ -3155,6 +3217,9 @@ score_t Search::search()
         }
 #endif
         MoveGenerator mg(board, &context, node, ply, hashMove, mainThread());
+        // generate only legal moves, so illegal ones are not made
+        // and unmade
+        if (!in_check) mg.setLegal();
         BoardState state(board.state);
         score_t try_score;
         //
@@ -3218,16 +3283,10 @@ score_t Search::search()
               continue;
             }
             board.doMove(move);
-            if (!in_check && !board.wasLegal(move)) {
-                  ASSERT(board.anyAttacks(board.kingSquare(board.oppositeSide()),board.sideToMove()));
-#ifdef _TRACE
-               if (mainThread()) {
-                  indent(ply); cout << "Illegal move!" << endl;
-               }
-#endif
-               board.undoMove(move,state);
-               continue;
-            }
+            // Start fetching the child's hash bucket. Assumes no
+            // repetition, which is the usual case.
+            controller->hashTable.prefetch(board.hashCode(0));
+            ASSERT(board.wasLegal(move));
             setCheckStatus(board, in_check_after_move);
             if (depth+extend-DEPTH_INCREMENT > 0) {
                 try_score = -search(-hibound, -node->best_score,
@@ -3564,10 +3623,13 @@ void Search::updatePV(const Board &board, NodeInfo *node, NodeInfo *fromNode, Mo
 // search will execute.
 void Search::init(NodeInfo (&ns)[Constants::MaxPly], ThreadInfo *slave_ti) {
     this->board = controller->initialBoard;
+    board.setAccumulatorStack(options.search.nn_eval && nnue::network.isLoaded() ?
+                              &nnueStack : nullptr);
     node = ns;
     ASSERT(node);
     nodeAccumulator = 0;
     ti = slave_ti;
+    counters = ti->counters;
     node->ply = 0;
     // depth will be set later
 #ifdef SINGULAR_EXTENSION
@@ -227,6 +227,12 @@ protected:
 
     void suboptimal(RootMoveGenerator &mg, Move &m, score_t &val);
 
+    // Copy this thread's node and tb hit counts into its statistics
+    void updateCounts() {
+        stats.num_nodes = counters->nodes.load(std::memory_order_relaxed);
+        stats.tb_hits = counters->tb_hits.load(std::memory_order_relaxed);
+    }
+
 
     SearchController *controller;
     Board board;
@@ -235,8 +241,10 @@ protected:
     SearchContext context;
     int terminate;
     int nodeAccumulator;
+    ThreadCounters *counters; // node and tb hit counts for this thread
     NodeInfo *node; // pointer into NodeStack array (external to class)
     Scoring scoring;
+    nnue::AccumulatorStack nnueStack; // used if network eval is enabled
     ThreadInfo *ti; // thread now running this search
     // The following variables are maintained as local copies of
     // state from the controller. Placing them in each thread instance
@@ -338,6 +346,12 @@ public:
 
     void resizeHash(size_t newSize);
 
+    // Save the main hash table to a file, or load it from a file
+    // written by saveHash. Return false on failure.
+    bool saveHash(const string &fileName) const;
+
+    bool loadHash(const string &fileName);
+
     void stopAllThreads();
 
     void clearStopFlags();
@@ -449,6 +463,12 @@ public:
        return pool->isCompleted(0);
    }
 
+   // Maximum time in microseconds from the start of the last search
+   // until a helper thread began searching.
+   uint64_t startLatency() const {
+       return pool->startLatency();
+   }
+
    const Statistics &getGlobalStats() const noexcept {
        return *stats;
    }
@@ -542,8 +562,8 @@ private:
     std::mt19937_64 random_engine;
 
     uint64_t elapsed_time; // in milliseconds
-    std::array <unsigned, Constants::MaxPly> search_counts;
-    std::mutex search_count_mtx;
+    // number of threads searching each depth
+    std::array <atomic<unsigned>, Constants::MaxPly> search_counts;
 
 #ifdef SMP_STATS
     uint64_t samples, threads;
@@ -2,6 +2,7 @@
 // All Rights Reserved.
 
 #include "see.h"
+#include "attacks.h"
 #include "params.h"
 #include "constant.h"
 #include "debug.h"
@@ -58,13 +59,12 @@ static Square minAttacker(const Board &board, Bitboard atcks, ColorType side) {
    }    
 }
 
-score_t see( const Board &board, Move move ) {
-   ASSERT(!IsNull(move));
-#ifdef ATTACK_TRACE
-   cout << "see ";
-   MoveImage(move,cout);
-   cout << endl;
-#endif
+// Exchange evaluation for "move", given the pieces of the side making
+// it ("my_attacks") and of the opponent ("opp_attacks", not empty)
+// that attack its destination square.
+static score_t seeAttacks(const Board &board, Move move,
+                          const Bitboard &my_attacks,
+                          const Bitboard &opp_attacks) {
    ColorType my_side = PieceColor(board[StartSquare(move)]);
    ColorType side = my_side;
    ColorType oside = OppositeColor(side);
@@ -72,20 +72,12 @@ score_t see( const Board &board, Move move ) {
    Square attack_square = StartSquare(move);
    Piece on_square = (TypeOfMove(move) == EnPassant) ? 
        MakePiece(Pawn,oside) : board[square];
-   Bitboard opp_attacks(board.calcAttacks(square,oside));
-   if (opp_attacks.isClear()) {
-       // piece is undefended
-#ifdef ATTACK_TRACE
-       cout << "undefended, returning " << Params::Gain(move) << endl;
-#endif
-       return Params::Gain(move);
-   }
    array<score_t,20> score_list;
    score_t swap_score = 0;
    score_t gain;
    Bitboard attacks[2]; 
    Square last_attack_sq[2] = {InvalidSquare, InvalidSquare};
-   attacks[side] = board.calcAttacks(square,side);
+   attacks[side] = my_attacks;
    attacks[oside] = opp_attacks;
    int count = 0;
 
@@ -161,21 +153,33 @@ score_t see( const Board &board, Move move ) {
    return score_list[0];
 }
 
-score_t seeSign( const Board &board, Move move, score_t threshold ) {
+score_t see( const Board &board, Move move ) {
    ASSERT(!IsNull(move));
 #ifdef ATTACK_TRACE
    cout << "see ";
    MoveImage(move,cout);
    cout << endl;
 #endif
-   if (Params::Gain(move) < threshold) {
-       // Even capturing the target piece "for free" would
-       // not get us up to the threshold
+   const ColorType side = PieceColor(board[StartSquare(move)]);
+   const Square square = DestSquare(move);
+   const Bitboard opp_attacks(board.calcAttacks(square,OppositeColor(side)));
+   if (opp_attacks.isClear()) {
+       // piece is undefended
 #ifdef ATTACK_TRACE
-       cout << "threshold test failed, return 0" << endl;
+       cout << "undefended, returning " << Params::Gain(move) << endl;
 #endif
-       return 0;
+       return Params::Gain(move);
    }
+   return seeAttacks(board,move,board.calcAttacks(square,side),opp_attacks);
+}
+
+// Threshold test for "move", given the attackers of its destination
+// square as for seeAttacks. The caller has checked that the gain from
+// the capture reaches the threshold.
+static score_t seeSignAttacks(const Board &board, Move move,
+                              score_t threshold,
+                              const Bitboard &my_attacks,
+                              const Bitboard &opp_attacks) {
    ColorType my_side = PieceColor(board[StartSquare(move)]);
    ColorType side = my_side;
    ColorType oside = OppositeColor(side);
@@ -183,20 +187,12 @@ score_t seeSign( const Board &board, Move move, score_t threshold ) {
    Square attack_square = StartSquare(move);
    Piece on_square = (TypeOfMove(move) == EnPassant) ? 
        MakePiece(Pawn,oside) : board[square];
-   Bitboard opp_attacks(board.calcAttacks(square,oside));
-   if (opp_attacks.isClear()) {
-       // piece is undefended
-#ifdef ATTACK_TRACE
-       cout << "undefended, returning 1"<< endl;
-#endif
-       return 1;
-   }
    score_t score_list[20];
    score_t swap_score = 0;
    score_t gain;
    Bitboard attacks[2]; 
    Square last_attack_sq[2] = {InvalidSquare, InvalidSquare};
-   attacks[side] = board.calcAttacks(square,side);
+   attacks[side] = my_attacks;
    attacks[oside] = opp_attacks;
    int count = 0;
 
@@ -304,3 +300,119 @@ score_t seeSign( const Board &board, Move move, score_t threshold ) {
    return score_list[0] >= threshold;
 }
 
+score_t seeSign( const Board &board, Move move, score_t threshold ) {
+   ASSERT(!IsNull(move));
+#ifdef ATTACK_TRACE
+   cout << "see ";
+   MoveImage(move,cout);
+   cout << endl;
+#endif
+   if (Params::Gain(move) < threshold) {
+       // Even capturing the target piece "for free" would
+       // not get us up to the threshold
+#ifdef ATTACK_TRACE
+       cout << "threshold test failed, return 0" << endl;
+#endif
+       return 0;
+   }
+   const ColorType side = PieceColor(board[StartSquare(move)]);
+   const Square square = DestSquare(move);
+   const Bitboard opp_attacks(board.calcAttacks(square,OppositeColor(side)));
+   if (opp_attacks.isClear()) {
+       // piece is undefended
+#ifdef ATTACK_TRACE
+       cout << "undefended, returning 1"<< endl;
+#endif
+       return 1;
+   }
+   return seeSignAttacks(board,move,threshold,
+                         board.calcAttacks(square,side),opp_attacks);
+}
+
+// Attackers of the target squares of a batch of moves, computed on
+// first use. The sliding piece attacks from a square are looked up
+// once for both sides. Captures usually target only a few distinct
+// squares.
+class SeeAttackCache {
+public:
+   explicit SeeAttackCache(const Board &b)
+      : board(b), count(0) {
+   }
+
+   // Sets the attackers of the destination of "move" by the side
+   // making it and by the opponent.
+   void get(Move move, Bitboard &mine, Bitboard &opp) {
+      const Square square = DestSquare(move);
+      const ColorType side = PieceColor(board[StartSquare(move)]);
+      int i = 0;
+      for (; i < count && squares[i] != square; i++) ;
+      Bitboard all;
+      if (i < count) {
+         all = attackers[i];
+      } else {
+         all = calcAttackers(square);
+         if (count < MAX_SQUARES) {
+            squares[count] = square;
+            attackers[count++] = all;
+         }
+      }
+      mine = all & board.occupied[side];
+      opp = all & board.occupied[OppositeColor(side)];
+   }
+
+private:
+   static constexpr int MAX_SQUARES = 32;
+
+   // pieces of both sides attacking "sq"
+   Bitboard calcAttackers(Square sq) const {
+      Bitboard kings;
+      kings.set(board.kingSquare(White));
+      kings.set(board.kingSquare(Black));
+      return (Attacks::pawn_attacks[sq][White] & board.pawn_bits[White]) |
+         (Attacks::pawn_attacks[sq][Black] & board.pawn_bits[Black]) |
+         (Attacks::knight_attacks[sq] &
+          (board.knight_bits[White] | board.knight_bits[Black])) |
+         (Attacks::king_attacks[sq] & kings) |
+         (board.rookAttacks(sq) &
+          (board.rook_bits[White] | board.rook_bits[Black] |
+           board.queen_bits[White] | board.queen_bits[Black])) |
+         (board.bishopAttacks(sq) &
+          (board.bishop_bits[White] | board.bishop_bits[Black] |
+           board.queen_bits[White] | board.queen_bits[Black]));
+   }
+
+   const Board &board;
+   int count;
+   Square squares[MAX_SQUARES];
+   Bitboard attackers[MAX_SQUARES];
+};
+
+void seeBatch(const Board &board, const Move *moves, int n, score_t *scores) {
+   SeeAttackCache cache(board);
+   for (int i = 0; i < n; i++) {
+      ASSERT(!IsNull(moves[i]));
+      Bitboard mine, opp;
+      cache.get(moves[i],mine,opp);
+      scores[i] = opp.isClear() ? Params::Gain(moves[i]) :
+         seeAttacks(board,moves[i],mine,opp);
+      ASSERT(scores[i] == see(board,moves[i]));
+   }
+}
+
+void seeSignBatch(const Board &board, const Move *moves, int n,
+                  score_t threshold, score_t *results) {
+   SeeAttackCache cache(board);
+   for (int i = 0; i < n; i++) {
+      ASSERT(!IsNull(moves[i]));
+      if (Params::Gain(moves[i]) < threshold) {
+         results[i] = 0;
+         continue;
+      }
+      Bitboard mine, opp;
+      cache.get(moves[i],mine,opp);
+      results[i] = opp.isClear() ? 1 :
+         seeSignAttacks(board,moves[i],threshold,mine,opp);
+      ASSERT(results[i] == seeSign(board,moves[i],threshold));
+   }
+}
+
@@ -14,5 +14,14 @@ score_t see( const Board &board, Move move );
 // is >= threshold
 score_t seeSign( const Board &board, Move move, score_t threshold);
 
+// Batched versions for "n" captures from the same position: set
+// scores[i] = see(board,moves[i]), or results[i] =
+// seeSign(board,moves[i],threshold). The attackers of each target
+// square are computed once and shared by all captures of that square.
+void seeBatch(const Board &board, const Move *moves, int n, score_t *scores);
+
+void seeSignBatch(const Board &board, const Move *moves, int n,
+                  score_t threshold, score_t *results);
+
 #endif
 
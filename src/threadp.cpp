@@ -3,6 +3,7 @@
 #include "threadp.h"
 #include "search.h"
 #include "globals.h"
+#include <new>
 #ifndef _WIN32
 #include <errno.h>
 #include <fcntl.h>
@@ -37,7 +38,8 @@ void log(const string &s,int param) {
 #endif
 
 void ThreadPool::idle_loop(ThreadInfo *ti) {
-   while (ti->state != ThreadInfo::Terminating) {
+   ThreadPool *pool = ti->pool;
+   for (;;) {
 #ifdef _THREAD_TRACE
       {
       std::ostringstream s;
@@ -45,39 +47,54 @@ void ThreadPool::idle_loop(ThreadInfo *ti) {
       log(s.str());
       }
 #endif
-      ti->pool->lock();
-      ti->state = ThreadInfo::Idle;
 #ifdef NUMA
+      pool->lock();
       if (rebindMask.test(ti->index)) {
-         if (ti->pool->bind(ti->index)) {
+         if (pool->bind(ti->index)) {
             cerr << "Warning: bind to CPU failed for thread " << ti->index << endl;
          }
          rebindMask.reset(ti->index);
       }
+      pool->unlock();
 #endif
-      ti->pool->unlock();
-      int result;
-      if ((result = ti->wait()) != 0) {
-         if (result == -1) continue; // was interrupted
-         else break;
+      const std::function<void(unsigned,unsigned)> *task;
+      unsigned taskThreads;
+      {
+         std::unique_lock<std::mutex> lk(pool->startLock);
+         if (ti->state != ThreadInfo::Terminating) {
+            ti->state = ThreadInfo::Idle;
+         }
+         pool->startCv.wait(lk,[ti,pool] {
+            return ti->state == ThreadInfo::Terminating ||
+               ti->generation != pool->generation; });
+         ti->generation = pool->generation;
+         task = pool->task;
+         taskThreads = pool->taskThreads;
       }
 #ifdef _THREAD_TRACE
       log("unblocked",ti->index);
 #endif
-      // We've been woken up. There are two possible reasons:
+      // We've been woken up. There are three possible reasons:
       // 1. This thread is terminating.
       // 2. This thread has been assigned some work.
+      // 3. This thread has been given a slice of a runAll task.
       //
       if (ti->state == ThreadInfo::Terminating) {
           break;
       }
+      if (task) {
+          // State remains Idle: we are not searching.
+          (*task)(ti->index,taskThreads);
+          pool->setCompleted(ti->index);
+          continue;
+      }
       ASSERT(ti->work);
-      ti->pool->lock();
-      ti->pool->activeMask |= (1ULL << ti->index);
+      pool->activeMask.set(ti->index);
       ti->state = ThreadInfo::Working;
-      ti->pool->unlock();
       NodeStack searchStack; // stack on which search will be done
       ti->work->init(searchStack, ti);
+      ti->startLatency = std::chrono::duration_cast<std::chrono::microseconds>(
+         getCurrentTime() - pool->startTime).count();
 #ifdef _THREAD_TRACE
       {
       std::ostringstream s;
@@ -86,21 +103,44 @@ void ThreadPool::idle_loop(ThreadInfo *ti) {
       }
 #endif
       ti->work->ply0_search();
-      ti->pool->lock();
+      // remove thread from active list and set state back to Idle
+      pool->activeMask.reset(ti->index);
+      ti->state = ThreadInfo::Idle;
       // Mark thread completed
-      ti->pool->completedMask.set(ti->index);
+      pool->setCompleted(ti->index);
 #ifdef _THREAD_TRACE
       {
            std::ostringstream s;
-           s << "# thread " << ti->index << " completed, mask=" << 
-           ti->pool->completedMask << endl;
+           s << "# thread " << ti->index << " completed, count=" <<
+           pool->completedCount << endl;
            log(s.str());
       }
 #endif
-      // remove thread from active list and set state back to Idle
-      ti->pool->activeMask.reset(ti->index);
-      ti->state = ThreadInfo::Idle;
-      ti->pool->unlock();
+   }
+}
+
+void ThreadPool::unblockAll()
+{
+   completedMask.clear();
+   completedCount = 0;
+   {
+      std::unique_lock<std::mutex> lk(startLock);
+      startTime = getCurrentTime();
+      ++generation;
+   }
+   // No need to unblock thread 0: that is the main thread. It does
+   // not wait on startCv.
+   startCv.notify_all();
+}
+
+void ThreadPool::setCompleted(unsigned index)
+{
+   if (completedMask.set(index) && ++completedCount == nThreads) {
+      // Last thread to complete wakes the waiter. Take the lock so
+      // the notification cannot be missed between the waiter's check
+      // and its wait.
+      std::unique_lock<std::mutex> lk(doneLock);
+      doneCv.notify_one();
    }
 }
 
@@ -112,16 +152,44 @@ void ThreadPool::waitAll()
 #ifdef _THREAD_TRACE
       {
          std::ostringstream s;
-         s << "waitAll: completed mask=" <<
-             completedMask << " count=" << completedMask.count() << endl;
+         s << "waitAll: completed count=" << completedCount << endl;
          log(s.str());
       }
 #endif
-      // TBD: use conditional variable/wait here
-      while (!allCompleted()) {
-          std::this_thread::sleep_for(std::chrono::milliseconds(5));
-      }
+      std::unique_lock<std::mutex> lk(doneLock);
+      doneCv.wait(lk,[this] { return allCompleted(); });
+   }
+}
+
+uint64_t ThreadPool::startLatency() const
+{
+   uint64_t latency = 0ULL;
+   for (unsigned i = 1; i < nThreads; i++) {
+      latency = std::max<uint64_t>(latency,data[i]->startLatency);
+   }
+   return latency;
+}
+
+void ThreadPool::runAll(const std::function<void(unsigned,unsigned)> &fn)
+{
+   bool idle = nThreads > 1;
+   for (unsigned i = 1; i < nThreads && idle; i++) {
+      idle = data[i]->state == ThreadInfo::Idle;
+   }
+   if (!idle) {
+      fn(0,1);
+      return;
+   }
+   {
+      std::unique_lock<std::mutex> lk(startLock);
+      task = &fn;
+      taskThreads = nThreads;
    }
+   unblockAll();
+   fn(0,taskThreads);
+   waitAll();
+   std::unique_lock<std::mutex> lk(startLock);
+   task = nullptr;
 }
 
 #ifdef _WIN32
@@ -147,14 +215,6 @@ static void * CDECL parkingLot(void *x)
 ThreadInfo::~ThreadInfo() {
 }
 
-void ThreadInfo::start() {
-    ASSERT(index>=0);
-#ifdef _THREAD_TRACE
-    log("start",index);
-#endif
-    signal();
-}
-
 ThreadInfo::ThreadInfo(ThreadPool *p, unsigned i)
  : state(Starting),
 #ifdef _WIN32
@@ -164,7 +224,10 @@ ThreadInfo::ThreadInfo(ThreadPool *p, unsigned i)
    work(nullptr),
 #endif
    pool(p),
-   index(i)
+   index(i),
+   counters(&p->counters[i]),
+   generation(p->generation),
+   startLatency(0ULL)
 {
 #ifdef _THREAD_TRACE
   log("starting",i);
@@ -192,12 +255,17 @@ ThreadInfo::ThreadInfo(ThreadPool *p, unsigned i)
 }
 
 ThreadPool::ThreadPool(SearchController *ctrl, unsigned n) :
-    controller(ctrl), nThreads(n) {
+    controller(ctrl), nThreads(n), task(nullptr), taskThreads(0),
+    completedCount(0), generation(0) {
 
    LockInit(poolLock);
    for (int i = 0; i < Constants::MaxCPUs; i++) {
       data[i] = nullptr;
    }
+   ALIGNED_MALLOC(counters,ThreadCounters,sizeof(ThreadCounters)*Constants::MaxCPUs,128);
+   for (int i = 0; i < Constants::MaxCPUs; i++) {
+      new (&counters[i]) ThreadCounters();
+   }
 #ifndef _WIN32
    if (pthread_attr_init (&stackSizeAttrib)) {
       perror("pthread_attr_init");
@@ -240,18 +308,14 @@ ThreadPool::ThreadPool(SearchController *ctrl, unsigned n) :
    }
    // Thread 0 (main thread) is always active:
    activeMask.set(0);
-   for (size_t i = 0; i < n; i++) {
-       availableMask.set(i);
-   }
-   // Wait for all threads to start up
-   while (n >1) {
-       unsigned cnt = 0;
-       for (unsigned i = 1; i < n; i++) {
-           if (data[i]->state == ThreadInfo::Idle) {
-             ++cnt;
-           }
+   waitForStartup(1);
+}
+
+void ThreadPool::waitForStartup(unsigned first) {
+   for (unsigned i = first; i < nThreads; i++) {
+       while (data[i]->state == ThreadInfo::Starting) {
+           std::this_thread::yield();
        }
-       if (cnt==n-1) break;
    }
 }
 
@@ -265,32 +329,36 @@ ThreadPool::~ThreadPool() {
       perror("pthread_attr_destroy");
    }
 #endif
+   ALIGNED_FREE(counters);
    LockFree(poolLock);
 }
 
-void ThreadPool::shutDown() {
-    Lock(poolLock);
-    ThreadInfo *p;
-    // note: do not terminate thread 0 (main thread) in this loop
-    for (unsigned i = 1; i < nThreads; i++) {
-        p = data[i];
-        // All threads should be idle when this function is called.
-        if (p->state == ThreadInfo::Idle) {
-          // Set the thread to the terminating state that will force thread
-          // procedure exit
-          p->state = ThreadInfo::Terminating;
-          // unblock the thread
-          p->signal();
-       }
-       // wait for the thread to terminate
+void ThreadPool::terminate(ThreadInfo *p) {
+    {
+        // Set the thread to the terminating state that will force thread
+        // procedure exit
+        std::unique_lock<std::mutex> lk(startLock);
+        p->state = ThreadInfo::Terminating;
+    }
+    // unblock the thread
+    startCv.notify_all();
+    // wait for the thread to terminate
 #ifdef _WIN32
-       WaitForSingleObject(p->thread_id,INFINITE);
+    WaitForSingleObject(p->thread_id,INFINITE);
 #else
-       void *value_ptr;
-       pthread_join(p->thread_id,&value_ptr);
+    void *value_ptr;
+    pthread_join(p->thread_id,&value_ptr);
 #endif
+}
+
+void ThreadPool::shutDown() {
+    Lock(poolLock);
+    // note: do not terminate thread 0 (main thread) in this loop.
+    // All threads should be idle when this function is called.
+    for (unsigned i = 1; i < nThreads; i++) {
+       terminate(data[i]);
        // Free thread data
-       delete p;
+       delete data[i];
     }
     // now free main thread data
     delete data[0]->work;
@@ -300,12 +368,14 @@ void ThreadPool::shutDown() {
 
 void ThreadPool::resize(unsigned n) {
     if (n >= 1 && n < Constants::MaxCPUs && n != nThreads) {
+        unsigned first = nThreads;
         lock();
 #ifdef NUMA
         topo.recalc();
 #endif
         if (n>nThreads) {
             // growing
+            first = nThreads;
             while (n > nThreads) {
                data[nThreads] = new ThreadInfo(this,nThreads);
                nThreads++;
@@ -315,43 +385,32 @@ void ThreadPool::resize(unsigned n) {
             // shrinking
             while (n < nThreads) {
                 ThreadInfo *p = data[nThreads-1];
-                p->state = ThreadInfo::Terminating;
-                if (p->state == ThreadInfo::Idle) {
-                    p->signal(); // unblock thread & exit thread proc
-                    // wait for thread exit
-#ifdef _WIN32
-                    WaitForSingleObject(p->thread_id,INFINITE);
-#else
-                    void *value_ptr;
-                    pthread_join(p->thread_id,&value_ptr);
-#endif
-                }
+                terminate(p);
                 delete p;
-                data[nThreads] = nullptr;
+                data[nThreads-1] = nullptr;
                 --nThreads;
             }
         }
         unlock();
+        // Wait until any new threads have created their Search
+        // instances, so that they are included in forEachSearch. This
+        // must be done without holding the pool lock, because new
+        // threads acquire it in idle_loop (NUMA builds) before they
+        // leave the Starting state.
+        waitForStartup(first);
     }
     ASSERT(nThreads == n);
-    for (size_t i = 0; i < Constants::MaxCPUs; i++) {
-        if (i < n) {
-            availableMask.set(i);
-        } else {
-            availableMask.reset(i);
-        }
-    }
 }
 
 int ThreadPool::activeCount() const {
-    return (activeMask & availableMask).count();
+    return activeMask.count();
 }
 
 uint64_t ThreadPool::totalNodes() const
 {
    uint64_t total = 0ULL;
    for (unsigned i = 0; i < nThreads; i++) {
-      total += data[i]->work->stats.num_nodes;
+      total += counters[i].nodes.load(std::memory_order_relaxed);
    }
    return total;
 }
@@ -360,8 +419,14 @@ uint64_t ThreadPool::totalHits() const
 {
    uint64_t total = 0ULL;
    for (unsigned i = 0; i < nThreads; i++) {
-      total += data[i]->work->stats.tb_hits;
+      total += counters[i].tb_hits.load(std::memory_order_relaxed);
    }
    return total;
 }
 
+void ThreadPool::clearCounters()
+{
+   for (unsigned i = 0; i < nThreads; i++) {
+      counters[i].clear();
+   }
+}
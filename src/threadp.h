@@ -12,6 +12,7 @@
 #include <array>
 #include <atomic>
 #include <bitset>
+#include <condition_variable>
 #include <functional>
 #include <mutex>
 
@@ -23,17 +24,51 @@ struct NodeInfo;
 
 class ThreadPool;
 
-struct ThreadInfo : public ThreadControl {
+// Node and tablebase hit counts for one search thread. These are
+// updated frequently by the searching thread and read by other
+// threads (for UCI output and time checks), so each thread's
+// counters are on their own cache line(s), apart from its other
+// search data. Only the owning thread updates them, so a relaxed
+// load and store is sufficient (no locked add).
+struct CACHE_ALIGN ThreadCounters {
+   atomic<uint64_t> nodes;
+   atomic<uint64_t> tb_hits;
+
+   ThreadCounters() : nodes(0ULL), tb_hits(0ULL) {
+   }
+
+   void addNodes(uint64_t n) {
+      nodes.store(nodes.load(std::memory_order_relaxed) + n,
+                  std::memory_order_relaxed);
+   }
+
+   void addTbHit() {
+      tb_hits.store(tb_hits.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_relaxed);
+   }
+
+   void clear() {
+      nodes.store(0ULL,std::memory_order_relaxed);
+      tb_hits.store(0ULL,std::memory_order_relaxed);
+   }
+};
+
+struct ThreadInfo {
  
    enum State { Starting, Idle, Working, Terminating };
    ThreadInfo(ThreadPool *,unsigned i);
    virtual ~ThreadInfo();
-   void start();
    atomic<State> state;
    Search *work;
    ThreadPool *pool;
    THREAD thread_id;
    unsigned index;
+   ThreadCounters *counters;
+   // last start generation seen by this thread (see ThreadPool::unblockAll)
+   unsigned generation;
+   // time in microseconds from the start of the last search until
+   // this thread began searching
+   uint64_t startLatency;
    int operator == (const ThreadInfo &ti) const {
        return index == ti.index;
    }
@@ -42,6 +77,46 @@ struct ThreadInfo : public ThreadControl {
    }
 };
 
+// Bit set of thread indices that can be updated and read without
+// locking.
+class AtomicThreadMask {
+public:
+   AtomicThreadMask() {
+      clear();
+   }
+
+   // Set a bit; return true if it was not already set.
+   bool set(unsigned index) {
+      const uint64_t bit = 1ULL << (index % 64);
+      return !(words[index/64].fetch_or(bit) & bit);
+   }
+
+   void reset(unsigned index) {
+      words[index/64].fetch_and(~(1ULL << (index % 64)));
+   }
+
+   bool test(unsigned index) const {
+      return (words[index/64].load(std::memory_order_acquire) >> (index % 64)) & 1;
+   }
+
+   unsigned count() const {
+      unsigned n = 0;
+      for (const auto &w : words) {
+         n += (unsigned)std::bitset<64>(w.load(std::memory_order_relaxed)).count();
+      }
+      return n;
+   }
+
+   void clear() {
+      for (auto &w : words) {
+         w.store(0ULL,std::memory_order_relaxed);
+      }
+   }
+
+private:
+   std::array<std::atomic<uint64_t>,(Constants::MaxCPUs+63)/64> words;
+};
+
 class ThreadPool {
     friend class SearchController;
     friend struct ThreadInfo;
@@ -71,16 +146,21 @@ public:
       unlock();
    }
 
-   void unblockAll() {
-      completedMask = 0ULL;
-      // No need to unblock thread 0: that is the main thread
-      for (unsigned i = 1; i < nThreads; i++) {
-         data[i]->signal();
-      }
-   }
+   // Start all idle threads (other than thread 0, the main
+   // thread), with a single broadcast wakeup.
+   void unblockAll();
 
+   // Called from the main thread: wait until all threads have
+   // completed their work.
    void waitAll();
 
+   // Run fn(index,count) on every thread in the pool, including the
+   // calling (main) thread, and return when all have finished. Used
+   // for work such as hash clearing that is split into "count"
+   // slices. If any helper thread is busy, fn runs on the calling
+   // thread only, as fn(0,1).
+   void runAll(const std::function<void(unsigned,unsigned)> &fn);
+
    SearchController *getController() const {
      return controller;
    }
@@ -113,41 +193,67 @@ public:
    }
 #endif
 
+   // Sum of node and tablebase hit counters across threads
    uint64_t totalNodes() const;
 
    uint64_t totalHits() const;
 
-   bool allCompleted() {
-       lock();
-       bool val = completedMask.count() == nThreads;
-       unlock();
-       return val;
-   }
+   // Zero all thread counters. Call before starting a search.
+   void clearCounters();
 
-   bool isCompleted(unsigned index) {
-       lock();
-       bool val = completedMask.test(index);
-       unlock();
-       return val;
+   bool allCompleted() const {
+       return completedCount.load() == nThreads;
    }
-    
-   void setCompleted(unsigned index) {
-       lock();
-       completedMask.set(static_cast<size_t>(index));
-       unlock();
+
+   bool isCompleted(unsigned index) const {
+       return completedMask.test(index);
    }
 
+   void setCompleted(unsigned index);
+
+   // Maximum time in microseconds from the start of the last search
+   // (unblockAll) until a helper thread began searching.
+   uint64_t startLatency() const;
+
 private:
    void shutDown();
 
+   // Stop a helper thread and wait for it to exit.
+   void terminate(ThreadInfo *p);
+
+   // Wait until threads with index >= first have started and are idle.
+   void waitForStartup(unsigned first);
+
    // lock for the class.
    LockDefine(poolLock);
    SearchController *controller;
    unsigned nThreads;
    std::array<ThreadInfo *,Constants::MaxCPUs> data;
 
+   // per-thread counters, indexed by thread index
+   ThreadCounters *counters;
+
+   // non-null while runAll is executing
+   const std::function<void(unsigned,unsigned)> *task;
+   unsigned taskThreads;
+
    // mask of thread status - 0 if idle, 1 if active
-   std::bitset<Constants::MaxCPUs> activeMask, availableMask, completedMask;
+   AtomicThreadMask activeMask;
+   // mask of threads that have completed their work
+   AtomicThreadMask completedMask;
+   std::atomic<unsigned> completedCount;
+
+   // Idle threads wait on startCv for generation to change (or to be
+   // told to terminate). startLock also protects task and
+   // taskThreads.
+   std::mutex startLock;
+   std::condition_variable startCv;
+   unsigned generation;
+   CLOCK_TYPE startTime;
+
+   // waitAll waits on doneCv for completedCount to reach nThreads
+   std::mutex doneLock;
+   std::condition_variable doneCv;
 
 #ifndef _WIN32
    pthread_attr_t stackSizeAttrib;
@@ -41,6 +41,27 @@ int Topology::bind(ThreadInfo *thread)
     return hwloc_set_thread_cpubind(topo,thread->thread_id,cpuset[thread->index],HWLOC_CPUBIND_THREAD | HWLOC_CPUBIND_STRICT);
 }
 
+unsigned Topology::interleave(void *addr, size_t len)
+{
+    hwloc_topology_t t;
+    if (hwloc_topology_init(&t)) {
+        return 0;
+    }
+    unsigned nodes = 0;
+    if (hwloc_topology_load(t) == 0) {
+        int n = hwloc_get_nbobjs_by_type(t, HWLOC_OBJ_NUMANODE);
+        if (n > 1 &&
+            hwloc_set_area_membind(t, addr, len,
+                                   hwloc_topology_get_topology_nodeset(t),
+                                   HWLOC_MEMBIND_INTERLEAVE,
+                                   HWLOC_MEMBIND_BYNODESET) == 0) {
+            nodes = unsigned(n);
+        }
+    }
+    hwloc_topology_destroy(t);
+    return nodes;
+}
+
 void Topology::recalc() {
     cleanup();
     init();
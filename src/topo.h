@@ -31,6 +31,12 @@ public:
     // Recalculate topology. Called after thread pool is resized.
     void recalc();
 
+    // Set the memory policy for an address range so that its pages
+    // are interleaved across all NUMA nodes. Must be called before the
+    // memory is first touched. Returns the number of nodes, or 0 if
+    // interleaving was not done (single node, or failure).
+    static unsigned interleave(void *addr, size_t len);
+
 private:
     int init();
     void cleanup();
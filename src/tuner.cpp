@@ -5,18 +5,23 @@
 #include "legal.h"
 #include "hash.h"
 #include "globals.h"
+#include "mmapfile.h"
+#include "packpos.h"
 #include "chessio.h"
 #include "search.h"
 #include "tune.h"
 #include <algorithm>
 #include <array>
 #include <cstdio>
+#include <cstring>
 #include <cmath>
 #include <ctime>
 #include <iostream>
 #include <fstream>
 #include <iomanip>
 #include <limits>
+#include <memory>
+#include <random>
 #include <vector>
 #include <unordered_map>
 #include <thread>
@@ -48,22 +53,46 @@ static string out_file_name="params.cpp";
 
 static string x0_file_name="x0";
 
+// if set, also write the parameters in parameter file format
+static string param_file_name;
+
 static string pos_file_name = "games.fen";
 
 static ifstream pos_file;
+// lines of pos_file read so far
+static uint64_t lines_read = 0;
+
+static string cache_file_name;
 
 static bool verbose = false;
+// if set, trace thread creation and phase start for each thread
+static bool trace_threads = false;
 static bool validate = false;
 static bool recalc = false;
 static bool test = false;
 
 static int pv_recalc_interval = 16;
 
+// if nonzero, record eval features every feature_interval iterations
+// and use them in between (-F option); 0 evaluates every position
+// exactly on every pass
+static int feature_interval = 0;
+
+// mini-batch mode settings (batch_size == 0 for full-batch tuning)
+static size_t batch_size = 0;
+static int validation_percent = 1;
+static int validation_interval = 0;
+
 static double lambda = 6E-5;
 
 static const int MAX_PV_LENGTH = 256;
 static const int NUM_RESULT = 8;
-static const int MAX_CORES = 64;
+// positions (or EPD records) a thread takes at a time
+static const size_t CHUNK_SIZE = 256;
+// mini-batches are made of shuffled blocks of this many positions
+static const size_t BATCH_BLOCK_SIZE = 256;
+// flush size for positions written directly to the cache file
+static const size_t CACHE_FLUSH_SIZE = 65536;
 static const int THREAD_STACK_SIZE = 12*1024*1024;
 static const int LEARNING_SEARCH_DEPTH = 1;
 // L2-regularization factor
@@ -91,35 +120,34 @@ enum class Objective {
 
 static Objective obj = Objective::Msq;
 
-static atomic<int> phase2_game_index;
+// next position to be processed in phase 2
+static atomic<size_t> next_position;
 
 static string cmdline;
 
 LockDefine(file_lock);
-LockDefine(data_lock);
 
 #ifdef _POSIX_VERSION
 static pthread_attr_t stackSizeAttrib;
 #endif
 
-struct PosInfo
-{
-   PosInfo(const string &pos, int ws, int bs, double res)
-      :position(pos),wstatus(ws),bstatus(bs),result(res)
-      {
-      }
-
-   PosInfo(const string &pos, double res)
-      :position(pos),wstatus(5),bstatus(5),result(res)
-      {
-      }
+// Positions selected in phase 1 are stored in compact form (see
+// packpos.h), in one contiguous array, so that phase 2 does not need
+// to parse and allocate a Board for each position. The array can be
+// saved to a file and memory-mapped by later runs (-b option),
+// skipping phase 1. A file of positions written by datagen can also
+// be given instead of a training file.
 
-   string position;
-   int wstatus,bstatus;
-   double result;
-};
+// true if the training file is a file of PackedPositions
+static bool packed_input = false;
 
-static vector<PosInfo *> positions;
+// positions from phase 1
+static vector<PackedPosition> positions;
+// or, positions mapped from a cache file
+static std::unique_ptr<MappedFile> position_cache;
+// positions used by phase 2 (from one of the above)
+static const PackedPosition *position_data = nullptr;
+static size_t position_count = 0;
 
 enum Phase {Phase1, Phase2};
 
@@ -137,48 +165,134 @@ struct Parse1Data
    // accumulated stats for this phase:
    double target;
 
+   // positions found by this thread
+   vector<PackedPosition> positions;
+
    void clear() {
       target = 0.0;
+      positions.clear();
    }
 
 };
 
 struct Parse2Data
 {
-   unsigned int id;
-
    // holds accumulated derivatives for the scoring parameters:
    vector <double> grads;
    double target;
    size_t count;
 
+   // derivatives of the eval for one position (all zero between
+   // positions)
+   vector<double> derivs;
+
+   // features recorded by this thread, for the positions listed in
+   // featurePositions (see Features, below)
+   vector<size_t> featurePositions;
+   vector<uint32_t> featureCounts;
+   vector<double> featureConstants;
+   vector<uint16_t> featureIndices;
+   vector<float> featureCoefs;
+
    void clear() {
        target = 0.0;
        grads.clear();
        grads.resize(tune_params.numTuningParams(),0.0);
+       derivs.clear();
+       derivs.resize(tune_params.numTuningParams(),0.0);
        count = 0;
+       featurePositions.clear();
+       featureCounts.clear();
+       featureConstants.clear();
+       featureIndices.clear();
+       featureCoefs.clear();
+   }
+
+   // add the objective and gradient from another thread
+   void add(const Parse2Data &other) {
+       target += other.target;
+       count += other.count;
+       const size_t n = grads.size();
+       for (size_t i = 0; i < n; i++) {
+          grads[i] += other.grads[i];
+       }
+   }
+};
+
+// Sparse feature vectors. For each position, the tunable parameters
+// that its evaluation depends on, with the partial derivative of the
+// eval (from White's point of view) with respect to each, as computed
+// by update_deriv_vector, and a constant term for the rest of the
+// eval. Most of the eval is linear
+// in the parameters, so an iteration only needs to compute
+// constant + sum(coef*param) for each position, and accumulate
+// dT*coef into the gradient, instead of evaluating the position and
+// deriving the gradient again. A few terms are products of parameters
+// (king cover, king position with low material): for these the
+// coefficients are exact only for the parameter values they were
+// recorded with, so the gradient between recordings is a linear
+// approximation. Features are therefore only used if enabled with the
+// -F option, which sets how often they are recorded again.
+struct Features
+{
+   vector<size_t> offsets; // start of each position's entries (count+1)
+   vector<double> constants;
+   vector<uint16_t> indices;
+   vector<float> coefs;
+
+   void clear() {
+      vector<size_t>().swap(offsets);
+      vector<double>().swap(constants);
+      vector<uint16_t>().swap(indices);
+      vector<float>().swap(coefs);
    }
 };
 
-static std::thread threads[MAX_CORES+1];
-static ThreadData threadDatas[MAX_CORES+1];
-static Parse1Data data1[MAX_CORES+1];
-static Parse2Data data2[MAX_CORES+1];
+static Features features;
+
+// true if the current iteration records features
+static bool extract_features = false;
+
+// true if phase 2 only computes the objective (no gradient)
+static bool objective_only = false;
+
+// in mini-batch mode, phase 1 writes positions directly to the cache
+// file instead of keeping them in memory
+static ofstream cache_out;
+static uint64_t cache_out_count = 0;
+LockDefine(cache_lock);
+
+// current parameter values, for the sparse evaluation
+static vector<double> param_values;
+
+// per-thread data, indexed 1..cores (sized by initThreads)
+static vector<std::thread> threads;
+static vector<ThreadData> threadDatas;
+static vector<Parse1Data> data1;
+static vector<Parse2Data> data2;
 
 static void usage()
 {
-   cerr << "Usage: tuner <options> <training file>" << endl;
+   cerr << "Usage: tuner <options> <training file (EPD, or positions from datagen)>" << endl;
    cerr << "Options:" << endl;
+   cerr << " -b <file> save positions from the first pass to a binary cache file, or read them from it if it exists" << endl;
+   cerr << " -B <batch size> mini-batch mode: tune on shuffled batches read from the cache file (-b); -n is the number of epochs" << endl;
    cerr << " -c <cores>" << endl;
    cerr << " -d just write out current parameters values to params.cpp" << endl;
+   cerr << " -E <batches> in mini-batch mode, also compute the validation objective every <batches> batches" << endl;
    cerr << " -f <ouput .cpp file>" << endl;
+   cerr << " -H <percent> in mini-batch mode, percentage of positions held out for validation (default 1)" << endl;
    cerr << " -i <input parameter file>" << endl;
    cerr << " -n <iterations>" << endl;
    cerr << " -o adagrad|adam|adaptive select optimization method" << endl;
    cerr << " -r <lambda> apply regularization" << endl;
    cerr << " -t just compute objective against file with current parameters" << endl;
+   cerr << " -T trace thread startup (debugging)" << endl;
+   cerr << " -v verbose output, including positions/second for each pass" << endl;
    cerr << " -x <ouput parameter file>" << endl;
+   cerr << " -F <interval> record eval features every <interval> iterations and use them in between (linear approximation for non-linear terms; default: evaluate exactly every iteration)" << endl;
    cerr << " -O log|msq|msqlog select objective type" << endl;
+   cerr << " -P <file> also write parameters to a file the engine can load at startup (search.param_file)" << endl;
    cerr << " -R <recalc interval> periodically recalulate PVs" << endl;
    cerr << " -V validate gradient" << endl;
 }
@@ -205,7 +319,7 @@ double result_val(const string &res)
 }
 
 // value is eval in pawn units; res is result string for game
-static double computeErrorTexel(const Board &board,double value,double result,const ColorType side)
+static double computeErrorTexel(double value,double result,const ColorType side)
 {
    value /= Params::PAWN_VALUE;
 
@@ -265,15 +379,16 @@ static double calc_penalty()
    // apply L2-regularization to the tuning parameters
    double l2 = 0.0;
    if (regularize) {
-      for (TuneParam p : tune_params) {
+      for (const TuneParam &p : tune_params) {
          // apply penalty only for parameters being tuned
          if (p.tunable) {
             if (p.range()==0) {
                cerr << "warning: param " << p.name << " has zero range" << endl;
                continue;
             }
-            p.scale();
-            l2 += lambda*(p.current-0.5)*(p.current-0.5);
+            // same scaled value as in adjust_params
+            const score_t val = p.scaled();
+            l2 += lambda*(val-0.5)*(val-0.5);
          }
       }
    }
@@ -322,74 +437,102 @@ static int make_pv(ThreadData &td,const Board &board, Board &pvBoard,score_t &sc
 }
 
 
+// Append positions to the cache file being written, and clear them.
+static void write_cache_positions(vector<PackedPosition> &pos)
+{
+   Lock(cache_lock);
+   cache_out.write(reinterpret_cast<const char *>(pos.data()),pos.size()*sizeof(PackedPosition));
+   cache_out_count += pos.size();
+   Unlock(cache_lock);
+   pos.clear();
+}
+
 static void parse1(ThreadData &td, Parse1Data &pdata, int id)
 {
    pdata.clear();
-   // iterate for each position in file
-   uint64_t line = 0;
-   while (!pos_file.eof() && pos_file.good()) {
-      try {
-         Board board, pvBoard;
-         double result = 0.0;
-         EPDRecord rec;
-         Lock(file_lock);
+   vector<string> lines;
+   lines.reserve(CHUNK_SIZE);
+   for (;;) {
+      // take the next chunk of lines from the file
+      uint64_t line;
+      lines.clear();
+      Lock(file_lock);
+      line = lines_read;
+      string buf;
+      while (lines.size() < CHUNK_SIZE && getline(pos_file,buf)) {
+         lines.push_back(buf);
+      }
+      lines_read += lines.size();
+      Unlock(file_lock);
+      if (lines.empty()) break;
+      for (const string &text : lines) {
          ++line;
-         if (!ChessIO::readEPDRecord(pos_file,board,rec)) {
-            // EOF
-            Unlock(file_lock);
-            break;
-         }
-         Unlock(file_lock);
-         if (rec.hasError()) {
-            cerr << "error in EPD record, line " << line << ": " << rec.getError() << endl;
-            continue;
-         }
-         string val;
-         if (rec.getVal(CASTLE_STATUS_KEY,val)) {
-            // trim quotes
-            val.erase(std::remove( val.begin(), val.end(), '\"' ),val.end());
-            stringstream vstream(val);
-            unsigned wstatus = 5, bstatus = 5;
-            vstream >> wstatus;
-            vstream >> bstatus;
-            if (!vstream.bad() && !vstream.fail() && wstatus <= 5 &&
-                bstatus <= 5) {
-               board.setCastleStatus((CastleType)wstatus,White);
-               board.setCastleStatus((CastleType)bstatus,Black);
-            } else {
-               cerr << "error parsing castling status";
+         try {
+            Board board, pvBoard;
+            double result = 0.0;
+            EPDRecord rec;
+            stringstream str(text);
+            if (!ChessIO::readEPDRecord(str,board,rec)) {
+               // blank line
                continue;
             }
-         }
-         if (rec.getVal(RESULT_KEY,val)) {
-            // trim quotes
-            val.erase(std::remove( val.begin(), val.end(), '\"' ),val.end());
-            stringstream rstream(val);
-            rstream >> result;
-            if (rstream.bad() || rstream.fail()) {
-               cerr << "error parsing result";
+            if (rec.hasError()) {
+               cerr << "error in EPD record, line " << line << ": " << rec.getError() << endl;
                continue;
             }
+            string val;
+            if (rec.getVal(CASTLE_STATUS_KEY,val)) {
+               // trim quotes
+               val.erase(std::remove( val.begin(), val.end(), '\"' ),val.end());
+               stringstream vstream(val);
+               unsigned wstatus = 5, bstatus = 5;
+               vstream >> wstatus;
+               vstream >> bstatus;
+               if (!vstream.bad() && !vstream.fail() && wstatus <= 5 &&
+                   bstatus <= 5) {
+                  board.setCastleStatus((CastleType)wstatus,White);
+                  board.setCastleStatus((CastleType)bstatus,Black);
+               } else {
+                  cerr << "error parsing castling status";
+                  continue;
+               }
+            }
+            if (rec.getVal(RESULT_KEY,val)) {
+               // trim quotes
+               val.erase(std::remove( val.begin(), val.end(), '\"' ),val.end());
+               stringstream rstream(val);
+               rstream >> result;
+               if (rstream.bad() || rstream.fail()) {
+                  cerr << "error parsing result";
+                  continue;
+               }
+            }
+            // check for illegal positions
+            Bitboard atcks = board.calcAttacks(board.kingSquare(board.oppositeSide()),board.sideToMove());
+            // If king can be captured, position is illegal
+            if (!atcks.isClear()) continue;
+            score_t score;
+            if (make_pv(td,board,pvBoard,score)) {
+                double func_value = computeErrorTexel(score, result, board.sideToMove());
+                pdata.target += func_value;
+                PackedPosition pos;
+                if (pos.pack(pvBoard)) {
+                   pos.setResult(result);
+                   pdata.positions.push_back(pos);
+                   if (cache_out.is_open() && pdata.positions.size() >= CACHE_FLUSH_SIZE) {
+                      write_cache_positions(pdata.positions);
+                   }
+                }
+            }
+         } catch(std::bad_alloc) {
+            cerr << "out of memory" << endl;
+            exit(-1);
          }
-         // check for illegal positions
-         Bitboard atcks = board.calcAttacks(board.kingSquare(board.oppositeSide()),board.sideToMove());
-         // If king can be captured, position is illegal
-         if (!atcks.isClear()) continue;
-         score_t score;
-         if (make_pv(td,board,pvBoard,score)) {
-             double func_value = computeErrorTexel(board, score, result, board.sideToMove());
-             pdata.target += func_value;
-             stringstream fen;
-             fen << pvBoard;
-             Lock(data_lock);
-             positions.push_back(new PosInfo(fen.str(),pvBoard.castleStatus(White),pvBoard.castleStatus(Black),result));
-             Unlock(data_lock);
-         }
-      } catch(std::bad_alloc) {
-         cerr << "out of memory" << endl;
-         exit(-1);
       }
    }
+   if (cache_out.is_open()) {
+      write_cache_positions(pdata.positions);
+   }
 }
 
 // returns index into PST corresponding to square "i"
@@ -1306,7 +1449,7 @@ static void calc_derivative(Scoring &s, Parse2Data &data, const Board &board, do
        return;
    }
 
-   double func_value = computeErrorTexel(board,record_value,result,board.sideToMove());
+   double func_value = computeErrorTexel(record_value,result,board.sideToMove());
    // compute the change in loss function per delta in eval
    double dT = computeTexelDeriv(record_value,result,board.sideToMove());
    // multiply the derivative by the x (feature) value, scaled if necessary
@@ -1321,23 +1464,143 @@ static void calc_derivative(Scoring &s, Parse2Data &data, const Board &board, do
    return;
 }
 
+// Like calc_derivative, but computes only the objective.
+static void calc_objective(Scoring &s, Parse2Data &data, const Board &board, double result) {
+   const double record_value = s.evalu8(board,true);
+   if (fabs(record_value) <= 30.0*Params::PAWN_VALUE) {
+      data.target += computeErrorTexel(record_value,result,board.sideToMove());
+      data.count++;
+   }
+}
+
+// Like calc_derivative, but also records the sparse features for
+// position "index".
+static void extract_derivative(Scoring &s, Parse2Data &data, const Board &board, double result, size_t index) {
+   const double record_value = s.evalu8(board,true);
+   // compute the partial derivatives of the eval
+   update_deriv_vector(s, board, White, data.derivs, 1.0);
+   update_deriv_vector(s, board, Black, data.derivs, -1.0);
+   const bool valid = fabs(record_value) <= 30.0*Params::PAWN_VALUE;
+   const double dT = valid ? computeTexelDeriv(record_value,result,board.sideToMove()) : 0.0;
+   // the eval is relative to the side to move, the derivatives and
+   // the features are from White's point of view
+   double constant = board.sideToMove() == White ? record_value : -record_value;
+   const size_t start = data.featureIndices.size();
+   const int n = tune_params.numTuningParams();
+   for (int i = 0; i < n; i++) {
+      const double deriv = data.derivs[i];
+      if (deriv != 0.0) {
+         data.derivs[i] = 0.0;
+         if (tune_params[i].tunable) {
+            data.grads[i] += dT*deriv;
+            const float coef = float(deriv);
+            data.featureIndices.push_back(uint16_t(i));
+            data.featureCoefs.push_back(coef);
+            constant -= coef*param_values[i];
+         }
+      }
+   }
+   data.featurePositions.push_back(index);
+   data.featureCounts.push_back(uint32_t(data.featureIndices.size()-start));
+   data.featureConstants.push_back(constant);
+   if (valid) {
+      data.target += computeErrorTexel(record_value,result,board.sideToMove());
+      data.count++;
+   }
+   if (validate) {
+      validateGradient(s, board, record_value, result);
+   }
+}
+
+// Compute the objective and gradient for position "index" from its
+// recorded features.
+static void sparse_derivative(Parse2Data &data, const PackedPosition &pos, size_t index) {
+   const size_t start = features.offsets[index];
+   const size_t end = features.offsets[index+1];
+   const uint16_t *indices = features.indices.data();
+   const float *coefs = features.coefs.data();
+   double value = features.constants[index];
+   for (size_t k = start; k < end; k++) {
+      value += coefs[k]*param_values[indices[k]];
+   }
+   const ColorType side = pos.sideToMove();
+   if (side == Black) value = -value;
+   if (fabs(value) > 30.0*Params::PAWN_VALUE) {
+       // invalid record - score is too high
+       return;
+   }
+   data.target += computeErrorTexel(value,pos.resultValue(),side);
+   const double dT = computeTexelDeriv(value,pos.resultValue(),side);
+   double *grads = data.grads.data();
+   for (size_t k = start; k < end; k++) {
+      grads[indices[k]] += dT*coefs[k];
+   }
+   data.count++;
+}
+
+// Compare the objective and gradient computed by sparse_derivative
+// for position "index" with those computed by calc_derivative, and
+// report any differences. "sparse" and "exact" are work areas.
+static void validateSparse(Scoring &s, const Board &board, const PackedPosition &pos, size_t index, Parse2Data &sparse, Parse2Data &exact) {
+   sparse.clear();
+   exact.clear();
+   sparse_derivative(sparse, pos, index);
+   calc_derivative(s, exact, board, pos.resultValue());
+   bool mismatch = false;
+   if (sparse.count != exact.count ||
+       fabs(sparse.target - exact.target) > 1.0e-4) {
+      cerr << board << endl;
+      cerr << "sparse objective mismatch: sparse=" << sparse.target <<
+         " exact=" << exact.target << endl;
+      mismatch = true;
+   }
+   for (int i = 0; i < tune_params.numTuningParams(); i++) {
+      const double diff = fabs(sparse.grads[i] - exact.grads[i]);
+      if (diff > 1.0e-9 && diff > 1.0e-2*fabs(exact.grads[i])) {
+         if (!mismatch) {
+            cerr << board << endl;
+            mismatch = true;
+         }
+         cerr << "sparse gradient mismatch: name=" << tune_params[i].name <<
+            " sparse=" << sparse.grads[i] << " exact=" << exact.grads[i] << endl;
+      }
+   }
+}
+
 static void parse2(ThreadData &td, Parse2Data &data)
 {
    // This is large so allocate on heap:
    Scoring *s = new Scoring();
-   const size_t max = positions.size();
+   Board board;
+   // work areas for validating the sparse gradient
+   Parse2Data sparse, exact;
+   const size_t max = position_count;
    for (;;) {
-      // obtain the next available posiion from the vector
-      size_t next = (size_t)phase2_game_index.fetch_add(1);
-      if (next >= max) break;
-      if (verbose) cout << "game " << next << " thread " << td.index << endl;
-      PosInfo *p = positions[next];
-      Board board;
-      stringstream pos(p->position);
-      pos >> board;
-      board.setCastleStatus((CastleType)p->wstatus,White);
-      board.setCastleStatus((CastleType)p->bstatus,Black);
-      calc_derivative(*s, data, board, p->result);
+      // obtain the next available chunk of positions from the array
+      const size_t first = next_position.fetch_add(CHUNK_SIZE);
+      if (first >= max) break;
+      const size_t last = std::min<size_t>(first+CHUNK_SIZE,max);
+      for (size_t next = first; next < last; next++) {
+         const PackedPosition &p = position_data[next];
+         if (objective_only) {
+            p.unpack(board);
+            calc_objective(*s, data, board, p.resultValue());
+         } else if (!feature_interval || batch_size) {
+            // features are not recorded in mini-batch mode, since
+            // each position is seen once per epoch
+            p.unpack(board);
+            calc_derivative(*s, data, board, p.resultValue());
+         } else if (extract_features) {
+            p.unpack(board);
+            extract_derivative(*s, data, board, p.resultValue(), next);
+         } else {
+            if (validate) {
+               p.unpack(board);
+               validateSparse(*s, board, p, next, sparse, exact);
+            }
+            sparse_derivative(data, p, next);
+         }
+      }
    }
    delete s;
 //   if (verbose) cout << "thread " << td.index << " complete.";
@@ -1348,7 +1611,8 @@ static void adjust_params(Parse2Data &data0, vector<double> &historical_gradient
                           vector<double> &v /* for ADAM */,
                           vector<double> &prev_gradient /* for adaptive */,
                           vector<double> &step_sizes /* for adaptive */,
-                          int iterations)
+                          int iterations,
+                          double penalty_scale = 1.0)
 {
    for (TuneParam &p : tune_params) {
       const int i = p.index;
@@ -1359,8 +1623,10 @@ static void adjust_params(Parse2Data &data0, vector<double> &historical_gradient
       if (regularize && p.tunable) {
          // add the derivative of the regularization term. Note:
          // non-tunable parameters will have derivative zero and
-         // we don't regularize them.
-         dv += 2*lambda*(val-0.5);
+         // we don't regularize them. In mini-batch mode the
+         // gradient is summed over one batch, so the term is
+         // scaled by the fraction of the training set in the batch.
+         dv += penalty_scale*2*lambda*(val-0.5);
       }
       if (dv != 0.0 && p.tunable) {
          score_t istep = 1;
@@ -1422,24 +1688,24 @@ static void threadp(ThreadData *td)
    }
 #endif
 
-   // allocate controller in the thread
-   try {
-      td->searcher = new SearchController();
-   } catch(std::bad_alloc) {
-      cerr << "out of memory, thread " << td->index << endl;
-      return;
-   }
-
-   td->searcher->clearHashTables();
    // perform work based on phase
    if (td->phase == Phase1) {
-      if (verbose) cout << "starting phase 1, thread " << td->index << endl;
+      // allocate controller in the thread (only phase 1 searches)
+      try {
+         td->searcher = new SearchController();
+      } catch(std::bad_alloc) {
+         cerr << "out of memory, thread " << td->index << endl;
+         return;
+      }
+      td->searcher->clearHashTables();
+      if (trace_threads) cout << "starting phase 1, thread " << td->index << endl;
       parse1(*td,data1[td->index],td->index);
    } else {
-      if (verbose) cout << "starting phase 2, thread " << td->index << endl;
+      if (trace_threads) cout << "starting phase 2, thread " << td->index << endl;
       parse2(*td,data2[td->index]);
    }
    delete td->searcher;
+   td->searcher = nullptr;
 }
 
 static void initThreads()
@@ -1451,6 +1717,10 @@ static void initThreads()
       return;
    }
 #endif
+   threads.resize(cores+1);
+   threadDatas.resize(cores+1);
+   data1.resize(cores+1);
+   data2.resize(cores+1);
    for (int i = 1; i <= cores; i++) {
       threadDatas[i].index = i;
       threadDatas[i].searcher = nullptr;
@@ -1460,16 +1730,16 @@ static void initThreads()
 
 static void launch_threads()
 {
-   if (verbose) cout << "launch_threads" << endl;
+   if (trace_threads) cout << "launch_threads" << endl;
    for (int i = 1; i <= cores; i++) {
       threads[i] = std::thread(threadp,&threadDatas[i]);
-      if (verbose) cout << "thread " << i << " created." << endl;
+      if (trace_threads) cout << "thread " << i << " created." << endl;
    }
    // wait for all searchers done
    for (int i = 1; i <= cores; i++) {
       threads[i].join();
    }
-   if (verbose) cout << "all searchers done" << endl;
+   if (trace_threads) cout << "all searchers done" << endl;
 }
 
 static void learn_parse(Phase p, int cores)
@@ -1478,7 +1748,131 @@ static void learn_parse(Phase p, int cores)
       threadDatas[i].phase = p;
    }
    launch_threads();
-   if (p == Phase1) cout << positions.size() << " positions read." << endl;
+   if (p == Phase1 && !cache_out.is_open()) {
+      size_t total = 0;
+      for (int i = 1; i <= cores; i++) {
+         total += data1[i].positions.size();
+      }
+      positions.reserve(total);
+      for (int i = 1; i <= cores; i++) {
+         positions.insert(positions.end(),data1[i].positions.begin(),data1[i].positions.end());
+         vector<PackedPosition>().swap(data1[i].positions);
+      }
+      position_data = positions.data();
+      position_count = positions.size();
+      cout << positions.size() << " positions read." << endl;
+   }
+}
+
+static uint64_t training_file_size()
+{
+   ifstream f(pos_file_name.c_str(), ios::in | ios::binary | ios::ate);
+   return f.good() ? (uint64_t)f.tellg() : 0ULL;
+}
+
+// Map the positions saved by a previous run (or, if packed_input is
+// set, the training file). Returns false if the file does not exist
+// or does not match the training file.
+static bool load_position_cache(MappedFile::Access access = MappedFile::Access::Sequential)
+{
+   std::unique_ptr<MappedFile> file(new MappedFile(cache_file_name,access));
+   if (!file->data()) return false;
+   PackedPositionHeader hdr;
+   if (file->size() < sizeof(hdr)) {
+      cerr << "warning: position cache " << cache_file_name << " is too small, ignoring it" << endl;
+      return false;
+   }
+   std::memcpy(&hdr,file->data(),sizeof(hdr));
+   if (!hdr.valid(file->size())) {
+      cerr << "warning: " << cache_file_name << " is not a valid position cache, ignoring it" << endl;
+      return false;
+   }
+   if (!packed_input && hdr.sourceSize != training_file_size()) {
+      cerr << "warning: position cache " << cache_file_name << " was made from a different training file, ignoring it" << endl;
+      return false;
+   }
+   position_cache = std::move(file);
+   position_data = reinterpret_cast<const PackedPosition *>(position_cache->data() + sizeof(hdr));
+   position_count = hdr.count;
+   return true;
+}
+
+static void write_cache_header(ofstream &out, uint64_t count)
+{
+   const PackedPositionHeader hdr(count,training_file_size());
+   out.write(reinterpret_cast<const char *>(&hdr),sizeof(hdr));
+}
+
+static void save_position_cache()
+{
+   ofstream out(cache_file_name.c_str(), ios::out | ios::binary | ios::trunc);
+   write_cache_header(out,positions.size());
+   out.write(reinterpret_cast<const char *>(positions.data()),positions.size()*sizeof(PackedPosition));
+   if (out.bad() || out.fail()) {
+      cerr << "error writing position cache " << cache_file_name << endl;
+   }
+}
+
+// Sum the phase 2 results from all threads into data2[0]. Pairs of
+// thread buffers are added in parallel, halving the number of buffers
+// at each step.
+static void reduce_results()
+{
+   for (int stride = 1; stride < cores; stride *= 2) {
+      vector<std::thread> workers;
+      for (int i = 1; i + stride <= cores; i += 2*stride) {
+         workers.emplace_back([i,stride]() {
+            data2[i].add(data2[i+stride]);
+         });
+      }
+      for (std::thread &t : workers) {
+         t.join();
+      }
+   }
+   data2[0].add(data2[1]);
+}
+
+// Gather the features recorded by each thread into one array, in
+// position order.
+static void merge_features()
+{
+   features.clear();
+   features.offsets.resize(position_count+1,0);
+   features.constants.resize(position_count,0.0);
+   size_t total = 0;
+   for (int i = 1; i <= cores; i++) {
+      const Parse2Data &data = data2[i];
+      for (size_t j = 0; j < data.featurePositions.size(); j++) {
+         features.offsets[data.featurePositions[j]+1] = data.featureCounts[j];
+         features.constants[data.featurePositions[j]] = data.featureConstants[j];
+      }
+      total += data.featureIndices.size();
+   }
+   for (size_t j = 0; j < position_count; j++) {
+      features.offsets[j+1] += features.offsets[j];
+   }
+   features.indices.resize(total);
+   features.coefs.resize(total);
+   for (int i = 1; i <= cores; i++) {
+      Parse2Data &data = data2[i];
+      size_t src = 0;
+      for (size_t j = 0; j < data.featurePositions.size(); j++) {
+         const size_t dest = features.offsets[data.featurePositions[j]];
+         const uint32_t count = data.featureCounts[j];
+         std::copy(data.featureIndices.begin()+src,data.featureIndices.begin()+src+count,features.indices.begin()+dest);
+         std::copy(data.featureCoefs.begin()+src,data.featureCoefs.begin()+src+count,features.coefs.begin()+dest);
+         src += count;
+      }
+      // free memory
+      vector<size_t>().swap(data.featurePositions);
+      vector<uint32_t>().swap(data.featureCounts);
+      vector<double>().swap(data.featureConstants);
+      vector<uint16_t>().swap(data.featureIndices);
+      vector<float>().swap(data.featureCoefs);
+   }
+   if (verbose) {
+      cout << "features: " << total << " (" << (position_count ? double(total)/position_count : 0.0) << " per position)" << endl;
+   }
 }
 
 static void output_solution(const string &cmd, double obj)
@@ -1507,12 +1901,34 @@ static void output_solution(const string &cmd, double obj)
    if (x0_out.bad() || x0_out.fail()) {
       cerr << "error writing parameters output file" << endl;
    }
+   if (param_file_name.length()) {
+      ofstream values_out(param_file_name.c_str(),ios::out | ios::trunc);
+      values_out << "# Generated " << timestr << " by " << cmd << endl;
+      if (obj != 0) {
+         values_out << "# Final objective value: " << obj << endl;
+      }
+      Params::writeValues(values_out);
+      if (values_out.bad() || values_out.fail()) {
+         cerr << "error writing parameter file" << endl;
+      }
+   }
 }
 
 
+static void report_throughput(const string &pass, size_t count, const CLOCK_TYPE &start)
+{
+   const uint64_t ms = getElapsedTime(start,getCurrentTime());
+   cout << pass << ": " << count << " positions in " << ms << " ms (";
+   if (ms) {
+      cout << uint64_t(1000.0*count/ms);
+   } else {
+      cout << "-";
+   }
+   cout << " positions/sec, " << cores << " thread(s))" << endl;
+}
+
 static void learn()
 {
-   LockInit(data_lock);
    LockInit(file_lock);
 #ifdef _MSC_VER
    double best = 1.0e10;
@@ -1524,6 +1940,7 @@ static void learn()
    vector<double> v(tune_params.numTuningParams(),0.0);
    vector<double> prev_gradient(tune_params.numTuningParams(),0.0);
    vector<double> step_sizes(tune_params.numTuningParams(),0.0);
+   int last_extract = 0;
    for (int iter = 1; iter <= iterations; iter++) {
       if (!test) cout << "iteration " << iter << endl;
       tune_params.applyParams();
@@ -1531,15 +1948,31 @@ static void learn()
          data1[i].clear();
          data2[i].clear();
       }
-      if (iter == 1 ||
+      param_values.resize(tune_params.numTuningParams());
+      for (int i = 0; i < tune_params.numTuningParams(); i++) {
+         param_values[i] = tune_params[i].current;
+      }
+      // features must be recorded when the position set changes
+      bool new_positions = true;
+      if (iter == 1 && !test && cache_file_name.length() &&
+          load_position_cache()) {
+         cout << position_count << " positions read from " << cache_file_name << endl;
+      }
+      else if (packed_input && iter == 1) {
+         cerr << "error: could not read positions from " << pos_file_name << endl;
+         exit(-1);
+      }
+      else if (iter == 1 ||
           (recalc && ((iter-1) % pv_recalc_interval) == 0)) {
          if (verbose) cout << "(re)calculating PVs" << endl;
          // clean up data from previous pass
-         while (!positions.empty()) {
-            delete positions.back();
-            positions.pop_back();
-         }
+         position_cache.reset();
+         positions.clear();
+         const CLOCK_TYPE start = getCurrentTime();
          learn_parse(Phase1, cores);
+         if (verbose) {
+            report_throughput("pass 1",positions.size(),start);
+         }
          // sum results over workers into 1st data element
          for (int i = 1; i <= cores; i++) {
             data1[0].target += data1[i].target;
@@ -1559,16 +1992,31 @@ static void learn()
          // rewind position file
          pos_file.clear();
          pos_file.seekg(0,ios::beg);
+         lines_read = 0;
+         if (cache_file_name.length()) {
+            save_position_cache();
+         }
+      }
+      else {
+         new_positions = false;
+      }
+      extract_features = feature_interval && !batch_size &&
+         (new_positions || iter - last_extract >= feature_interval);
+      if (extract_features) {
+         if (verbose) cout << "recording features" << endl;
+         last_extract = iter;
+         features.clear();
       }
-      phase2_game_index = 0;
+      next_position = 0;
+      const CLOCK_TYPE start = getCurrentTime();
       learn_parse(Phase2, cores);
+      if (extract_features) {
+         merge_features();
+      }
       // sum results over workers into 1st data element
-      for (int i = 1; i <= cores; i++) {
-         data2[0].target += data2[i].target;
-         data2[0].count += data2[i].count;
-         for (int j = 0; j < tune_params.numTuningParams(); j++) {
-            data2[0].grads[j] += data2[i].grads[j];
-         }
+      reduce_results();
+      if (verbose) {
+         report_throughput("pass 2",position_count,start);
       }
       data2[0].target /= data2[0].count;
       const double obj = data2[0].target + calc_penalty();
@@ -1583,10 +2031,182 @@ static void learn()
       adjust_params(data2[0],historical_grad,m,v,prev_gradient,step_sizes,iter);
    }
 
-   LockFree(data_lock);
    LockFree(file_lock);
 }
 
+// Write the positions from phase 1 to the cache file as they are
+// found, and map the file. Returns false on error.
+static bool stream_position_cache()
+{
+   cache_out.open(cache_file_name.c_str(), ios::out | ios::binary | ios::trunc);
+   if (!cache_out.good()) {
+      cerr << "error opening position cache " << cache_file_name << endl;
+      return false;
+   }
+   // header is rewritten with the final count
+   write_cache_header(cache_out,0);
+   cache_out_count = 0;
+   learn_parse(Phase1, cores);
+   cache_out.seekp(0,ios::beg);
+   write_cache_header(cache_out,cache_out_count);
+   const bool ok = !cache_out.bad() && !cache_out.fail();
+   cache_out.close();
+   if (!ok) {
+      cerr << "error writing position cache " << cache_file_name << endl;
+      return false;
+   }
+   cout << cache_out_count << " positions written to " << cache_file_name << endl;
+   return load_position_cache(MappedFile::Access::Random);
+}
+
+// Compute the objective (without penalty) over "count" positions.
+static double batch_objective(const PackedPosition *data, size_t count)
+{
+   position_data = data;
+   position_count = count;
+   for (int i = 0; i <= cores; i++) {
+      data2[i].clear();
+   }
+   objective_only = true;
+   next_position = 0;
+   learn_parse(Phase2, cores);
+   objective_only = false;
+   reduce_results();
+   return data2[0].count ? data2[0].target/data2[0].count : 0.0;
+}
+
+// Mini-batch tuning. The positions are memory-mapped from the cache
+// file (-b), so they need not fit in memory. The file is divided into
+// blocks of BATCH_BLOCK_SIZE positions, and the last validation_percent
+// of the blocks are held out to measure the objective. Each epoch
+// visits the other blocks in a new random order, and the parameters
+// are adjusted after each batch of blocks. While one batch is
+// processed, the next one is copied from the file into a second
+// buffer by a background thread.
+static void learn_batches()
+{
+   LockInit(file_lock);
+   LockInit(cache_lock);
+   tune_params.applyParams();
+   if (load_position_cache(MappedFile::Access::Random)) {
+      cout << position_count << " positions read from " << cache_file_name << endl;
+   } else if (packed_input || !stream_position_cache()) {
+      exit(-1);
+   }
+   const PackedPosition *mapped = position_data;
+   const size_t mapped_count = position_count;
+   const size_t blocks = (mapped_count+BATCH_BLOCK_SIZE-1)/BATCH_BLOCK_SIZE;
+   size_t validation_blocks = blocks*validation_percent/100;
+   if (validation_percent && !validation_blocks && blocks > 1) {
+      validation_blocks = 1;
+   }
+   const size_t training_blocks = blocks - validation_blocks;
+   if (!training_blocks) {
+      cerr << "error: no positions for training" << endl;
+      exit(-1);
+   }
+   const size_t validation_start = std::min<size_t>(training_blocks*BATCH_BLOCK_SIZE,mapped_count);
+   const size_t validation_count = mapped_count - validation_start;
+   const size_t batch_blocks = std::max<size_t>(1,batch_size/BATCH_BLOCK_SIZE);
+   const size_t batches = (training_blocks+batch_blocks-1)/batch_blocks;
+   cout << validation_start << " training positions, " <<
+      validation_count << " validation positions, " << batches <<
+      " batches of " << batch_blocks*BATCH_BLOCK_SIZE << " positions" << endl;
+
+   vector<size_t> order(training_blocks);
+   for (size_t i = 0; i < training_blocks; i++) {
+      order[i] = i;
+   }
+   std::mt19937_64 engine(getRandomSeed());
+   auto fill = [&](vector<PackedPosition> &buf, size_t batch) {
+      buf.clear();
+      const size_t last = std::min<size_t>((batch+1)*batch_blocks,training_blocks);
+      for (size_t b = batch*batch_blocks; b < last; b++) {
+         const size_t start = order[b]*BATCH_BLOCK_SIZE;
+         const size_t end = std::min<size_t>(start+BATCH_BLOCK_SIZE,mapped_count);
+         buf.insert(buf.end(),mapped+start,mapped+end);
+      }
+   };
+   vector<PackedPosition> buffers[2];
+
+#ifdef _MSC_VER
+   double best = 1.0e10;
+#else
+   double best = numeric_limits<double>::max();
+#endif
+   auto check_best = [&](const char *label, double target) {
+      const double obj = target + calc_penalty();
+      cout << label << " target=" << target << " penalty=" << calc_penalty() << " objective=" << obj << endl;
+      if (obj < best) {
+         best = obj;
+         cout << "new best objective: " << best << endl;
+         output_solution(cmdline,obj);
+      }
+   };
+   vector<double> historical_grad(tune_params.numTuningParams(),0.0);
+   vector<double> m(tune_params.numTuningParams(),0.0);
+   vector<double> v(tune_params.numTuningParams(),0.0);
+   vector<double> prev_gradient(tune_params.numTuningParams(),0.0);
+   vector<double> step_sizes(tune_params.numTuningParams(),0.0);
+   int step = 0;
+   for (int epoch = 1; epoch <= iterations; epoch++) {
+      cout << "epoch " << epoch << endl;
+      std::shuffle(order.begin(),order.end(),engine);
+      fill(buffers[0],0);
+      double training_target = 0.0;
+      size_t training_count = 0;
+      const CLOCK_TYPE start = getCurrentTime();
+      for (size_t batch = 0; batch < batches; batch++) {
+         std::thread reader;
+         if (batch+1 < batches) {
+            reader = std::thread(fill,std::ref(buffers[(batch+1)%2]),batch+1);
+         }
+         const vector<PackedPosition> &buf = buffers[batch%2];
+         tune_params.applyParams();
+         for (int i = 0; i <= cores; i++) {
+            data2[i].clear();
+         }
+         position_data = buf.data();
+         position_count = buf.size();
+         next_position = 0;
+         learn_parse(Phase2, cores);
+         reduce_results();
+         training_target += data2[0].target;
+         training_count += data2[0].count;
+         if (verbose) {
+            cout << "batch " << batch+1 << " target=" << (data2[0].count ? data2[0].target/data2[0].count : 0.0) << endl;
+         }
+         adjust_params(data2[0],historical_grad,m,v,prev_gradient,step_sizes,++step,
+                       double(buf.size())/validation_start);
+         if (reader.joinable()) {
+            reader.join();
+         }
+         if (validation_interval && validation_count &&
+             step % validation_interval == 0 && batch+1 < batches) {
+            tune_params.applyParams();
+            check_best("validation",batch_objective(mapped+validation_start,validation_count));
+         }
+      }
+      if (verbose) {
+         report_throughput("epoch",validation_start,start);
+      }
+      // the training objective is the mean over batches, with the
+      // parameters changing during the epoch
+      const double training_obj = training_count ? training_target/training_count : 0.0;
+      tune_params.applyParams();
+      if (validation_count) {
+         cout << "training target=" << training_obj << endl;
+         check_best("validation",batch_objective(mapped+validation_start,validation_count));
+      } else {
+         check_best("training",training_obj);
+      }
+   }
+   position_data = mapped;
+   position_count = mapped_count;
+   LockFree(file_lock);
+   LockFree(cache_lock);
+}
+
 int CDECL main(int argc, char **argv)
 {
     Bitboard::init();
@@ -1645,9 +2265,54 @@ int CDECL main(int argc, char **argv)
           ++arg;
           iterations = atoi(argv[arg]);
        }
-       else if (strcmp(argv[arg],"-c")==0) {
+       else if (strcmp(argv[arg],"-B")==0) {
+          if (++arg >= argc) {
+             cerr << "expected integer after -B" << endl;
+             exit(-1);
+          }
+          const long n = atol(argv[arg]);
+          if (n < 1) {
+             cerr << "invalid batch size: " << argv[arg] << endl;
+             exit(-1);
+          }
+          batch_size = size_t(n);
+       }
+       else if (strcmp(argv[arg],"-E")==0) {
+          if (++arg >= argc) {
+             cerr << "expected integer after -E" << endl;
+             exit(-1);
+          }
+          validation_interval = atoi(argv[arg]);
+       }
+       else if (strcmp(argv[arg],"-H")==0) {
+          if (++arg >= argc) {
+             cerr << "expected integer after -H" << endl;
+             exit(-1);
+          }
+          validation_percent = atoi(argv[arg]);
+          if (validation_percent < 0 || validation_percent >= 100) {
+             cerr << "invalid validation percentage: " << argv[arg] << endl;
+             exit(-1);
+          }
+       }
+       else if (strcmp(argv[arg],"-b")==0) {
           ++arg;
+          if (arg >= argc) {
+             usage();
+             exit(-1);
+          }
+          cache_file_name = argv[arg];
+       }
+       else if (strcmp(argv[arg],"-c")==0) {
+          if (++arg >= argc) {
+             usage();
+             exit(-1);
+          }
           cores = atoi(argv[arg]);
+          if (cores < 1) {
+             cerr << "invalid core count: " << argv[arg] << endl;
+             exit(-1);
+          }
        }
        else if (strcmp(argv[arg],"-t")==0) {
           test = true;
@@ -1655,6 +2320,9 @@ int CDECL main(int argc, char **argv)
        else if (strcmp(argv[arg],"-v")==0) {
           verbose = true;
        }
+       else if (strcmp(argv[arg],"-T")==0) {
+          trace_threads = true;
+       }
        else if (strcmp(argv[arg],"-V")==0) {
           validate = true;
        }
@@ -1701,6 +2369,24 @@ int CDECL main(int argc, char **argv)
              exit(-1);
           }
           pv_recalc_interval = atoi(argv[++arg]);
+       }
+       else if (strcmp(argv[arg],"-P")==0) {
+          if (++arg >= argc) {
+             usage();
+             exit(-1);
+          }
+          param_file_name = argv[arg];
+       }
+       else if (strcmp(argv[arg],"-F")==0) {
+          if (++arg >= argc) {
+             cerr << "expected integer after -F" << endl;
+             exit(-1);
+          }
+          feature_interval = atoi(argv[arg]);
+          if (feature_interval < 1) {
+             cerr << "invalid feature interval: " << argv[arg] << endl;
+             exit(-1);
+          }
        } else {
           cerr << "invalid option: " << argv[arg] << endl;
           usage();
@@ -1719,6 +2405,18 @@ int CDECL main(int argc, char **argv)
       exit(0);
     }
 
+    if (tune_params.numTuningParams() > 65536) {
+       cerr << "error: too many parameters for feature index" << endl;
+       exit(-1);
+    }
+
+    if (batch_size) {
+       if (test || recalc) {
+          cerr << "error: -B is not compatible with -t or -R" << endl;
+          exit(-1);
+       }
+    }
+
     if (validate && cores > 1) {
        cerr << "error: validation (-V) does not work with multiple threads" << endl;
        exit(-1);
@@ -1753,13 +2451,36 @@ int CDECL main(int argc, char **argv)
 
     if (verbose) cout << "game file: " << pos_file_name << endl;
 
-    pos_file.open(pos_file_name.c_str());
+    pos_file.open(pos_file_name.c_str(), ios::in | ios::binary);
 
     if (pos_file.fail()) {
        cerr << "failed to open file " << pos_file_name << endl;
        exit(-1);
     }
 
+    // A file of positions (from datagen) is mapped like a position
+    // cache, instead of being read in phase 1.
+    char magic[sizeof(PACKED_POSITION_MAGIC)];
+    if (pos_file.read(magic,sizeof(magic)) &&
+        std::memcmp(magic,PACKED_POSITION_MAGIC,sizeof(magic)) == 0) {
+       if (test || recalc) {
+          cerr << "error: -t and -R require an EPD training file" << endl;
+          exit(-1);
+       }
+       if (cache_file_name.length()) {
+          cerr << "warning: " << pos_file_name << " contains positions, ignoring -b" << endl;
+       }
+       packed_input = true;
+       cache_file_name = pos_file_name;
+    }
+    pos_file.clear();
+    pos_file.seekg(0,ios::beg);
+
+    if (batch_size && !cache_file_name.length()) {
+       cerr << "error: mini-batch mode (-B) requires a position cache file (-b) or a position file from datagen" << endl;
+       exit(-1);
+    }
+
     cout << "parameter count: " << tune_params.numTuningParams() << " (";
     int tunable = 0;
     for (const TuneParam &p : tune_params) {
@@ -1769,7 +2490,11 @@ int CDECL main(int argc, char **argv)
 
     initThreads();
 
-    learn();
+    if (batch_size) {
+       learn_batches();
+    } else {
+       learn();
+    }
 
     return 0;
 }
@@ -2,14 +2,19 @@
 
 // Unit tests for Arasan
 
+#include "bhash.h"
 #include "board.h"
 #include "boardio.h"
+#include "bookread.h"
+#include "bookwrit.h"
 #include "legal.h"
 #include "movegen.h"
 #include "options.h"
+#include "perft.h"
 #include "movearr.h"
 #include "notation.h"
 #include "chessio.h"
+#include "learn.h"
 #include "scoring.h"
 #include "search.h"
 #include "globals.h"
@@ -18,6 +23,7 @@
 #endif
 #include <algorithm>
 #include <iostream>
+#include <memory>
 #include <regex>
 #include <set>
 #include <string>
@@ -214,6 +220,35 @@ static int testSee() {
           }
        }
     }
+
+    // batched SEE must agree with single-move SEE for all captures
+    for (int i = 0; i < 25; i++) {
+       const Board &board = seeData[i].board;
+       if (board.checkStatus() == InCheck) continue;
+       MoveGenerator mg(board);
+       Move moves[Constants::MaxMoves];
+       const int count = mg.generateCaptures(moves);
+       Move list[Constants::MaxMoves];
+       int n = 0;
+       for (int j = 0; j < count; j++) {
+          if (Capture(moves[j]) != Empty && Capture(moves[j]) != King) {
+             list[n++] = moves[j];
+          }
+       }
+       score_t scores[Constants::MaxMoves], signs[Constants::MaxMoves];
+       seeBatch(board,list,n,scores);
+       seeSignBatch(board,list,n,seeData[i].result,signs);
+       for (int j = 0; j < n; j++) {
+          if (scores[j] != see(board,list[j])) {
+             cerr << "seeBatch: error in case " << i << endl;
+             ++errs;
+          }
+          if ((signs[j] != 0) != (seeSign(board,list[j],seeData[i].result) != 0)) {
+             cerr << "seeSignBatch: error in case " << i << endl;
+             ++errs;
+          }
+       }
+    }
     return errs;
 }
 
@@ -522,6 +557,113 @@ static int testEval() {
     return errs;
 }
 
+static int testParamFile() {
+    int errs = 0;
+    Board board;
+    // White has the bishop pair
+    if (!BoardIO::readFEN(board, "r1bqk2r/pppp1ppp/2n2n2/4p3/2B1P3/2N2N2/PPPP1PPP/R1BQK2R w KQkq -")) {
+        cerr << "testParamFile: error in FEN" << endl;
+        return 1;
+    }
+    Scoring *s = new Scoring();
+    const score_t eval = s->evalu8(board);
+    delete s;
+    stringstream original;
+    Params::writeValues(original);
+
+    string err;
+    stringstream changed("# comment\n\nBISHOP_PAIR_MID 200\nBISHOP_PAIR_END 200\n");
+    if (!Params::readValues(changed,err)) {
+        cerr << "testParamFile: read failed: " << err << endl;
+        ++errs;
+    }
+    else if (Params::BISHOP_PAIR_MID != 200 || Params::BISHOP_PAIR_END != 200) {
+        cerr << "testParamFile: values not set" << endl;
+        ++errs;
+    }
+    s = new Scoring();
+    if (s->evalu8(board) <= eval) {
+        cerr << "testParamFile: eval not changed" << endl;
+        ++errs;
+    }
+    delete s;
+
+    // files with errors do not change any values
+    static const string bad[3] = {
+        "BISHOP_PAIR_MID 100\nNO_SUCH_PARAM 1\n",
+        "BISHOP_PAIR_MID 100\nKNIGHT_MOBILITY 1 2 3\n",
+        "BISHOP_PAIR_MID 100 x\n"
+    };
+    for (int i = 0; i < 3; i++) {
+        stringstream in(bad[i]);
+        if (Params::readValues(in,err)) {
+            cerr << "testParamFile: error not detected in case " << i << endl;
+            ++errs;
+        }
+        else if (Params::BISHOP_PAIR_MID != 200) {
+            cerr << "testParamFile: value changed by bad file in case " << i << endl;
+            ++errs;
+        }
+    }
+
+    // reading a complete file restores the original values
+    stringstream in(original.str());
+    if (!Params::readValues(in,err)) {
+        cerr << "testParamFile: error reading written values: " << err << endl;
+        ++errs;
+    }
+    stringstream out;
+    Params::writeValues(out);
+    if (out.str() != original.str()) {
+        cerr << "testParamFile: values not restored from file" << endl;
+        ++errs;
+    }
+    s = new Scoring();
+    if (s->evalu8(board) != eval) {
+        cerr << "testParamFile: eval not restored" << endl;
+        ++errs;
+    }
+    delete s;
+
+    // piece-square values: only White has a knight
+    Board board2;
+    if (!BoardIO::readFEN(board2, "4k3/8/8/8/8/2N5/8/4K3 w - -")) {
+        cerr << "testParamFile: error in FEN" << endl;
+        return ++errs;
+    }
+    s = new Scoring();
+    const score_t eval2 = s->evalu8(board2);
+    stringstream pst;
+    pst << "KNIGHT_PST";
+    for (int i = 0; i < 2*64; i++) pst << " 900";
+    pst << endl;
+    if (!Params::readValues(pst,err)) {
+        cerr << "testParamFile: read failed: " << err << endl;
+        ++errs;
+    }
+    // existing boards must recompute their piece-square sums
+    board2.setSecondaryVars();
+    if (s->evalu8(board2) <= eval2) {
+        cerr << "testParamFile: eval not changed by PST values" << endl;
+        ++errs;
+    }
+
+    Params::restoreDefaults();
+    stringstream restored;
+    Params::writeValues(restored);
+    if (restored.str() != original.str()) {
+        cerr << "testParamFile: defaults not restored" << endl;
+        ++errs;
+    }
+    board2.setSecondaryVars();
+    if (s->evalu8(board2) != eval2) {
+        cerr << "testParamFile: eval not restored after PST change" << endl;
+        ++errs;
+    }
+    delete s;
+    return errs;
+}
+
 static int testBitbases() {
     // verify eval results are symmetrical (White/Black)
     const int CASES = 8;
@@ -1051,10 +1193,160 @@ static int testHash() {
         cerr << "testHash case 6: expected valid move" << endl;
     }
 
+    // Codes differing only in their high-order bits map to the same
+    // bucket. A full bucket should hold Hash::BucketSize entries.
+    hashTable.clearHash();
+    const hash_t base = 0x123456789abcdefULL;
+    for (int i = 0; i < Hash::BucketSize; i++) {
+        hashTable.storeHash(base + (hash_t(i+1) << 40),i+1,1,HashEntry::Valid,
+                            score_t(i),Constants::INVALID_SCORE,0,NullMove);
+    }
+    for (int i = 0; i < Hash::BucketSize; i++) {
+        HashEntry he5;
+        if (hashTable.searchHash(base + (hash_t(i+1) << 40), 0, 1, he5) != HashEntry::Valid ||
+            he5.getValue() != score_t(i) || he5.depth() != i+1) {
+            ++errs;
+            cerr << "testHash case 7: entry " << i << " not found" << endl;
+        }
+    }
+    // a further store in the same bucket replaces the lowest-depth entry
+    hashTable.storeHash(base + (hash_t(Hash::BucketSize+1) << 40),10,1,HashEntry::Valid,
+                        0,Constants::INVALID_SCORE,0,NullMove);
+    HashEntry he5;
+    if (hashTable.searchHash(base + (hash_t(1) << 40), 0, 1, he5) != HashEntry::NoHit) {
+        ++errs;
+        cerr << "testHash case 7: expected entry to be replaced" << endl;
+    }
+    if (hashTable.searchHash(base + (hash_t(Hash::BucketSize+1) << 40), 0, 1, he5) != HashEntry::Valid) {
+        ++errs;
+        cerr << "testHash case 7: new entry not found" << endl;
+    }
+
+    // save and reload into a table of a different size
+    const string hashFile("unit_test.hsh");
+    if (!hashTable.saveHash(hashFile,7)) {
+        ++errs;
+        cerr << "testHash case 8: save failed" << endl;
+    }
+    else {
+        Hash loaded;
+        loaded.initHash(100000);
+        unsigned age = 0;
+        if (!loaded.loadHash(hashFile,age)) {
+            ++errs;
+            cerr << "testHash case 8: load failed" << endl;
+        }
+        else {
+            if (age != 7 || loaded.getHashSize() != hashTable.getHashSize() ||
+                loaded.pctFull() != hashTable.pctFull()) {
+                ++errs;
+                cerr << "testHash case 8: header mismatch" << endl;
+            }
+            if (loaded.searchHash(base + (hash_t(Hash::BucketSize+1) << 40), 0, 1, he5) != HashEntry::Valid ||
+                he5.depth() != 10) {
+                ++errs;
+                cerr << "testHash case 8: entry not found after load" << endl;
+            }
+        }
+        loaded.freeHash();
+        remove(hashFile.c_str());
+        if (loaded.loadHash(hashFile,age)) {
+            ++errs;
+            cerr << "testHash case 8: load of missing file succeeded" << endl;
+        }
+    }
+
     options.learning.position_learning = tmp;
     return errs;
 }
 
+static int testLearn()
+{
+   int errs = 0;
+   const string storeFile("unit_test.lrb"), textFile("unit_test.lrn");
+   remove(storeFile.c_str());
+   // old format text file, with a repeated position
+   {
+      ofstream text(textFile.c_str());
+      text << "123456789abcdef 0 -50 9 e2-e4\n";
+      text << "fedcba987654321 1 120 12 a7-a8=N\n";
+      text << "123456789abcdef 0 -75 11 d2-d4\n";
+   }
+   if (LearnStore::importText(textFile,storeFile) != 3) {
+      cerr << "testLearn: text import failed" << endl;
+      ++errs;
+   }
+   remove(textFile.c_str());
+   LearnStore store;
+   if (!store.open(storeFile,LearnStore::Mode::ReadWrite)) {
+      cerr << "testLearn: open failed" << endl;
+      return ++errs;
+   }
+   LearnRecord rec;
+   if (store.count() != 2) {
+      cerr << "testLearn: wrong count" << endl;
+      ++errs;
+   }
+   if (!store.find(0x123456789abcdefULL,rec) || rec.score != -75 ||
+       rec.depth != 11 || rec.start != D2 || rec.dest != D4 ||
+       rec.in_check) {
+      cerr << "testLearn: wrong record for repeated position" << endl;
+      ++errs;
+   }
+   if (!store.find(0xfedcba987654321ULL,rec) || rec.promotion != Knight ||
+       !rec.in_check || rec.dest != A8) {
+      cerr << "testLearn: wrong record for promotion" << endl;
+      ++errs;
+   }
+   // enough positions to enlarge the table several times
+   const int N = 20000;
+   for (int i = 1; i <= N; i++) {
+      rec.hashcode = hash_t(i)*0x9e3779b97f4a7c15ULL;
+      rec.in_check = 0;
+      rec.score = i % 1000;
+      rec.depth = i % 64;
+      rec.start = rec.dest = InvalidSquare;
+      rec.promotion = Empty;
+      if (!store.add(rec)) {
+         cerr << "testLearn: add failed" << endl;
+         ++errs;
+         break;
+      }
+   }
+   store.close();
+   if (!store.open(storeFile,LearnStore::Mode::ReadOnly)) {
+      cerr << "testLearn: reopen failed" << endl;
+      return ++errs;
+   }
+   int found = 0;
+   store.forEach([&found](const LearnRecord &) { ++found; });
+   if (store.count() != N+2 || found != N+2) {
+      cerr << "testLearn: wrong count after adding positions" << endl;
+      ++errs;
+   }
+   for (int i = 1; i <= N; i++) {
+      if (!store.find(hash_t(i)*0x9e3779b97f4a7c15ULL,rec) ||
+          rec.score != i % 1000 || rec.depth != i % 64 ||
+          rec.start != InvalidSquare) {
+         cerr << "testLearn: wrong record after adding positions" << endl;
+         ++errs;
+         break;
+      }
+   }
+   if (!store.find(0x123456789abcdefULL,rec) || rec.score != -75) {
+      cerr << "testLearn: record lost when table enlarged" << endl;
+      ++errs;
+   }
+   // read-only store cannot be updated
+   if (store.add(rec)) {
+      cerr << "testLearn: add to read-only store" << endl;
+      ++errs;
+   }
+   store.close();
+   remove(storeFile.c_str());
+   return errs;
+}
+
 static int testRep()
 {
     const string fen = "8/B2nk3/8/8/3K4/7B/8/8 w - - 0 2";
@@ -1351,6 +1643,404 @@ static int testPerft()
          cerr << "testPerft: error in test case " << i << " wrong result: " << result << endl;
          ++errs;
       }
+      const uint64_t expected = RootMoveGenerator::perft(board,acase.depth-1,true);
+      if ((result = RootMoveGenerator::perft(board,acase.depth-1,false)) != expected) {
+         cerr << "testPerft: error in test case " << i << " wrong pseudo-legal result: " << result << endl;
+         ++errs;
+      }
+      // multi-threaded, with hash table and divide
+      Perft perft(3,1024*1024,i%2 == 0);
+      vector<Perft::DivideEntry> divide;
+      if ((result = perft.run(board,acase.depth-1,&divide)) != expected) {
+         cerr << "testPerft: error in test case " << i << " wrong threaded result: " << result << endl;
+         ++errs;
+      }
+      uint64_t sum = 0ULL;
+      for (const Perft::DivideEntry &entry : divide) {
+         Board b(board);
+         b.doMove(entry.move);
+         sum += entry.nodes;
+         if (entry.nodes != RootMoveGenerator::perft(b,acase.depth-2,true)) {
+            cerr << "testPerft: error in test case " << i << " wrong divide count" << endl;
+            ++errs;
+         }
+      }
+      if (sum != expected) {
+         cerr << "testPerft: error in test case " << i << " divide counts do not add up" << endl;
+         ++errs;
+      }
+      if (board.checkStatus() != InCheck) {
+         // staged generation in legal mode returns the same moves
+         Move moves[Constants::MaxMoves];
+         MoveGenerator mg(board);
+         const int n = mg.generateLegalMoves(moves);
+         MoveGenerator staged(board);
+         staged.setLegal();
+         Move m;
+         int order, count = 0;
+         while (!IsNull(m = staged.nextMove(order))) {
+            if (std::find_if(moves,moves+n,[&m](const Move &x) {return MovesEqual(x,m);}) == moves+n) {
+               cerr << "testPerft: error in test case " << i << " illegal move generated" << endl;
+               ++errs;
+            }
+            ++count;
+         }
+         if (count != n) {
+            cerr << "testPerft: error in test case " << i << " wrong staged move count" << endl;
+            ++errs;
+         }
+      }
+   }
+   return errs;
+}
+
+#ifndef TUNE
+static int pstWalk(Board &board, int depth)
+{
+   // compare incrementally updated piece-square sums with a
+   // full recomputation
+   int errs = 0;
+   Board copy(board);
+   copy.setSecondaryVars();
+   for (int i = 0; i < 2; i++) {
+      const ColorType side = (ColorType)i;
+      if (board.pstScore(side).mid != copy.pstScore(side).mid ||
+          board.pstScore(side).end != copy.pstScore(side).end) {
+         cerr << "testPst: incorrect value for " << ColorImage(side) <<
+            " in position " << endl << board << endl;
+         return 1;
+      }
+   }
+   if (depth == 0) return 0;
+   RootMoveGenerator mg(board);
+   BoardState state = board.state;
+   Move m;
+   int order;
+   while (!errs && (m = mg.nextMove(order)) != NullMove) {
+      board.doMove(m);
+      errs += pstWalk(board, depth-1);
+      board.undoMove(m,state);
+   }
+   return errs;
+}
+
+static int testPst()
+{
+   // positions include castling, promotion and en passant moves
+   static const string fens[4] = {
+      "r3k2r/1b4bq/8/8/8/8/7B/R3K2R w KQkq - 0 1",
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+      "n1n5/PPPk4/8/8/8/8/4Kppp/5N1N b - - 0 1",
+      "8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1"
+   };
+   int errs = 0;
+   for (int i = 0; i < 4; i++) {
+      Board board;
+      if (!BoardIO::readFEN(board, fens[i].c_str())) {
+         cerr << "testPst: error in FEN: " << fens[i] << endl;
+         ++errs;
+         continue;
+      }
+      errs += pstWalk(board, 3);
+   }
+   return errs;
+}
+#endif
+
+static int nnueWalk(const nnue::Network &net, Board &board, int depth)
+{
+   // compare the incrementally updated evaluation with one computed
+   // from scratch, and the SIMD kernel with the scalar one
+   Board copy(board);
+   const score_t incremental = net.evaluate(board);
+   const score_t full = net.evaluate(copy);
+   const score_t scalar = net.evaluate(board,true);
+   if (incremental != full || scalar != full) {
+      cerr << "testNNUE: evaluation mismatch (" << incremental << ", " <<
+         full << ", " << scalar << ") in position " << endl << board << endl;
+      return 1;
+   }
+   if (depth == 0) return 0;
+   BoardState state = board.state;
+   board.doNull();
+   int errs = nnueWalk(net, board, 0);
+   board.undoNull(state);
+   RootMoveGenerator mg(board);
+   Move m;
+   int order;
+   while (!errs && (m = mg.nextMove(order)) != NullMove) {
+      board.doMove(m);
+      errs += nnueWalk(net, board, depth-1);
+      board.undoMove(m,state);
+   }
+   return errs;
+}
+
+static int testBook()
+{
+   int errs = 0;
+   // positions after 2 plies from the start
+   vector<Board> boards;
+   Board start;
+   RootMoveGenerator mg(start);
+   Move m;
+   int order = 0;
+   while ((m = mg.nextMove(order)) != NullMove) {
+      Board board(start);
+      board.doMove(m);
+      RootMoveGenerator mg2(board);
+      Move m2;
+      while ((m2 = mg2.nextMove(order)) != NullMove) {
+         Board board2(board);
+         board2.doMove(m2);
+         boards.push_back(board2);
+      }
+   }
+   // add the first two moves for each position, plus a duplicate
+   // move (ignored by the writer)
+   BookWriter writer;
+   for (const Board &board : boards) {
+      writer.add(board.hashCode(), 0, book::NO_RECOMMEND, 10, 10, 10);
+      writer.add(board.hashCode(), 1, book::NO_RECOMMEND, 5, 5, 10);
+      writer.add(board.hashCode(), 1, book::NO_RECOMMEND, 50, 50, 50);
+   }
+   const string bookFile("unit_test.bin");
+   if (writer.write(bookFile.c_str())) {
+      cerr << "testBook: book write failed" << endl;
+      return 1;
+   }
+   BookReader reader;
+   if (reader.open(bookFile.c_str())) {
+      cerr << "testBook: book open failed" << endl;
+      ++errs;
+   }
+   else {
+      for (const Board &board : boards) {
+         Move move_list[Constants::MaxMoves];
+         RootMoveGenerator mg3(board);
+         (void)mg3.generateAllMoves(move_list,1);
+         vector<Move> moves;
+         if (reader.book_moves(board,moves) != 2 ||
+             !MovesEqual(moves[0],move_list[0]) ||
+             !MovesEqual(moves[1],move_list[1])) {
+            cerr << "testBook: wrong book moves for " << board << endl;
+            ++errs;
+            break;
+         }
+      }
+      vector<Move> moves;
+      if (reader.book_moves(start,moves) != 0) {
+         cerr << "testBook: unexpected book moves for start position" << endl;
+         ++errs;
+      }
+      if (reader.is_writable()) {
+         cerr << "testBook: book opened writable" << endl;
+         ++errs;
+      }
+      reader.close();
+   }
+   // book learning updates the counts in the file
+   if (reader.open(bookFile.c_str(),Options::BookFormat::Arasan,true) ||
+       !reader.is_writable()) {
+      cerr << "testBook: writable book open failed" << endl;
+      ++errs;
+   }
+   else {
+      const Board &board = boards[0];
+      Move move_list[Constants::MaxMoves];
+      RootMoveGenerator mg3(board);
+      (void)mg3.generateAllMoves(move_list,1);
+      // cache the position's moves, before updating them
+      vector<book::DataEntry> results;
+      (void)reader.lookup(board,results);
+      if (!reader.learn(board,move_list[1],BookReader::Outcome::Win) ||
+          !reader.learn(board,move_list[1],BookReader::Outcome::Draw) ||
+          !reader.learn(board,move_list[0],BookReader::Outcome::Loss) ||
+          reader.learn(board,move_list[2],BookReader::Outcome::Win) ||
+          reader.learn(start,move_list[0],BookReader::Outcome::Win)) {
+         cerr << "testBook: book learning failed" << endl;
+         ++errs;
+      }
+      auto countsOk = [&]() {
+         return reader.lookup(board,results) == 2 &&
+            results[0].win == 10 && results[0].loss == 11 && results[0].draw == 10 &&
+            results[1].win == 6 && results[1].loss == 5 && results[1].draw == 11;
+      };
+      // the cached entry must not be used after the update
+      if (!countsOk()) {
+         cerr << "testBook: stale counts after book learning" << endl;
+         ++errs;
+      }
+      reader.close();
+      // reopen read-only and check the counts
+      if (reader.open(bookFile.c_str()) || !countsOk()) {
+         cerr << "testBook: wrong counts after book learning" << endl;
+         ++errs;
+      }
+      // updates through another reader of the same file (as in
+      // another process) are seen by cached lookups
+      BookReader other;
+      if (other.open(bookFile.c_str(),Options::BookFormat::Arasan,true) ||
+          !other.learn(board,move_list[0],BookReader::Outcome::Win) ||
+          reader.lookup(board,results) != 2 || results[0].win != 11) {
+         cerr << "testBook: update by another reader not seen" << endl;
+         ++errs;
+      }
+      other.close();
+      // cached lookups return the same moves
+      for (int i = 0; i < 2; i++) {
+         for (const Board &b : boards) {
+            vector<book::DataEntry> again;
+            if (reader.lookup(b,results) != 2 || reader.lookup(b,again) != 2 ||
+                results[0].index != again[0].index ||
+                results[1].count() != again[1].count()) {
+               cerr << "testBook: cached lookup mismatch" << endl;
+               ++errs;
+               break;
+            }
+         }
+      }
+      // pick prefetches the replies to the move chosen
+      if (IsNull(reader.pick(boards[0]))) {
+         cerr << "testBook: no book move picked" << endl;
+         ++errs;
+      }
+      reader.close();
+   }
+   // the streaming writer requires positions in hash code order
+   BookStreamWriter streamWriter;
+   vector<book::MoveEntry> entries(1);
+   if (streamWriter.open(bookFile) ||
+       streamWriter.add(2ULL, entries) ||
+       !streamWriter.add(1ULL, entries) ||
+       streamWriter.close() ||
+       streamWriter.positionCount() != 1) {
+      cerr << "testBook: stream writer failed" << endl;
+      ++errs;
+   }
+   remove(bookFile.c_str());
+   return errs;
+}
+
+static int testPolyglot()
+{
+   int errs = 0;
+   // reference keys from the Polyglot book format specification
+   static const struct {
+      const char *fen;
+      hash_t key;
+   } cases[] = {
+      {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 0x463b96181691fc9cULL},
+      {"rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1", 0x823c9b50fd114196ULL},
+      {"rnbqkbnr/ppp1pppp/8/3p4/4P3/8/PPPP1PPP/RNBQKBNR w KQkq d6 0 2", 0x0756b94461c50fb0ULL},
+      {"rnbqkbnr/ppp1pppp/8/3pP3/8/8/PPPP1PPP/RNBQKBNR b KQkq - 0 2", 0x662fafb965db29d4ULL},
+      {"rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3", 0x22a48b5a8e47ff78ULL},
+      {"rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPPKPPP/RNBQ1BNR b kq - 0 3", 0x652a607ca3f242c1ULL},
+      {"rnbq1bnr/ppp1pkpp/8/3pPp2/8/8/PPPPKPPP/RNBQ1BNR w - - 0 4", 0x00fdd303c946bdd9ULL},
+      {"rnbqkbnr/p1pppppp/8/8/PpP4P/8/1P1PPPP1/RNBQKBNR b KQkq c3 0 3", 0x3c8123ea7b067637ULL},
+      {"rnbqkbnr/p1pppppp/8/8/P6P/R1p5/1P1PPPP1/1NBQKBNR b Kkq - 0 4", 0x5c3f9b829b279560ULL}
+   };
+   for (const auto &c : cases) {
+      Board board;
+      if (!BoardIO::readFEN(board, c.fen)) {
+         cerr << "testPolyglot: error in FEN: " << c.fen << endl;
+         ++errs;
+      }
+      else if (BoardHash::polyglotHashCode(board) != c.key) {
+         cerr << "testPolyglot: wrong key for " << c.fen << endl;
+         ++errs;
+      }
+   }
+
+   // write and read back a small book, including a castling move
+   Board start, castle;
+   if (!BoardIO::readFEN(castle, "r1bqk1nr/pppp1ppp/2n5/2b1p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4")) {
+      cerr << "testPolyglot: error in FEN" << endl;
+      return ++errs;
+   }
+   const Move e4 = Notation::value(start,White,Notation::InputFormat::SAN,"e4");
+   const Move d4 = Notation::value(start,White,Notation::InputFormat::SAN,"d4");
+   const Move nf3 = Notation::value(start,White,Notation::InputFormat::SAN,"Nf3");
+   const Move oo = Notation::value(castle,White,Notation::InputFormat::SAN,"O-O");
+   PolyglotWriter writer;
+   writer.add(BoardHash::polyglotHashCode(start),d4,1);
+   writer.add(BoardHash::polyglotHashCode(start),e4,3);
+   writer.add(BoardHash::polyglotHashCode(start),nf3,0);
+   writer.add(BoardHash::polyglotHashCode(castle),oo,5);
+   const string bookFile("unit_test.bin");
+   if (writer.write(bookFile.c_str())) {
+      cerr << "testPolyglot: book write failed" << endl;
+      return ++errs;
+   }
+   BookReader reader;
+   if (reader.open(bookFile.c_str(),Options::BookFormat::Polyglot)) {
+      cerr << "testPolyglot: book open failed" << endl;
+      ++errs;
+   }
+   else {
+      vector<Move> moves;
+      // zero-weight moves are not returned
+      if (reader.book_moves(start,moves) != 2 ||
+          !MovesEqual(moves[0],e4) || !MovesEqual(moves[1],d4)) {
+         cerr << "testPolyglot: wrong book moves for start position" << endl;
+         ++errs;
+      }
+      if (reader.book_moves(castle,moves) != 1 || !MovesEqual(moves[0],oo)) {
+         cerr << "testPolyglot: wrong book moves for castling position" << endl;
+         ++errs;
+      }
+      const Move m = reader.pick(start);
+      if (!MovesEqual(m,e4) && !MovesEqual(m,d4)) {
+         cerr << "testPolyglot: wrong book move picked" << endl;
+         ++errs;
+      }
+      reader.close();
+   }
+   remove(bookFile.c_str());
+   return errs;
+}
+
+static int testNNUE()
+{
+   int errs = 0;
+   std::unique_ptr<nnue::Network> net(new nnue::Network());
+   net->randomize(1ULL);
+   std::unique_ptr<nnue::AccumulatorStack> stack(new nnue::AccumulatorStack());
+   static const string fens[3] = {
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+      "n1n5/PPPk4/8/8/8/8/4Kppp/5N1N b - - 0 1",
+      "8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1"
+   };
+   for (int i = 0; i < 3; i++) {
+      Board board;
+      if (!BoardIO::readFEN(board, fens[i].c_str())) {
+         cerr << "testNNUE: error in FEN: " << fens[i] << endl;
+         ++errs;
+         continue;
+      }
+      board.setAccumulatorStack(stack.get());
+      errs += nnueWalk(*net, board, 2);
+      board.setAccumulatorStack(nullptr);
+   }
+
+   // save and reload the network
+   const string netFile("unit_test.nnue");
+   std::unique_ptr<nnue::Network> net2(new nnue::Network());
+   if (!net->save(netFile) || !net2->load(netFile)) {
+      cerr << "testNNUE: network save/load failed" << endl;
+      ++errs;
+   }
+   else {
+      Board board;
+      if (net2->evaluate(board) != net->evaluate(board)) {
+         cerr << "testNNUE: reloaded network gives different result" << endl;
+         ++errs;
+      }
+   }
+   remove(netFile.c_str());
+   if (net2->load(netFile)) {
+      cerr << "testNNUE: load of missing file succeeded" << endl;
+      ++errs;
    }
    return errs;
 }
@@ -1595,14 +2285,22 @@ int doUnit() {
    errs += testSee();
    errs += testPGN();
    errs += testEval();
+   errs += testParamFile();
    errs += testBitbases();
    errs += testDrawEval();
    errs += testCheckStatus();
    errs += testEPD();
    errs += testHash();
+   errs += testLearn();
+   errs += testBook();
+   errs += testPolyglot();
    errs += testRep();
    errs += testMoveGen();
    errs += testPerft();
+#ifndef TUNE
+   errs += testPst();
+#endif
+   errs += testNNUE();
    errs += testSearch();
 #ifdef SYZYGY_TBS
    errs += testTB();
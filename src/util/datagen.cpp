@@ -0,0 +1,377 @@
+// Copyright 2019 by Jon Dart. All Rights Reserved.
+
+// Generates training data by fixed-node self-play. Quiet positions
+// from each game are written with the search score and the game result
+// to a binary file, in fixed-size records (see packpos.h). The tuner
+// can read the file directly.
+
+#include "board.h"
+#include "boardio.h"
+#include "globals.h"
+#include "chessio.h"
+#include "movegen.h"
+#include "packpos.h"
+#include "scoring.h"
+#include "search.h"
+extern "C"
+{
+#include <string.h>
+};
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+static struct DatagenOptions
+{
+   int cores;
+   int games;
+   int nodes;
+   int depth;
+   int randomPlies;
+   int maxPly;
+   int adjudicatePlies;
+   score_t adjudicateScore;
+   unsigned seed;
+   string outFile;
+
+   DatagenOptions() :
+      cores(1),
+      games(1000),
+      nodes(5000),
+      depth(Constants::MaxPly-1),
+      randomPlies(8),
+      maxPly(400),
+      adjudicatePlies(4),
+      adjudicateScore(10*Params::PAWN_VALUE),
+      seed(1),
+      outFile("datagen.bin")
+   {
+   }
+} datagen_options;
+
+static const int MAX_CORES = 256;
+
+// skip positions with scores larger than this (same as the tuner)
+static const score_t MAX_SCORE = 30*Params::PAWN_VALUE;
+
+// number of records buffered by each thread before writing
+static const size_t WRITE_BUFFER_SIZE = 4096;
+
+static vector<string> startPositions;
+
+static ofstream out_file;
+static mutex out_lock;
+
+static atomic<int> games_started;
+static atomic<uint64_t> positions_written;
+
+static void usage()
+{
+   cerr << "Usage:" << endl;
+   cerr << "datagen -c <cores> -g <games> -n <nodes per move> -d <max depth>" << endl;
+   cerr << "        -r <random plies> -s <seed> -o <output file> [start position file]" << endl;
+   cerr << "datagen -x <data file>  (write data file as EPD)" << endl;
+}
+
+// A position is used if it is quiet: side to move is not in check,
+// the best move is not a capture or promotion, and the score is not
+// too large. Positions the evaluator does not score (bitbase and
+// drawn endings) are skipped, as in the tuner.
+static bool quiet(const Board &board, Move best, score_t score)
+{
+   if (IsNull(best) || CaptureOrPromotion(best) ||
+       board.checkStatus() == InCheck || std::abs(score) >= MAX_SCORE) {
+      return false;
+   }
+   if ((board.getMaterial(White).kingOnly() &&
+        board.getMaterial(Black).infobits() == Material::KP) ||
+       (board.getMaterial(Black).kingOnly() &&
+        board.getMaterial(White).infobits() == Material::KP)) {
+      return false;
+   }
+   return !Scoring::materialDraw(board) && !Scoring::theoreticalDraw(board);
+}
+
+static void flush(vector<PackedPosition> &buf)
+{
+   if (buf.empty()) return;
+   std::unique_lock<mutex> lock(out_lock);
+   out_file.write(reinterpret_cast<const char*>(buf.data()),
+                  buf.size()*sizeof(PackedPosition));
+   positions_written += buf.size();
+   buf.clear();
+}
+
+// Play one game and add its quiet positions to "buf".
+static void playGame(SearchController *searcher, mt19937 &rng,
+                     vector<PackedPosition> &buf)
+{
+   Board board;
+   if (startPositions.size()) {
+      BoardIO::readFEN(board,startPositions[rng() % startPositions.size()]);
+   }
+   // play random moves to diversify the openings
+   for (int i = 0; i < datagen_options.randomPlies; i++) {
+      RootMoveGenerator mg(board);
+      vector<Move> moves;
+      Move m;
+      int order = 0;
+      while ((m = mg.nextMove(order)) != NullMove) {
+         moves.push_back(m);
+      }
+      if (moves.empty()) return;
+      board.doMove(moves[rng() % moves.size()]);
+   }
+   searcher->clearHashTables();
+
+   const size_t first = buf.size();
+   int result = 1; // draw unless decided otherwise
+   // consecutive plies with a decisive score for each side
+   int decisive[2] = {0, 0};
+   for (int ply = 0; ply < datagen_options.maxPly; ply++) {
+      if (Scoring::isLegalDraw(board) || Scoring::materialDraw(board)) {
+         break;
+      }
+      Statistics stats;
+      const Move best = searcher->findBestMove(board,
+                                               FixedDepth,
+                                               INFINITE_TIME,
+                                               0,
+                                               datagen_options.depth,
+                                               false,
+                                               false,
+                                               stats,
+                                               Silent);
+      if (stats.state == Checkmate) {
+         result = board.sideToMove() == White ? 0 : 2;
+         break;
+      }
+      else if (stats.state == Stalemate || IsNull(best)) {
+         break;
+      }
+      const score_t score = stats.value;
+      // adjudicate once both sides' searches agree on the winner
+      const ColorType side = board.sideToMove();
+      if (score >= datagen_options.adjudicateScore) {
+         ++decisive[side];
+         decisive[OppositeColor(side)] = 0;
+      }
+      else if (score <= -datagen_options.adjudicateScore) {
+         ++decisive[OppositeColor(side)];
+         decisive[side] = 0;
+      }
+      else {
+         decisive[White] = decisive[Black] = 0;
+      }
+      if (decisive[White] >= datagen_options.adjudicatePlies) {
+         result = 2;
+         break;
+      }
+      else if (decisive[Black] >= datagen_options.adjudicatePlies) {
+         result = 0;
+         break;
+      }
+      if (quiet(board,best,score)) {
+         PackedPosition pos;
+         pos.pack(board);
+         pos.score = int16_t(board.sideToMove() == White ? score : -score);
+         pos.ply = uint16_t(ply+datagen_options.randomPlies);
+         buf.push_back(pos);
+      }
+      board.doMove(best);
+   }
+   for (size_t i = first; i < buf.size(); i++) {
+      buf[i].result = uint8_t(result);
+   }
+}
+
+static void threadp(int index, uint64_t nodeLimit)
+{
+   SearchController *searcher;
+   try {
+      searcher = new SearchController();
+   } catch(std::bad_alloc &) {
+      cerr << "out of memory, thread " << index << endl;
+      return;
+   }
+   searcher->registerMonitorFunction(
+      [nodeLimit](SearchController *c, const Statistics &) -> int {
+         return c->totalNodes() >= nodeLimit;
+      });
+   mt19937 rng(datagen_options.seed + index);
+   vector<PackedPosition> buf;
+   buf.reserve(WRITE_BUFFER_SIZE + 2*datagen_options.maxPly);
+   while (games_started++ < datagen_options.games) {
+      playGame(searcher,rng,buf);
+      if (buf.size() >= WRITE_BUFFER_SIZE) {
+         flush(buf);
+      }
+   }
+   flush(buf);
+   delete searcher;
+}
+
+static int dump(const string &fileName)
+{
+   ifstream in(fileName.c_str(), ios::in | ios::binary);
+   if (!in.good()) {
+      cerr << "could not open file " << fileName << endl;
+      return -1;
+   }
+   static const char *results[3] = {"0.0", "0.5", "1.0"};
+   PackedPositionHeader hdr;
+   in.seekg(0,ios::end);
+   const uint64_t size = in.tellg();
+   in.seekg(0,ios::beg);
+   if (!in.read(reinterpret_cast<char*>(&hdr),sizeof(hdr)) || !hdr.valid(size)) {
+      cerr << "invalid header in " << fileName << endl;
+      return -1;
+   }
+   PackedPosition pos;
+   Board board;
+   while (in.read(reinterpret_cast<char*>(&pos),sizeof(PackedPosition))) {
+      if (pos.result > 2) {
+         cerr << "invalid record in " << fileName << endl;
+         return -1;
+      }
+      pos.unpack(board);
+      // output in the format read by the tuner
+      cout << board << " c1 \"" << int(board.castleStatus(White)) << ' ' <<
+         int(board.castleStatus(Black)) << "\"; c2 \"" << results[pos.result] <<
+         "\"; ce " << (100*int(pos.score))/Params::PAWN_VALUE << ';' << endl;
+   }
+   return 0;
+}
+
+int CDECL main(int argc, char **argv)
+{
+   Bitboard::init();
+   initOptions(argv[0]);
+   options.book.book_enabled = options.log_enabled = 0;
+   Attacks::init();
+   Scoring::init();
+   if (!initGlobals(argv[0], false)) {
+      cleanupGlobals();
+      exit(-1);
+   }
+   atexit(cleanupGlobals);
+   delayedInit();
+
+   int arg = 1;
+   auto processInt = [&arg,&argc,&argv] (int &opt, const string &name) {
+      if (++arg < argc) {
+         stringstream s(argv[arg]);
+         s >> opt;
+         if (s.bad() || s.fail()) {
+            cerr << "expected integer after -" << name  << endl;
+            exit(-1);
+         }
+      } else {
+         cerr << "expected integer after -" << name << endl;
+         exit(-1);
+      }
+   };
+   for (;arg < argc && *(argv[arg]) == '-';++arg) {
+      if (strcmp(argv[arg],"-c")==0) {
+         processInt(datagen_options.cores,"c");
+      }
+      else if (strcmp(argv[arg],"-g")==0) {
+         processInt(datagen_options.games,"g");
+      }
+      else if (strcmp(argv[arg],"-n")==0) {
+         processInt(datagen_options.nodes,"n");
+      }
+      else if (strcmp(argv[arg],"-d")==0) {
+         processInt(datagen_options.depth,"d");
+      }
+      else if (strcmp(argv[arg],"-r")==0) {
+         processInt(datagen_options.randomPlies,"r");
+      }
+      else if (strcmp(argv[arg],"-s")==0) {
+         int seed;
+         processInt(seed,"s");
+         datagen_options.seed = unsigned(seed);
+      }
+      else if (strcmp(argv[arg],"-o")==0 && arg+1 < argc) {
+         datagen_options.outFile = argv[++arg];
+      }
+      else if (strcmp(argv[arg],"-x")==0 && arg+1 < argc) {
+         return dump(argv[++arg]);
+      }
+      else {
+         usage();
+         exit(-1);
+      }
+   }
+   if (datagen_options.cores < 1 || datagen_options.cores > MAX_CORES ||
+       datagen_options.depth < 1 || datagen_options.depth >= Constants::MaxPly ||
+       datagen_options.nodes < 1) {
+      usage();
+      exit(-1);
+   }
+   if (arg < argc) {
+      // read start positions (same format as the tuner input)
+      ifstream pos_file(argv[arg]);
+      if (!pos_file.good()) {
+         cerr << "could not open file " << argv[arg] << endl;
+         exit(-1);
+      }
+      Board board;
+      EPDRecord rec;
+      while (ChessIO::readEPDRecord(pos_file,board,rec)) {
+         if (rec.hasError()) {
+            continue;
+         }
+         stringstream fen;
+         fen << board;
+         startPositions.push_back(fen.str());
+      }
+      cerr << startPositions.size() << " start positions read" << endl;
+   }
+
+   options.search.hash_table_size = 16*1024*1024;
+   options.search.ncpus = 1;
+   options.search.easy_plies = 0;
+   options.search.can_resign = 0;
+   options.learning.position_learning = 0;
+#ifdef SYZYGY_TBS
+   options.search.use_tablebases = false;
+#endif
+
+   out_file.open(datagen_options.outFile.c_str(), ios::out | ios::binary | ios::trunc);
+   if (!out_file.good()) {
+      cerr << "could not open output file " << datagen_options.outFile << endl;
+      exit(-1);
+   }
+   // the header is rewritten with the final count
+   PackedPositionHeader hdr;
+   out_file.write(reinterpret_cast<const char*>(&hdr),sizeof(hdr));
+
+   CLOCK_TYPE startTime = getCurrentTime();
+   vector<std::thread> threads;
+   for (int i = 0; i < datagen_options.cores; i++) {
+      threads.push_back(std::thread(threadp,i,uint64_t(datagen_options.nodes)));
+   }
+   for (std::thread &t : threads) {
+      t.join();
+   }
+   hdr.count = positions_written;
+   out_file.seekp(0,ios::beg);
+   out_file.write(reinterpret_cast<const char*>(&hdr),sizeof(hdr));
+   out_file.close();
+   const uint64_t elapsed = getElapsedTime(startTime,getCurrentTime());
+   cerr << positions_written << " positions written to " <<
+      datagen_options.outFile << " (" <<
+      (60000*positions_written)/std::max<uint64_t>(1,elapsed) <<
+      " positions/minute)" << endl;
+   return 0;
+}
@@ -0,0 +1,46 @@
+// Copyright 2019 by Jon Dart.  All Rights Reserved.
+
+// Utility to convert a text position learning file (the format used
+// before version 21.3) to the binary format.
+
+#include "globals.h"
+#include "learn.h"
+#include "scoring.h"
+
+#include <iostream>
+
+using namespace std;
+
+static void show_usage()
+{
+   cerr << "Usage: learnconv <text learn file> <output file>" << endl;
+   cerr << "Records are added to the output file if it exists." << endl;
+}
+
+int CDECL main(int argc, char **argv)
+{
+   Bitboard::init();
+   Attacks::init();
+   Scoring::init();
+   if (!initGlobals(argv[0], false)) {
+      cleanupGlobals();
+      exit(-1);
+   }
+   atexit(cleanupGlobals);
+
+   if (argc != 3) {
+      show_usage();
+      return -1;
+   }
+   int count = LearnStore::importText(argv[1], argv[2]);
+   if (count < 0) {
+      cerr << "conversion failed" << endl;
+      return -1;
+   }
+   LearnStore store;
+   if (store.open(argv[2], LearnStore::Mode::ReadOnly)) {
+      cout << count << " records read, " << store.count() <<
+         " positions in " << argv[2] << endl;
+   }
+   return 0;
+}
@@ -3,12 +3,16 @@
 // Stand-alone executable to build the binary opening book from
 // one or more PGN input files.
 
-// The book file is a binary file consisting of a header followed
-// by one or more "index pages" and then by one or more "data pages."
-// These data structures are defined in bookdefs.h.
+// The input files are split into blocks of games, which are parsed
+// by multiple threads. Move statistics are accumulated in hash tables
+// sharded by hash code. When a shard exceeds its share of the memory
+// limit it is sorted and spilled to a temporary "run" file. At the end
+// each shard's runs are merged and the book is written in one pass,
+// in hash code order. The book format is defined in bookdefs.h.
 
 #include "board.h"
 #include "bookdefs.h"
+#include "bookread.h"
 #include "bookwrit.h"
 #include "bhash.h"
 #include "chessio.h"
@@ -18,11 +22,21 @@
 #include "globals.h"
 
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <queue>
 #include <regex>
-#include <stack>
+#include <sstream>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 using namespace std;
 
@@ -34,11 +48,12 @@ extern "C"{
 enum ResultType {White_Win, Black_Win, DrawResult, UnknownResult};
 ResultType tmp_result;
 
-// number of pages in the book.
-static unsigned indexPages = 1;                    // default
 // max ply depth processed for PGN games
 static int maxPly = 70;
 static bool verbose = false;
+static int cores = 1;
+// memory limit for the move tables, in MB
+static unsigned memory = 1024;
 
 enum MoveEval {NO_MOVE_EVAL,
                BLUNDER_MOVE,POOR_MOVE,QUESTIONABLE_MOVE,NEUTRAL_EVAL,
@@ -64,8 +79,6 @@ static const byte MoveEvalValues[] = { book::NO_RECOMMEND, 0, 0, book::MAX_WEIGH
 
 static string output_name;
 
-class BookEntry;
-
 struct MoveListEntry {
     Move move;
     int index;
@@ -97,27 +110,19 @@ struct Variation {
 
 static unsigned minFrequency = 0;
 
-#ifdef __INTEL_COMPILER
-#pragma pack(push,1)
-#endif
-
-class BookEntry
-BEGIN_PACKED_STRUCT
-   public:
-    BookEntry( ColorType side,
-               unsigned rec, PositionEval ev,
-               MoveEval mev, ResultType result,
-               byte mv_indx,
-               BookEntry *nxt, bool first);
-
-    BookEntry *next;
-    bool first;
-    PositionEval eval;
-    MoveEval moveEval;
-    unsigned rec; // explicit weight if any
+// Statistics for a move, accumulated from the games.
+//
+// Games are numbered in input order. Where games disagree, the
+// annotations from the earliest game are kept, so the result does not
+// depend on the order in which the threads process them.
+struct MoveStats {
     uint32_t win,loss,draw;
-    byte move_index;
-    uint16_t weight;
+    uint32_t game; // first game with this move
+    uint32_t recGame, moveEvalGame; // games supplying rec and moveEval
+    byte rec; // explicit weight if any
+    byte eval; // PositionEval, from the first game
+    byte moveEval; // MoveEval
+    bool first; // move occurs in the first input file
 
     uint32_t count() const
     {
@@ -126,26 +131,27 @@ BEGIN_PACKED_STRUCT
 
     void updateWinLoss( ColorType side, ResultType result );
 
+    // Add the counts from "other". Annotations already set are kept.
+    void merge(const MoveStats &other);
+
     byte computeWeight() const;
-END_PACKED_STRUCT
+};
 
-#ifdef __INTEL_COMPILER
-#pragma pack(pop)
-#endif
+// A position's hash code and move, with the statistics for the
+// move. Records are produced by the parsing threads, and are also the
+// format of the runs spilled to disk.
+struct BookRecord {
+    hash_t hashCode;
+    byte move_index;
+    MoveStats stats;
 
-BookEntry::BookEntry( ColorType side, unsigned r, PositionEval ev,
-                       MoveEval mev,
-                       ResultType result, byte mv_indx,
-                       BookEntry *nxt, bool first_file)
-    :next(nxt), first(first_file),
-     eval(ev), moveEval(mev), rec(r),
-     win(0),loss(0),draw(0),
-     move_index(mv_indx), weight(book::MAX_WEIGHT/2)
-{
-   updateWinLoss(side,result);
-}
+    bool operator < (const BookRecord &r) const {
+       return hashCode < r.hashCode ||
+          (hashCode == r.hashCode && move_index < r.move_index);
+    }
+};
 
-void BookEntry::updateWinLoss( ColorType side, ResultType result )
+void MoveStats::updateWinLoss( ColorType side, ResultType result )
 {
    if (side == White) {
       if (result == White_Win) {
@@ -171,7 +177,29 @@ void BookEntry::updateWinLoss( ColorType side, ResultType result )
    }
 }
 
-byte BookEntry::computeWeight() const
+void MoveStats::merge(const MoveStats &other)
+{
+   win += other.win;
+   loss += other.loss;
+   draw += other.draw;
+   if (other.game < game) {
+      game = other.game;
+      eval = other.eval;
+   }
+   if (other.recGame < recGame) {
+      // explicit weight from an earlier game
+      rec = other.rec;
+      recGame = other.recGame;
+   }
+   if (other.moveEvalGame < moveEvalGame) {
+      // move eval from an earlier game
+      moveEval = other.moveEval;
+      moveEvalGame = other.moveEvalGame;
+   }
+   first |= other.first;
+}
+
+byte MoveStats::computeWeight() const
 {
    if (rec != book::NO_RECOMMEND) {
       return rec*book::MAX_WEIGHT/100;
@@ -190,104 +218,137 @@ byte BookEntry::computeWeight() const
    }
 }
 
-static unordered_map <uint64_t, BookEntry *>* hashTable = nullptr;
+struct MoveKey {
+    hash_t hashCode;
+    byte move_index;
 
-// Add move to our in-memory data structure
-static void
-add_move(const Board & board, const MoveListEntry &m, bool is_first_file,
-         const Variation &var)
+    bool operator == (const MoveKey &k) const {
+       return hashCode == k.hashCode && move_index == k.move_index;
+    }
+};
+
+struct MoveKeyHash {
+    size_t operator()(const MoveKey &k) const {
+       return size_t(k.hashCode ^ (k.move_index*0x9E3779B97F4A7C15ULL));
+    }
+};
+
+// Positions are assigned to shards by the high bits of the hash code,
+// so each shard holds a contiguous range of hash codes.
+static const int SHARD_BITS = 8;
+static const int SHARDS = 1 << SHARD_BITS;
+
+// approximate memory used per hash table entry, in bytes
+static const size_t ENTRY_SIZE = 96;
+
+// records read at a time from a run file
+static const size_t RUN_BUFFER_SIZE = 4096;
+
+// games per block passed to a parsing thread
+static const int GAMES_PER_CHUNK = 256;
+
+struct Shard {
+    std::mutex lock;
+    unordered_map<MoveKey, MoveStats, MoveKeyHash> moves;
+    // sorted runs spilled to disk (file offset and record count)
+    vector<pair<uint64_t,uint64_t>> runs;
+    uint64_t runFileSize = 0;
+};
+
+static Shard shards[SHARDS];
+
+// max entries held in memory per shard
+static size_t shardLimit;
+
+static const uint32_t NO_GAME = 0xffffffff;
+
+static inline int shardOf(hash_t hashCode)
 {
-#ifdef _TRACE
-   cout << "adding move ";
-   Notation::image(board,m.move,Notation::SAN_OUT,cout);
-   cout << endl;
-#endif
-   const int move_index = m.index;
-   const int recommend = m.rec;
-   auto it = hashTable->find(board.hashCode());
-   BookEntry *be;
-   if (it == hashTable->end())
-      be = nullptr;
-   else
-      be = (*it).second;
-   if (be == nullptr) {
-       // position not found in hashtable
-       BookEntry *new_entry;
-       try {
-          new_entry = new BookEntry(board.sideToMove(), recommend,
-                                    var.eval, m.moveEval, var.result,
-                                    move_index, nullptr, is_first_file);
-       } catch(std::bad_alloc) {
-          cerr << "out of memory!" << endl;
-          exit(-1);
-       }
-      (*hashTable)[board.hashCode()] = new_entry;
-#ifdef _TRACE
-      cout << "inserting position: " <<
-         " h:" << (hex) << Bitboard(board.hashCode()).hivalue() <<
-         Bitboard(board.hashCode()).lovalue() << (dec) <<
-         " index = " << (int)move_index << " from bk = " << (int)is_first_file <<
-          " pos. eval=" << (int)var.eval << " moveEval=" << (int)m.moveEval << " recommend=" << (int)recommend << endl;
-#endif
+   return int(hashCode >> (64-SHARD_BITS));
+}
+
+static string runFileName(int index)
+{
+   stringstream s;
+   s << output_name << ".run" << index;
+   return s.str();
+}
+
+// Sort a shard's entries and append them to its run file. Called with
+// the shard locked.
+static void spill(int index)
+{
+   Shard &shard = shards[index];
+   vector<BookRecord> recs;
+   recs.reserve(shard.moves.size());
+   for (const auto &it : shard.moves) {
+      recs.push_back(BookRecord{it.first.hashCode, it.first.move_index, it.second});
    }
-   else {
-      // update existing entry
-      BookEntry *p = be;
-      int found = 0;
-      while (p && !found) {
-         if (p->move_index == move_index) {
-            ++found; break;
-         }
-         p = p->next;
-      }
-      if (found) {
-         // Move already in hash table
-         p->updateWinLoss(board.sideToMove(),var.result);
-         if (m.rec != book::NO_RECOMMEND &&
-             p->rec == book::NO_RECOMMEND) {
-            // set explicit weight if not set already
-            p->rec = m.rec;
-         }
-         if (m.moveEval != NO_MOVE_EVAL && p->moveEval == NO_MOVE_EVAL) {
-            // set move eval if not set already
-            p->moveEval = m.moveEval;
+   unordered_map<MoveKey, MoveStats, MoveKeyHash>().swap(shard.moves);
+   std::sort(recs.begin(), recs.end());
+   const string name(runFileName(index));
+   ofstream out(name, ios::out | ios::app | ios::binary);
+   out.write((const char*)recs.data(), recs.size()*sizeof(BookRecord));
+   out.close();
+   if (out.fail()) {
+      cerr << "error writing temporary file " << name << endl;
+      exit(-1);
+   }
+   shard.runs.push_back(std::make_pair(shard.runFileSize, uint64_t(recs.size())));
+   shard.runFileSize += recs.size()*sizeof(BookRecord);
+}
+
+// Merge a batch of records from the parsing threads into the shards.
+static void add_records(vector<BookRecord> &recs)
+{
+   // group by shard, keeping game order for each move
+   std::stable_sort(recs.begin(), recs.end());
+   for (auto it = recs.begin(); it != recs.end(); ) {
+      const int index = shardOf(it->hashCode);
+      Shard &shard = shards[index];
+      std::unique_lock<std::mutex> lock(shard.lock);
+      for (; it != recs.end() && shardOf(it->hashCode) == index; ++it) {
+         auto result = shard.moves.emplace(MoveKey{it->hashCode, it->move_index},
+                                           it->stats);
+         if (!result.second) {
+            // Move already in hash table
+            result.first->second.merge(it->stats);
          }
-#ifdef _TRACE
-         cout << "updating: " <<
-            " h:" << (hex) << Bitboard(board.hashCode()).hivalue() <<
-            Bitboard(board.hashCode()).lovalue() << (dec) <<
-            " index = " << (int)move_index <<
-            " first = " << (int)is_first_file <<
-            " winloss=" << p->white_win_loss <<
-            " rec=" << p->rec <<
-            " pos. eval=" << (int)p->eval <<
-            " moveEval=" << (int)p->moveEval <<
-            " count=" << p->count() << endl;
-#endif
       }
-      else {
-         // Position is in hashtable, but not with this move.
-#ifdef _TRACE
-         cout << "inserting move: " <<
-            " h:" << (hex) << Bitboard(board.hashCode()).hivalue() <<
-            Bitboard(board.hashCode()).lovalue() << (dec) <<
-            " index = " << (int)move_index << " first = " << (int)is_first_file <<
-             " pos. eval =" << (int)var.eval << " move eval=" << (int)m.moveEval << " recommend=" << (int)recommend << endl;
-#endif
-         BookEntry *new_entry;
-         try {
-            new_entry = new BookEntry(board.sideToMove(), recommend,
-                                      var.eval, m.moveEval, var.result,
-                                      move_index, be, is_first_file);
-         } catch(std::bad_alloc) {
-            cerr << "out of memory!" << endl;
-            exit(-1);
-         }
-         (*hashTable)[board.hashCode()] = new_entry;
+      if (shard.moves.size() > shardLimit) {
+         spill(index);
       }
    }
+   recs.clear();
 }
 
+// Record a move from a game
+static void
+add_move(const Board & board, const MoveListEntry &m, bool is_first_file,
+         uint32_t game, const Variation &var, vector<BookRecord> &recs)
+{
+#ifdef _TRACE
+   cout << "adding move ";
+   Notation::image(board,m.move,Notation::SAN_OUT,cout);
+   cout << " index = " << m.index << " from bk = " << (int)is_first_file <<
+      " pos. eval=" << (int)var.eval << " moveEval=" << (int)m.moveEval <<
+      " recommend=" << m.rec << endl;
+#endif
+   BookRecord rec;
+   rec.hashCode = board.hashCode();
+   rec.move_index = (byte)m.index;
+   MoveStats &stats = rec.stats;
+   stats.win = stats.loss = stats.draw = 0;
+   stats.rec = (byte)m.rec;
+   stats.eval = (byte)var.eval;
+   stats.moveEval = (byte)m.moveEval;
+   stats.first = is_first_file;
+   stats.game = game;
+   stats.recGame = m.rec == book::NO_RECOMMEND ? NO_GAME : game;
+   stats.moveEvalGame = m.moveEval == NO_MOVE_EVAL ? NO_GAME : game;
+   stats.updateWinLoss(board.sideToMove(), var.result);
+   recs.push_back(rec);
+}
 
 // convert a move to an index based on the order the move generator
 // provides. Return -1 if move is not in generated list, hence is illegal.
@@ -306,7 +367,8 @@ static int get_move_indx(const Board &board, Move move) {
     return move_indx;
 }
 
-static void processVar(const Variation &var, bool first) {
+static void processVar(const Variation &var, bool first, uint32_t game,
+                       vector<BookRecord> &recs) {
     // Game has been processed, now add moves to book (we do this
     // only after seeing the whole variation, because we want the
     // end of line eval or result, if any).
@@ -326,7 +388,7 @@ static void processVar(const Variation &var, bool first) {
         while (it != var.moves.end()) {
             const MoveListEntry &m = *it++;
             if (ply < maxPly || first) {
-                add_move(board, m, first, var);
+                add_move(board, m, first, game, var, recs);
             }
             ++ply;
             board.doMove(m.move);
@@ -334,10 +396,30 @@ static void processVar(const Variation &var, bool first) {
     }
 }
 
-static int do_pgn(ifstream &infile, const string &book_name, bool firstFile)
+// A block of games from one input file.
+struct Chunk {
+    string text;
+    string fileName;
+    long firstGame; // number of the first game in the file
+    uint32_t ordinal; // number of the first game in all input
+    bool firstFile;
+    Chunk() : firstGame(1L), ordinal(0), firstFile(false) {
+    }
+};
+
+static std::mutex queueLock;
+static std::condition_variable queueNotEmpty, queueNotFull;
+static std::deque<Chunk> chunkQueue;
+static bool inputDone = false;
+static std::atomic<bool> parseError(false);
+
+// Parse the games in a chunk, appending the moves to "recs".
+static int do_pgn(istream &infile, const Chunk &chunk, vector<BookRecord> &recs)
 {
    vector<ChessIO::Header> hdrs;
-   long games = 0L;
+   const string &book_name = chunk.fileName;
+   const bool firstFile = chunk.firstFile;
+   long games = chunk.firstGame - 1;
    ColorType side = White;
    while (!infile.eof() && infile.good()) {
       long first;
@@ -355,6 +437,7 @@ static int do_pgn(ifstream &infile, const string &book_name, bool firstFile)
       }
       ChessIO::collect_headers(infile,hdrs,first);
       ++games;
+      const uint32_t game = chunk.ordinal + uint32_t(games - chunk.firstGame);
 #ifdef _TRACE
       cout << "game " << games << endl;
 #endif
@@ -394,7 +477,7 @@ static int do_pgn(ifstream &infile, const string &book_name, bool firstFile)
          }
          else if (var && tok.type == ChessIO::CloseVar) {
              const Variation &branchPoint = varStack[var-1];
-             processVar(branchPoint,firstFile);
+             processVar(branchPoint,firstFile,game,recs);
              if (var >= 2) {
                  Variation &parent = varStack[var-2];
                  // minimax child variation evals back to parent
@@ -536,17 +619,288 @@ static int do_pgn(ifstream &infile, const string &book_name, bool firstFile)
             break;
          }
       }
-      processVar(topVar,firstFile);
+      processVar(topVar,firstFile,game,recs);
       --var;
       ASSERT(var == 0);
    }
    return 0;
 }
 
+static void parse_chunks()
+{
+   vector<BookRecord> recs;
+   for (;;) {
+      Chunk chunk;
+      {
+         std::unique_lock<std::mutex> lock(queueLock);
+         queueNotEmpty.wait(lock, [] { return !chunkQueue.empty() || inputDone; });
+         if (chunkQueue.empty()) break;
+         chunk = std::move(chunkQueue.front());
+         chunkQueue.pop_front();
+      }
+      queueNotFull.notify_one();
+      // after an error, discard the remaining input
+      if (parseError) continue;
+      istringstream in(chunk.text);
+      try {
+         if (do_pgn(in, chunk, recs) == -1) {
+            parseError = true;
+         }
+         add_records(recs);
+      } catch(std::bad_alloc &) {
+         cerr << "out of memory!" << endl;
+         exit(-1);
+      }
+   }
+}
+
+static void queue_chunk(Chunk &chunk)
+{
+   std::unique_lock<std::mutex> lock(queueLock);
+   queueNotFull.wait(lock, [] { return chunkQueue.size() < 4*size_t(cores); });
+   chunkQueue.push_back(std::move(chunk));
+   lock.unlock();
+   queueNotEmpty.notify_one();
+}
+
+// Split a PGN file into chunks of games for the parsing threads.
+// "ordinal" is the number of games in the preceding files, and is
+// updated.
+static void read_pgn(ifstream &infile, const string &book_name, bool firstFile,
+                     uint32_t &ordinal)
+{
+   Chunk chunk;
+   chunk.fileName = book_name;
+   chunk.firstFile = firstFile;
+   chunk.ordinal = ordinal;
+   long games = 0L;
+   int chunkGames = 0;
+   bool inMoves = false; // past the headers of the current game
+   int commentDepth = 0;
+   string line;
+   while (!parseError && getline(infile, line)) {
+      if (line.size() && line[0] == '[' && commentDepth == 0 &&
+          (inMoves || games == 0)) {
+         // start of a new game
+         if (chunkGames == GAMES_PER_CHUNK) {
+            queue_chunk(chunk);
+            chunk = Chunk();
+            chunk.fileName = book_name;
+            chunk.firstFile = firstFile;
+            chunk.firstGame = games + 1;
+            chunk.ordinal = ordinal + uint32_t(games);
+            chunkGames = 0;
+         }
+         ++games;
+         ++chunkGames;
+         inMoves = false;
+      }
+      else if (line.size() && (line[0] != '[' || commentDepth)) {
+         inMoves = true;
+         for (char c : line) {
+            if (c == '{') {
+               ++commentDepth;
+            }
+            else if (c == '}' && commentDepth) {
+               --commentDepth;
+            }
+         }
+      }
+      chunk.text += line;
+      chunk.text += '\n';
+   }
+   if (chunk.text.size()) {
+      queue_chunk(chunk);
+   }
+   ordinal += uint32_t(games);
+}
+
+// Reads back a sorted run of records.
+class RunReader {
+ public:
+   // read records from a run file
+   RunReader(const string &fileName, uint64_t offset, uint64_t count)
+      : in(fileName, ios::in | ios::binary), remaining(count), pos(0) {
+      in.seekg(offset);
+   }
+
+   // read records held in memory
+   explicit RunReader(vector<BookRecord> &&recs)
+      : buf(std::move(recs)), remaining(0), pos(0) {
+   }
+
+   // get the next record, returns false at the end of the run
+   bool next(BookRecord &rec) {
+      if (pos == buf.size()) {
+         if (remaining == 0) return false;
+         buf.resize(size_t(std::min<uint64_t>(remaining, RUN_BUFFER_SIZE)));
+         in.read((char*)buf.data(), buf.size()*sizeof(BookRecord));
+         if (in.fail()) {
+            cerr << "error reading temporary file" << endl;
+            exit(-1);
+         }
+         remaining -= buf.size();
+         pos = 0;
+      }
+      rec = buf[pos++];
+      return true;
+   }
+
+ private:
+   ifstream in;
+   vector<BookRecord> buf;
+   uint64_t remaining;
+   size_t pos;
+};
+
+// Pick out a position's moves that meet the "minFrequency" test,
+// compute their weights and add them to the book.
+static int add_position(BookStreamWriter &writer, const vector<BookRecord> &position)
+{
+   vector<book::MoveEntry> moves;
+   for (const BookRecord &r : position) {
+      if (r.stats.count() >= minFrequency || r.stats.first) {
+         book::MoveEntry m;
+         m.index = r.move_index;
+         m.weight = r.stats.computeWeight();
+         m.reserved = 0;
+         m.win = r.stats.win;
+         m.loss = r.stats.loss;
+         m.draw = r.stats.draw;
+         moves.push_back(m);
+      }
+   }
+   return writer.add(position[0].hashCode, moves);
+}
+
+// Merge a shard's entries, in memory and in its runs, in hash code
+// order and write them to the book.
+static int write_shard(int index, BookStreamWriter &writer)
+{
+   Shard &shard = shards[index];
+   vector<std::unique_ptr<RunReader>> readers;
+   if (shard.runs.size()) {
+      spill(index);
+      for (const auto &run : shard.runs) {
+         readers.emplace_back(new RunReader(runFileName(index), run.first, run.second));
+      }
+   }
+   else {
+      vector<BookRecord> recs;
+      recs.reserve(shard.moves.size());
+      for (const auto &it : shard.moves) {
+         recs.push_back(BookRecord{it.first.hashCode, it.first.move_index, it.second});
+      }
+      unordered_map<MoveKey, MoveStats, MoveKeyHash>().swap(shard.moves);
+      std::sort(recs.begin(), recs.end());
+      readers.emplace_back(new RunReader(std::move(recs)));
+   }
+   // Heap of the next record from each run, in (hash code, move index)
+   // order.
+   typedef pair<BookRecord,size_t> HeapEntry;
+   auto cmp = [](const HeapEntry &a, const HeapEntry &b) {
+      return b.first < a.first ||
+         (!(a.first < b.first) && b.second < a.second);
+   };
+   std::priority_queue<HeapEntry, vector<HeapEntry>, decltype(cmp)> heap(cmp);
+   BookRecord rec;
+   for (size_t i = 0; i < readers.size(); i++) {
+      if (readers[i]->next(rec)) heap.push(std::make_pair(rec,i));
+   }
+   int result = 0;
+   vector<BookRecord> position;
+   while (!heap.empty() && result == 0) {
+      const HeapEntry top = heap.top();
+      heap.pop();
+      if (readers[top.second]->next(rec)) heap.push(std::make_pair(rec,top.second));
+      const BookRecord &r = top.first;
+      if (position.size() && position.back().hashCode != r.hashCode) {
+         result = add_position(writer, position);
+         position.clear();
+      }
+      if (position.size() && position.back().move_index == r.move_index) {
+         position.back().stats.merge(r.stats);
+      }
+      else {
+         position.push_back(r);
+      }
+   }
+   if (position.size() && result == 0) {
+      result = add_position(writer, position);
+   }
+   if (shard.runs.size()) {
+      readers.clear();
+      std::remove(runFileName(index).c_str());
+   }
+   return result;
+}
+
+// Export an Arasan format book in Polyglot format. Arasan books are
+// indexed by hash code only, so the positions are found by following
+// the book moves from the initial position; positions that are not
+// reachable that way are not exported.
+static int export_polyglot(const string &book_name, const string &out_name)
+{
+   BookReader reader;
+   if (reader.open(book_name.c_str())) {
+      return -1;
+   }
+   PolyglotWriter writer;
+   std::deque<Board> boards(1);
+   unordered_set<hash_t> visited;
+   visited.insert(boards.front().hashCode());
+   vector<book::DataEntry> entries;
+   unsigned long positions = 0, total_moves = 0;
+   while (!boards.empty()) {
+      const Board board(boards.front());
+      boards.pop_front();
+      if (reader.lookup(board,entries) <= 0) continue;
+      Move move_list[Constants::MaxMoves];
+      RootMoveGenerator mg(board);
+      const int n = mg.generateAllMoves(move_list,1 /* repeatable */);
+      // Polyglot weights are conventionally 2*wins + draws. Explicit
+      // weights scale this up or down, and zero-weight ("don't play")
+      // moves are omitted.
+      vector<std::pair<Move,double>> weights;
+      double maxWeight = 0.0;
+      for (const book::DataEntry &entry : entries) {
+         if (entry.index >= n || entry.weight == 0) continue;
+         double w = std::max<double>(1.0,2.0*entry.win + entry.draw);
+         if (entry.weight != book::NO_RECOMMEND) {
+            w *= double(entry.weight)/(book::MAX_WEIGHT/2);
+         }
+         weights.push_back(std::make_pair(move_list[entry.index],w));
+         maxWeight = std::max<double>(maxWeight,w);
+      }
+      if (weights.empty()) continue;
+      const hash_t key = BoardHash::polyglotHashCode(board);
+      // weights are 16 bits
+      const double scale = maxWeight > 65535.0 ? 65535.0/maxWeight : 1.0;
+      for (const auto &it : weights) {
+         writer.add(key,it.first,
+                    (uint16_t)std::max<double>(1.0,std::round(it.second*scale)));
+         ++total_moves;
+         Board next(board);
+         next.doMove(it.first);
+         if (visited.insert(next.hashCode()).second) {
+            boards.push_back(next);
+         }
+      }
+      ++positions;
+   }
+   if (writer.write(out_name.c_str())) {
+      cerr << "error writing book" << endl;
+      return -1;
+   }
+   cout << positions << " positions, " << total_moves << " total moves exported." << endl;
+   return 0;
+}
+
 static void usage() {
     cerr << "Usage:" << endl;
-    cerr << "makebook -n <pages> -p <max play> -h <hash size>" << endl;
-    cerr << "         -m <min frequency> -o <output file> <input file(s)>" << endl;
+    cerr << "makebook -p <max ply> -m <min frequency> -c <cores>" << endl;
+    cerr << "         -M <memory (MB)> -o <output file> [-v] <input file(s)>" << endl;
+    cerr << "makebook -x <book file> -o <Polyglot output file>" << endl;
 }
 
 int CDECL main(int argc, char **argv)
@@ -563,7 +917,6 @@ int CDECL main(int argc, char **argv)
    }
    atexit(cleanupGlobals);
 
-   hashTable =  new unordered_map< uint64_t, BookEntry*>;
    moveEvals.insert(std::pair<string,MoveEval>("$1",GOOD_MOVE));
    moveEvals.insert(std::pair<string,MoveEval>("$2",POOR_MOVE));
    moveEvals.insert(std::pair<string,MoveEval>("$3",VERY_GOOD_MOVE));
@@ -584,6 +937,7 @@ int CDECL main(int argc, char **argv)
    positionEvals.insert(std::pair<string,PositionEval>("$20",WHITE_WINNING_ADVANTAGE));
 
    output_name = "";
+   string export_name;
    int arg = 1;
    while (arg < argc) {
       if (*argv[arg] == '-') {
@@ -601,18 +955,35 @@ int CDECL main(int argc, char **argv)
                ++arg;
                output_name = argv[arg];
                break;
-            case 'n':                             /* number of pages */
+            case 'n':
+               // number of index pages: not used by the current
+               // book format, accepted for compatibility
                ++arg;
-               indexPages = atoi(argv[arg]);
-               if (indexPages == 0) {
-                  cerr << "Illegal size specified for -n" << endl;
-                  exit(-1);
-               }
                break;
             case 'm':
                ++arg;
                minFrequency = (unsigned)atoi(argv[arg]);
                break;
+            case 'c':
+               ++arg;
+               cores = atoi(argv[arg]);
+               if (cores < 1) {
+                  cerr << "Illegal cores (-c) value" << endl;
+                  exit(-1);
+               }
+               break;
+            case 'M':
+               ++arg;
+               memory = (unsigned)atoi(argv[arg]);
+               if (memory == 0) {
+                  cerr << "Illegal memory (-M) value" << endl;
+                  exit(-1);
+               }
+               break;
+            case 'x':
+               ++arg;
+               export_name = argv[arg];
+               break;
             case 'v':
                 verbose = true;
                 break;
@@ -627,6 +998,12 @@ int CDECL main(int argc, char **argv)
          break;
    }
 
+   if (export_name != "") {
+      if (output_name == "") {
+         output_name = "polyglot.bin";
+      }
+      return export_polyglot(export_name, output_name);
+   }
    if (output_name == "") {
       output_name = "book.bin";
    }
@@ -636,61 +1013,74 @@ int CDECL main(int argc, char **argv)
        return -1;
    }
 
-   bool first = true;
-   while (arg < argc) {
+   shardLimit = std::max<size_t>(1,size_t(memory)*1024*1024/ENTRY_SIZE/SHARDS);
+
+   vector<std::thread> threads;
+   for (int i = 0; i < cores; i++) {
+      threads.push_back(std::thread(parse_chunks));
+   }
+   bool first = true, openError = false;
+   uint32_t games = 0;
+   while (arg < argc && !parseError) {
       book_name = argv[arg++];
       ifstream infile;
 
       infile.open(book_name.c_str(), ios::in);
       if (!infile.good()) {
          cerr << "Can't open book file: " << book_name << endl;
-         return -1;
+         openError = true;
+         break;
       }
       if (verbose) cout << "processing " << book_name << endl;
-      int result = do_pgn(infile, book_name, first);
+      read_pgn(infile, book_name, first, games);
       first = false;
       infile.close();
-      if (result == -1) break;
-   }
-
-   // Iterate through the hash table, picking out moves that meet
-   // the "minFrequency" test. Also at this stage we compute move
-   // weights.
-   if (verbose) cout << "PGN processing complete." << endl;
-   BookWriter writer(indexPages);
-   uint32_t total_moves = 0;
-   unsigned long positions = 0;
-   for (const auto &it : *hashTable) {
-       const BookEntry* be = it.second;
-       // Note: it.first is the hash code
-#ifdef _TRACE
-       cout << "h:" << (hex) << it.first << (dec) << endl;
-#endif
-       int added = 0;
-       while (be) {
-           if ((be->count() >= minFrequency) || be->first) {
-               ++added;
-               try {
-                   writer.add(it.first, be->move_index,
-                              be->computeWeight(), be->win, be->loss, be->draw);
-               } catch(BookFullException &ex) {
-                   cerr << ex.what() << endl;
-                   return -1;
-               }
-               total_moves++;
-           }
-           be = be->next;
-       }
-       if (added) ++positions;
    }
-   if (verbose) cout << "writing .." << endl;
-   if (writer.write(output_name.c_str())) {
+   {
+      std::unique_lock<std::mutex> lock(queueLock);
+      inputDone = true;
+   }
+   queueNotEmpty.notify_all();
+   for (std::thread &t : threads) {
+      t.join();
+   }
+   if (openError) {
+      for (int i = 0; i < SHARDS; i++) {
+         if (shards[i].runs.size()) std::remove(runFileName(i).c_str());
+      }
+      return -1;
+   }
+
+   if (verbose) {
+      size_t runs = 0;
+      for (const Shard &shard : shards) {
+         runs += shard.runs.size();
+      }
+      cout << "PGN processing complete";
+      if (runs) cout << ", " << runs << " runs spilled to disk";
+      cout << "." << endl;
+      cout << "writing .." << endl;
+   }
+   // Merge the shards in order and write the book.
+   BookStreamWriter writer;
+   int result = writer.open(output_name);
+   try {
+      for (int i = 0; i < SHARDS && result == 0; i++) {
+         result = write_shard(i, writer);
+      }
+   } catch(BookFullException &ex) {
+      cerr << ex.what() << endl;
+      return -1;
+   }
+   if (result == 0) {
+      result = writer.close();
+   }
+   if (result) {
        cerr << "error writing book" << endl;
        return -1;
    }
    else {
-       cout << positions << " positions, " << total_moves << " total moves in book." << endl;
-       cout << "book capacity is about " << indexPages*book::INDEX_PAGE_SIZE << " positions." << endl;
+       cout << writer.positionCount() << " positions, " << writer.moveCount() << " total moves in book." << endl;
        return 0;
    }
 }